@@ -142,7 +142,7 @@ void setup(void)
 
 void loop(void)
 {
-    static float ax, ay, az, gx, gy, gz, mx, my, mz, temperature;
+    static MPUIMU::Sample_t sample;
 
     // If INTERRUPT_PIN goes high, either all data registers have new data
     // or the accel wake on motion threshold has been crossed
@@ -152,10 +152,9 @@ void loop(void)
 
         if (imu.checkNewData())  { // data ready interrupt is detected
 
-            imu.readAccelerometer(ax, ay, az);
-            imu.readGyrometer(gx, gy, gz);
-            imu.readMagnetometer(mx, my, mz);
-            temperature = imu.readTemperature();
+            // Accelerometer, gyrometer, and thermometer in one burst, which takes in the
+            // magnetometer only when a new reading is due; sample.mag holds the last one
+            imu.readAll(sample);
         }
     }
 
@@ -167,27 +166,29 @@ void loop(void)
 
         msec_prev = msec_curr;
 
-        reportAcceleration("X", ax);
-        reportAcceleration("Y", ay);
-        reportAcceleration("Z", az);
+        reportAcceleration("X", sample.accel[0]);
+        reportAcceleration("Y", sample.accel[1]);
+        reportAcceleration("Z", sample.accel[2]);
 
         Serial.println();
 
-        reportGyroRate("X", gx);
-        reportGyroRate("Y", gy);
-        reportGyroRate("Z", gz);
+        reportGyroRate("X", sample.gyro[0]);
+        reportGyroRate("Y", sample.gyro[1]);
+        reportGyroRate("Z", sample.gyro[2]);
 
         Serial.println();;
 
-        reportMagnetometer("X", mx);
-        reportMagnetometer("Y", my);
-        reportMagnetometer("Z", mz);
+        reportMagnetometer("X", sample.mag[0]);
+        reportMagnetometer("Y", sample.mag[1]);
+        reportMagnetometer("Z", sample.mag[2]);
 
-        Serial.println();;
+        Serial.print("(");
+        Serial.print(sample.magAge);
+        Serial.println(" samples old)");
 
         // Print temperature in degrees Centigrade      
         Serial.print("Gyro temperature is ");  
-        Serial.print(temperature, 1);  
+        Serial.print(sample.temperature, 1);  
         Serial.println(" degrees C\n"); 
     }
 }
@@ -0,0 +1,713 @@
+/*
+   Bench.cpp: throughput, latency, bus-traffic, and CPU-time benchmark for the MPU classes
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <MPU6050.h>
+#include <MPU9250_Master_I2C.h>
+#include <MPU9250_Passthru.h>
+#include <MPU9250_Mock.h>
+#include <MPUBus.h>
+
+#if defined(BENCH_SPI)
+#include <MPU6000.h>
+#include <MPU6500.h>
+#include <MPU9250_Master_SPI.h>
+#include <MPU6500_Mock.h>
+#endif
+
+#if defined(BENCH_NULL_BUS)
+#include "NullBus.h"
+#endif
+
+#include "BusCounter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+/*
+   Each device is begun and then read for a fixed time along each access path:
+
+   single: readAccelerometer(), readGyrometer(), readTemperature(), and readMagnetometer()
+   burst:  readAll()
+   fifo:   readFifo() of accelerometer and gyrometer frames, FIFO_BATCH at a time
+
+   The single and burst paths poll checkNewData() and read once per new sample; the fifo path
+   reads whatever has accumulated and sleeps while it refills.  Polls are included in the bus
+   traffic, since they are part of what a sample costs.  Latency is the time from the start of
+   a read to its converted result; for the fifo path it is per batch.
+
+   The mock devices run against MPUSimulator, whose clock is advanced instead of waited on, so
+   they measure the library's CPU cost at the simulated rate.  Given a trace recorded with -w
+   (on any build), -R replays it to them.
+
+   Results are written one JSON object per line, per device and path.  With no -p or -R, the
+   mocks also run checks.  On the MPU9250, a host reading at half the IMU rate, out of step with
+   the magnetometer, must still catch every new magnetometer reading of a changing field.  On the
+   MPU6500, which leaves its calibration bias in the output, one adjustGyroBias() by the residual
+   must take readGyrometer() and readAll() alike to zero.  A failed check makes the exit status
+   nonzero.
+ */
+
+static const MPUIMU::Gscale_t  GSCALE = MPUIMU::GFS_250DPS;
+static const MPUIMU::Ascale_t  ASCALE = MPUIMU::AFS_2G;
+static const MPU9250::Mscale_t MSCALE = MPU9250::MFS_16BITS;
+static const MPU9250::Mmode_t  MMODE  = MPU9250::M_100Hz;
+
+static const uint16_t FIFO_BATCH = 32;
+
+typedef enum {
+
+    PATH_SINGLE,
+    PATH_BURST,
+    PATH_FIFO,
+    PATH_COUNT
+
+} Path_t;
+
+static const char * PATH_NAMES[PATH_COUNT] = { "single", "burst", "fifo" };
+
+// Command-line options
+static uint8_t     _divisor     = 0;
+static double      _seconds     = 2;
+static uint8_t     _i2cBus      = 1;
+static bool        _magAutoRead = false;
+static const char * _device     = NULL;
+static const char * _path       = NULL;
+static FILE       * _out        = stdout;
+static std::vector<uint8_t> _replay;
+
+static bool _checkFailed = false;
+
+typedef struct {
+
+    uint64_t samples;
+    uint64_t reads;
+    uint64_t wallNsec;
+    uint64_t cpuNsec;
+
+    std::vector<uint32_t> latencies; // nanoseconds, one per read
+
+} Run_t;
+
+static uint64_t nsec(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleepNsec(uint64_t ns)
+{
+    struct timespec ts = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    nanosleep(&ts, NULL);
+}
+
+// Waits out ns, or (for zero) spins for the next poll
+static void idle(MPUIMU & imu, uint64_t ns)
+{
+    (void)imu;
+    if (ns) {
+        sleepNsec(ns);
+    }
+}
+
+// Simulated devices skip ahead instead, by a sample period when no time is given
+static void idle(MPUSimulator & sim, uint64_t ns)
+{
+    sim.advance(ns ? (uint32_t)(ns / 1000) : (uint32_t)(1e6 / sim.getSampleRate()) + 1);
+}
+
+static void idle(MPU9250_Mock & imu, uint64_t ns)
+{
+    idle(imu.getSimulator(), ns);
+}
+
+#if defined(BENCH_SPI)
+static void idle(MPU6500_Mock & imu, uint64_t ns)
+{
+    idle(imu.getSimulator(), ns);
+}
+#endif
+
+// Only the MPU9250 has a magnetometer
+static void readMag(MPU9250 & imu, MPUIMU::Sample_t & sample)
+{
+    imu.readMagnetometer(sample.mag[0], sample.mag[1], sample.mag[2]);
+}
+
+static void readMag(MPUIMU & imu, MPUIMU::Sample_t & sample)
+{
+    (void)imu;
+    sample.mag[0] = sample.mag[1] = sample.mag[2] = 0;
+}
+
+static void prepare(MPU9250_Master & imu)
+{
+    if (_magAutoRead) {
+        imu.enableMagAutoRead();
+    }
+}
+
+static void prepare(MPUIMU & imu)
+{
+    (void)imu;
+}
+
+// Device is the static type, so the MPUBusDevice variants are measured with their
+// devirtualized reads rather than through the base class
+template <class Device>
+static void readSample(Device & imu, Path_t path, MPUIMU::Sample_t & sample)
+{
+    if (path == PATH_BURST) {
+        imu.readAll(sample);
+        return;
+    }
+
+    imu.readAccelerometer(sample.accel[0], sample.accel[1], sample.accel[2]);
+    imu.readGyrometer(sample.gyro[0], sample.gyro[1], sample.gyro[2]);
+    sample.temperature = imu.readTemperature();
+    readMag(imu, sample);
+}
+
+template <class Device>
+static void runPolled(Device & imu, Path_t path, Run_t & run, uint64_t deadline)
+{
+    MPUIMU::Sample_t sample;
+
+    while (nsec(CLOCK_MONOTONIC) < deadline) {
+
+        if (!imu.checkNewData()) {
+            idle(imu, 0);
+            continue;
+        }
+
+        uint64_t start = nsec(CLOCK_MONOTONIC);
+        readSample(imu, path, sample);
+        run.latencies.push_back((uint32_t)(nsec(CLOCK_MONOTONIC) - start));
+
+        run.samples++;
+        run.reads++;
+    }
+}
+
+template <class Device>
+static void runFifo(Device & imu, Run_t & run, uint64_t deadline)
+{
+    MPUIMU::Sample_t samples[FIFO_BATCH];
+
+    uint64_t period = (uint64_t)(1e9 / imu.getSampleRate());
+
+    imu.enableFifo(MPUIMU::FIFO_ACCEL | MPUIMU::FIFO_GYRO);
+
+    while (nsec(CLOCK_MONOTONIC) < deadline) {
+
+        uint64_t start = nsec(CLOCK_MONOTONIC);
+        uint16_t count = imu.readFifo(samples, FIFO_BATCH);
+
+        if (count > 0) {
+            run.latencies.push_back((uint32_t)(nsec(CLOCK_MONOTONIC) - start));
+            run.samples += count;
+            run.reads++;
+        }
+
+        // Wait for the rest of a batch to arrive
+        if (count < FIFO_BATCH) {
+            idle(imu, (FIFO_BATCH - count) * period);
+        }
+    }
+
+    imu.disableFifo();
+}
+
+static double percentile(const std::vector<uint32_t> & sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+
+    return sorted[(size_t)(p * (sorted.size() - 1) + 0.5)] / 1e3;
+}
+
+static void report(const char * device, const char * bus, Path_t path, Run_t & run)
+{
+    std::sort(run.latencies.begin(), run.latencies.end());
+
+    double samples = run.samples ? (double)run.samples : 1;
+
+    fprintf(_out, "{\"device\": \"%s\", \"bus\": \"%s\", \"path\": \"%s\", \"divisor\": %u, \"mag_auto_read\": %s, "
+            "\"samples\": %llu, \"reads\": %llu, \"seconds\": %.3f, \"samples_per_sec\": %.1f, "
+            "\"latency_usec\": {\"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}, "
+            "\"transactions_per_sample\": %.3f, \"bytes_per_sample\": %.2f, "
+            "\"reads_per_sample\": %.3f, \"writes_per_sample\": %.3f, "
+            "\"cpu_usec_per_sample\": %.3f, \"wall_nsec_per_sample\": %.1f}\n",
+            device, bus, PATH_NAMES[path], _divisor, _magAutoRead ? "true" : "false",
+            (unsigned long long)run.samples, (unsigned long long)run.reads,
+            run.wallNsec / 1e9, run.samples / (run.wallNsec / 1e9),
+            percentile(run.latencies, .50), percentile(run.latencies, .90),
+            percentile(run.latencies, .99), percentile(run.latencies, 1),
+            busCounts.transactions / samples, busCounts.bytes / samples,
+            busCounts.reads / samples, busCounts.writes / samples,
+            run.cpuNsec / 1e3 / samples, run.wallNsec / samples);
+
+    fflush(_out);
+}
+
+template <class Device>
+static void runPaths(Device & imu, const char * device, const char * bus)
+{
+    for (uint8_t p=0; p<PATH_COUNT; ++p) {
+
+        if (_path && strcmp(_path, PATH_NAMES[p])) {
+            continue;
+        }
+
+        Path_t path = (Path_t)p;
+
+        Run_t run;
+        run.samples = 0;
+        run.reads   = 0;
+        run.latencies.reserve((size_t)(_seconds * 100000));
+
+        busCountsReset();
+
+        uint64_t wall = nsec(CLOCK_MONOTONIC);
+        uint64_t cpu  = nsec(CLOCK_PROCESS_CPUTIME_ID);
+        uint64_t deadline = wall + (uint64_t)(_seconds * 1e9);
+
+        if (path == PATH_FIFO) {
+            runFifo(imu, run, deadline);
+        }
+        else {
+            runPolled(imu, path, run, deadline);
+        }
+
+        run.wallNsec = nsec(CLOCK_MONOTONIC) - wall;
+        run.cpuNsec  = nsec(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+        report(device, bus, path, run);
+    }
+}
+
+// Calibration is irrelevant to the timing, so restore an empty one and skip it
+template <class Device>
+static bool started(Device & imu, MPUIMU::Error_t error, const char * device)
+{
+    if (error != MPUIMU::ERROR_NONE) {
+        fprintf(stderr, "%s: begin() failed with error %d\n", device, error);
+        return false;
+    }
+
+    prepare(imu);
+
+    return true;
+}
+
+template <class Device>
+static void warmStart(Device & imu)
+{
+    MPUIMU::Calibration_t calibration;
+    imu.getCalibration(calibration);
+    imu.setCalibration(calibration);
+}
+
+template <class Device>
+static void benchI2C(Device & imu, const char * device)
+{
+    warmStart(imu);
+
+    if (started(imu, imu.begin(_i2cBus), device)) {
+        runPaths(imu, device, "i2c");
+    }
+}
+
+template <class Device>
+static void benchSPI(Device & imu, const char * device)
+{
+    warmStart(imu);
+
+    if (started(imu, imu.begin(), device)) {
+        runPaths(imu, device, "spi");
+    }
+}
+
+static void mpu6050(const char * name)
+{
+    MPU6050 imu(ASCALE, GSCALE, _divisor);
+    benchI2C(imu, name);
+}
+
+static void mpu6050Bus(const char * name)
+{
+    MPU6050_Bus imu(ASCALE, GSCALE, _divisor);
+    benchI2C(imu, name);
+}
+
+static void mpu9250Master(const char * name)
+{
+    MPU9250_Master_I2C imu(ASCALE, GSCALE, MSCALE, MMODE, _divisor);
+    benchI2C(imu, name);
+}
+
+static void mpu9250MasterBus(const char * name)
+{
+    MPU9250_Master_I2C_Bus imu(ASCALE, GSCALE, MSCALE, MMODE, _divisor);
+    benchI2C(imu, name);
+}
+
+static void mpu9250Passthru(const char * name)
+{
+    MPU9250_Passthru imu(ASCALE, GSCALE, MSCALE, MMODE, _divisor);
+    benchI2C(imu, name);
+}
+
+template <class Mock>
+static void benchMock(Mock & imu, const char * device)
+{
+    if (!_replay.empty()) {
+        imu.getSimulator().replay(&_replay[0], (uint32_t)_replay.size());
+    }
+
+    if (started(imu, imu.begin(), device)) {
+        runPaths(imu, device, "sim");
+    }
+}
+
+// Simulated seconds, and the share of the magnetometer readings that must be caught
+static const double MAG_CHECK_SECONDS = 5;
+static const double MAG_CHECK_CAUGHT  = 0.95;
+
+static void checkMagHalfRate(const char * device)
+{
+    MPU9250_Mock imu(ASCALE, GSCALE, MSCALE, MMODE, 0);
+
+    if (!started(imu, imu.begin(), device)) {
+        _checkFailed = true;
+        return;
+    }
+
+    MPUSimulator & sim = imu.getSimulator();
+    sim.setTransferTime(0);
+
+    uint32_t period = (uint32_t)(2e6 / imu.getSampleRate());
+    uint32_t reads  = (uint32_t)(MAG_CHECK_SECONDS * 1e6 / period);
+    uint32_t caught = 0;
+
+    MPUIMU::Sample_t sample;
+
+    for (uint32_t k=0; k<reads; ++k) {
+
+        sim.advance(period);
+
+        // A ramp, so that no two readings are alike
+        sim.setMag(100 + (float)(k % 1000), 0, 0);
+
+        imu.readAll(sample);
+
+        if (sample.magAge == 0) {
+            caught++;
+        }
+    }
+
+    double expected = MAG_CHECK_SECONDS * (MMODE == MPU9250::M_8Hz ? 8 : 100);
+    bool pass = caught >= MAG_CHECK_CAUGHT * expected;
+
+    fprintf(_out, "{\"device\": \"%s\", \"check\": \"mag_half_rate\", \"readings\": %u, \"expected\": %.0f, \"pass\": %s}\n",
+            device, caught, expected, pass ? "true" : "false");
+
+    fflush(_out);
+
+    if (!pass) {
+        _checkFailed = true;
+    }
+}
+
+static void mpu9250Mock(const char * name)
+{
+    {
+        MPU9250_Mock imu(ASCALE, GSCALE, MSCALE, MMODE, _divisor);
+        benchMock(imu, name);
+    }
+
+    if (!_path && _replay.empty()) {
+        checkMagHalfRate(name);
+    }
+}
+
+#if defined(BENCH_SPI)
+
+// A gyro bias that the MPU6500 leaves in its output, restored as a stored calibration would be, and
+// how close to zero one adjustGyroBias() by the residual seen must bring every read path
+static const float GYRO_CHECK_BIAS[3]   = { 2, -1, 0.5f };
+static const float GYRO_CHECK_TOLERANCE = 0.05f;
+
+class GyroCheckMock : public MPU6500_Mock {
+
+    public:
+
+        GyroCheckMock(void) : MPU6500_Mock(ASCALE, GSCALE, 0) { }
+
+        void restoreGyroBias(const float bias[3])
+        {
+            setBiases(_accelBias, bias);
+        }
+};
+
+static bool nearZero(const float gyro[3])
+{
+    for (uint8_t k=0; k<3; ++k) {
+        if (gyro[k] < -GYRO_CHECK_TOLERANCE || gyro[k] > GYRO_CHECK_TOLERANCE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void checkGyroResidual(const char * device)
+{
+    GyroCheckMock imu;
+
+    MPUSimulator & sim = imu.getSimulator();
+    sim.setGyro(GYRO_CHECK_BIAS[0], GYRO_CHECK_BIAS[1], GYRO_CHECK_BIAS[2]);
+
+    if (!started(imu, imu.begin(), device)) {
+        _checkFailed = true;
+        return;
+    }
+
+    imu.restoreGyroBias(GYRO_CHECK_BIAS);
+    idle(sim, 0);
+
+    float residual[3], applied[3];
+    imu.readGyrometer(residual[0], residual[1], residual[2]);
+    imu.adjustGyroBias(residual, applied);
+    idle(sim, 0);
+
+    float single[3];
+    imu.readGyrometer(single[0], single[1], single[2]);
+
+    MPUIMU::Sample_t sample;
+    imu.readAll(sample);
+
+    bool pass = nearZero(single) && nearZero(sample.gyro);
+
+    fprintf(_out, "{\"device\": \"%s\", \"check\": \"gyro_residual\", \"single\": [%.3f, %.3f, %.3f], "
+            "\"burst\": [%.3f, %.3f, %.3f], \"pass\": %s}\n", device, single[0], single[1], single[2],
+            sample.gyro[0], sample.gyro[1], sample.gyro[2], pass ? "true" : "false");
+
+    fflush(_out);
+
+    if (!pass) {
+        _checkFailed = true;
+    }
+}
+
+static void mpu6500Mock(const char * name)
+{
+    {
+        MPU6500_Mock imu(ASCALE, GSCALE, _divisor);
+        benchMock(imu, name);
+    }
+
+    if (!_path && _replay.empty()) {
+        checkGyroResidual(name);
+    }
+}
+
+static void mpu6000(const char * name)
+{
+    MPU6000 imu(ASCALE, GSCALE, _divisor);
+    benchSPI(imu, name);
+}
+
+static void mpu6000Bus(const char * name)
+{
+    MPU6000_Bus imu(ASCALE, GSCALE, _divisor);
+    benchSPI(imu, name);
+}
+
+static void mpu6500(const char * name)
+{
+    MPU6500 imu(ASCALE, GSCALE, _divisor);
+    benchSPI(imu, name);
+}
+
+static void mpu6500Bus(const char * name)
+{
+    MPU6500_Bus imu(ASCALE, GSCALE, _divisor);
+    benchSPI(imu, name);
+}
+
+static void mpu9250MasterSPI(const char * name)
+{
+    MPU9250_Master_SPI imu(ASCALE, GSCALE, MSCALE, MMODE, _divisor);
+    benchSPI(imu, name);
+}
+
+static void mpu9250MasterSPIBus(const char * name)
+{
+    MPU9250_Master_SPI_Bus imu(ASCALE, GSCALE, MSCALE, MMODE, _divisor);
+    benchSPI(imu, name);
+}
+
+#endif // BENCH_SPI
+
+typedef struct {
+
+    const char * name;
+    void (*bench)(const char * name);
+    uint8_t whoAmI; // for the null bus
+
+} Device_t;
+
+static const Device_t DEVICES[] = {
+
+    { "mpu6050",                mpu6050,             0x68 },
+    { "mpu6050-bus",            mpu6050Bus,          0x68 },
+    { "mpu9250-master",         mpu9250Master,       0x71 },
+    { "mpu9250-master-bus",     mpu9250MasterBus,    0x71 },
+    { "mpu9250-passthru",       mpu9250Passthru,     0x71 },
+    { "mpu9250-mock",           mpu9250Mock,         0x71 },
+#if defined(BENCH_SPI)
+    { "mpu6000",                mpu6000,             0x68 },
+    { "mpu6000-bus",            mpu6000Bus,          0x68 },
+    { "mpu6500",                mpu6500,             0x70 },
+    { "mpu6500-bus",            mpu6500Bus,          0x70 },
+    { "mpu9250-master-spi",     mpu9250MasterSPI,    0x71 },
+    { "mpu9250-master-spi-bus", mpu9250MasterSPIBus, 0x71 },
+    { "mpu6500-mock",           mpu6500Mock,         0x70 },
+#endif
+};
+
+static bool loadTrace(const char * filename)
+{
+    FILE * fp = fopen(filename, "rb");
+
+    if (!fp) {
+        return false;
+    }
+
+    uint8_t buffer[4096];
+    size_t count;
+
+    while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        _replay.insert(_replay.end(), buffer, buffer+count);
+    }
+
+    fclose(fp);
+
+    return true;
+}
+
+static void usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [-d device] [-p single|burst|fifo] [-t seconds] [-r divisor] [-b i2cbus] [-a] [-o file] [-w trace] [-R trace]\n", program);
+    fprintf(stderr, "  -a  enable magnetometer auto-read in master mode\n");
+    fprintf(stderr, "  -w  record the bus transfers to a trace\n");
+    fprintf(stderr, "  -R  replay a trace to the mock devices\nDevices:");
+    for (size_t k=0; k<sizeof(DEVICES)/sizeof(DEVICES[0]); ++k) {
+        fprintf(stderr, " %s", DEVICES[k].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "d:p:t:r:b:ao:w:R:h")) != -1) {
+
+        switch (c) {
+            case 'd':
+                _device = optarg;
+                break;
+            case 'p':
+                _path = optarg;
+                break;
+            case 't':
+                _seconds = atof(optarg);
+                break;
+            case 'r':
+                _divisor = (uint8_t)atoi(optarg);
+                break;
+            case 'b':
+                _i2cBus = (uint8_t)atoi(optarg);
+                break;
+            case 'a':
+                _magAutoRead = true;
+                break;
+            case 'o':
+                if (!(_out = fopen(optarg, "w"))) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                {
+                    FILE * trace = fopen(optarg, "wb");
+                    if (!trace) {
+                        perror(optarg);
+                        return 1;
+                    }
+                    busTraceOpen(trace);
+                }
+                break;
+            case 'R':
+                if (!loadTrace(optarg)) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    bool found = false;
+
+    for (size_t k=0; k<sizeof(DEVICES)/sizeof(DEVICES[0]); ++k) {
+
+        if (_device && strcmp(_device, DEVICES[k].name)) {
+            continue;
+        }
+
+#if defined(BENCH_NULL_BUS)
+        nullbus_begin(DEVICES[k].whoAmI);
+#endif
+        DEVICES[k].bench(DEVICES[k].name);
+
+        found = true;
+    }
+
+    if (!found) {
+        usage(argv[0]);
+    }
+
+    if (_out != stdout) {
+        fclose(_out);
+    }
+
+    return _checkFailed ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/*
+   BusCounter.cpp: Bus transaction and byte counts for benchmarking
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The real transfer functions, under other names
+#define cpi2c_open          real_cpi2c_open
+#define cpi2c_writeRegister real_cpi2c_writeRegister
+#define cpi2c_readRegisters real_cpi2c_readRegisters
+#define cpspi_writeRegister real_cpspi_writeRegister
+#define cpspi_readRegisters real_cpspi_readRegisters
+#define cpspi_transfer      real_cpspi_transfer
+
+#define mpui2c_open           real_mpui2c_open
+#define mpui2c_readRegisters  real_mpui2c_readRegisters
+#define mpui2c_writeRegisters real_mpui2c_writeRegisters
+
+#include BUS_IMPL
+
+// The library's own I^2C transfers, on top of the real cpi2c_* ones
+#include <MPUI2C.cpp>
+
+#undef mpui2c_open
+#undef mpui2c_readRegisters
+#undef mpui2c_writeRegisters
+
+#undef cpi2c_open
+#undef cpi2c_writeRegister
+#undef cpi2c_readRegisters
+#undef cpspi_writeRegister
+#undef cpspi_readRegisters
+#undef cpspi_transfer
+
+#include "BusCounter.h"
+
+#include <MPUSimulator.h>
+
+#include <string.h>
+
+BusCounts_t busCounts;
+
+static FILE * _trace;
+
+// Traces name devices by address; platforms may hand out some other handle
+static uint8_t _addresses[256];
+
+void busCountsReset(void)
+{
+    memset(&busCounts, 0, sizeof(busCounts));
+}
+
+void busTraceOpen(FILE * trace)
+{
+    _trace = trace;
+}
+
+static void countRead(uint8_t address, uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    busCounts.transactions++;
+    busCounts.reads++;
+    busCounts.bytes += 1 + count;
+
+    if (_trace) {
+        uint8_t header[3] = { address, (uint8_t)(subAddress & 0x7F), count };
+        fwrite(header, 1, 3, _trace);
+        fwrite(data, 1, count, _trace);
+    }
+}
+
+static void countWrite(uint8_t address, uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    busCounts.transactions++;
+    busCounts.writes++;
+    busCounts.bytes += 1 + count;
+
+    if (_trace) {
+        uint8_t header[3] = { (uint8_t)(address | MPUSimulator::TRACE_WRITE), (uint8_t)(subAddress & 0x7F), count };
+        fwrite(header, 1, 3, _trace);
+        fwrite(data, 1, count, _trace);
+    }
+}
+
+uint8_t cpi2c_open(uint8_t address, uint8_t bus)
+{
+    uint8_t handle = real_cpi2c_open(address, bus);
+    _addresses[handle] = address;
+    return handle;
+}
+
+bool cpi2c_writeRegister(uint8_t address, uint8_t subAddress, uint8_t data)
+{
+    countWrite(_addresses[address], subAddress, 1, &data);
+    return real_cpi2c_writeRegister(address, subAddress, data);
+}
+
+bool cpi2c_readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    bool ok = real_cpi2c_readRegisters(address, subAddress, count, dest);
+    countRead(_addresses[address], subAddress, count, dest);
+    return ok;
+}
+
+uint8_t mpui2c_open(uint8_t address, uint8_t bus, uint32_t & clock)
+{
+    uint8_t handle = real_mpui2c_open(address, bus, clock);
+    _addresses[handle] = address;
+    return handle;
+}
+
+bool mpui2c_readRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    bool ok = real_mpui2c_readRegisters(handle, subAddress, count, dest);
+    countRead(_addresses[handle], subAddress, count, dest);
+    return ok;
+}
+
+bool mpui2c_writeRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    countWrite(_addresses[handle], subAddress, count, data);
+    return real_mpui2c_writeRegisters(handle, subAddress, count, data);
+}
+
+#if defined(BENCH_SPI)
+
+void cpspi_writeRegister(uint8_t subAddress, uint8_t data)
+{
+    countWrite(MPUSimulator::MPU_ADDRESS, subAddress, 1, &data);
+    real_cpspi_writeRegister(subAddress, data);
+}
+
+bool cpspi_readRegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    bool ok = real_cpspi_readRegisters(subAddress, count, dest);
+    countRead(MPUSimulator::MPU_ADDRESS, subAddress, count, dest);
+    return ok;
+}
+
+// One address byte out, then count-1 data bytes back for a read (the read flag set), or out for a write
+bool cpspi_transfer(const uint8_t * send, uint8_t * recv, uint8_t count)
+{
+    if (!(send[0] & 0x80)) {
+        countWrite(MPUSimulator::MPU_ADDRESS, send[0], count-1, &send[1]);
+        return real_cpspi_transfer(send, recv, count);
+    }
+
+    bool ok = real_cpspi_transfer(send, recv, count);
+    countRead(MPUSimulator::MPU_ADDRESS, send[0], count-1, &recv[1]);
+    return ok;
+}
+
+#endif // BENCH_SPI
@@ -0,0 +1,45 @@
+/*
+   BusCounter.h: Bus transaction and byte counts for benchmarking
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// BusCounter.cpp compiles the platform's bus implementation (named by BUS_IMPL) with its
+// transfer functions renamed, along with the library's MPUI2C.cpp, and puts counting cpi2c_*,
+// mpui2c_* (and, with BENCH_SPI, cpspi_*) functions in front of them, so every transfer the library
+// makes is counted, whichever class or code path it comes from.  Bytes include the register address
+// sent ahead of the data.
+typedef struct {
+
+    uint64_t transactions;
+    uint64_t bytes;
+    uint64_t reads;
+    uint64_t writes;
+
+} BusCounts_t;
+
+extern BusCounts_t busCounts;
+
+void busCountsReset(void);
+
+// Also write every transfer to trace, in the format MPUSimulator::replay() reads; NULL stops
+void busTraceOpen(FILE * trace);
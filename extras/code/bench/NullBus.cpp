@@ -0,0 +1,201 @@
+/*
+   NullBus.cpp: In-memory stand-in for CrossPlatformDataBus, for benchmarking without hardware
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NullBus.h"
+
+#include <CrossPlatformI2C.h>
+#include <CrossPlatformSPI.h>
+
+#include <string.h>
+
+// Registers the emulation treats specially
+static const uint8_t I2C_SLV0_ADDR    = 0x25;
+static const uint8_t I2C_SLV0_REG     = 0x26;
+static const uint8_t I2C_SLV0_CTRL    = 0x27;
+static const uint8_t INT_STATUS       = 0x3A;
+static const uint8_t ACCEL_XOUT_H     = 0x3B;
+static const uint8_t EXT_SENS_DATA_00 = 0x49;
+static const uint8_t EXT_SENS_DATA_23 = 0x60;
+static const uint8_t I2C_SLV0_DO      = 0x63;
+static const uint8_t PWR_MGMT_1       = 0x6B;
+static const uint8_t FIFO_COUNTH      = 0x72;
+static const uint8_t FIFO_R_W         = 0x74;
+static const uint8_t WHO_AM_I         = 0x75;
+
+static const uint8_t AK8963_ADDRESS   = 0x0C;
+
+// Frames the FIFO claims to hold: enough that every readFifo() gets a full batch
+static const uint16_t FIFO_BYTES = 480;
+
+static uint8_t _mpu[128];
+static uint8_t _ak[32];
+
+// Accelerometer 1 g on Z, thermometer ~25 C, gyrometer zero, in register order
+static const uint8_t SENSORS[14] = { 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+void nullbus_begin(uint8_t whoAmI)
+{
+    memset(_mpu, 0, sizeof(_mpu));
+    memset(_ak, 0, sizeof(_ak));
+
+    memcpy(&_mpu[ACCEL_XOUT_H], SENSORS, sizeof(SENSORS));
+    _mpu[INT_STATUS]    = 0x01; // data ready
+    _mpu[FIFO_COUNTH]   = FIFO_BYTES >> 8;
+    _mpu[FIFO_COUNTH+1] = FIFO_BYTES & 0xFF;
+    _mpu[WHO_AM_I]      = whoAmI;
+
+    _ak[0x00] = 0x48; // WIA
+    _ak[0x02] = 0x01; // ST1: data ready
+    _ak[0x03] = 0x2C; // HXL..HZH: a modest field
+    _ak[0x04] = 0x01;
+    _ak[0x05] = 0x90;
+    _ak[0x06] = 0xFF;
+    _ak[0x07] = 0x20;
+    _ak[0x08] = 0x03;
+    _ak[0x09] = 0x10; // ST2: 16-bit output, no overflow
+    _ak[0x10] = 0x80; // ASAX..ASAZ: unity adjustment
+    _ak[0x11] = 0x80;
+    _ak[0x12] = 0x80;
+}
+
+static bool isReadOnly(uint8_t subAddress)
+{
+    return (subAddress >= INT_STATUS && subAddress <= EXT_SENS_DATA_23) ||
+        subAddress == FIFO_COUNTH || subAddress == FIFO_COUNTH+1 || subAddress == WHO_AM_I;
+}
+
+// Slave 0 runs once, as soon as it is enabled
+static void runSlave0(uint8_t ctrl)
+{
+    if (!(ctrl & 0x80) || (_mpu[I2C_SLV0_ADDR] & 0x7F) != AK8963_ADDRESS) {
+        return;
+    }
+
+    uint8_t reg   = _mpu[I2C_SLV0_REG] & 0x1F;
+    uint8_t count = ctrl & 0x0F;
+
+    if (_mpu[I2C_SLV0_ADDR] & 0x80) {
+        for (uint8_t k=0; k<count; ++k) {
+            _mpu[EXT_SENS_DATA_00+k] = _ak[(reg+k) & 0x1F];
+        }
+    }
+    else {
+        _ak[reg] = _mpu[I2C_SLV0_DO];
+    }
+}
+
+static void writeMPU(uint8_t subAddress, uint8_t data)
+{
+    subAddress &= 0x7F;
+
+    if (isReadOnly(subAddress)) {
+        return;
+    }
+
+    // The reset bit clears itself
+    _mpu[subAddress] = (subAddress == PWR_MGMT_1) ? (data & 0x7F) : data;
+
+    if (subAddress == I2C_SLV0_CTRL) {
+        runSlave0(data);
+    }
+}
+
+static void readMPU(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    subAddress &= 0x7F;
+
+    // FIFO_R_W does not auto-increment; hand out accel/gyro frames
+    if (subAddress == FIFO_R_W) {
+        for (uint16_t k=0; k<count; ++k) {
+            uint8_t j = k % 12;
+            dest[k] = SENSORS[j < 6 ? j : j+2];
+        }
+        return;
+    }
+
+    for (uint8_t k=0; k<count; ++k) {
+        dest[k] = _mpu[(subAddress+k) & 0x7F];
+    }
+}
+
+uint8_t cpi2c_open(uint8_t address, uint8_t bus)
+{
+    (void)bus;
+    return address;
+}
+
+bool cpi2c_writeRegister(uint8_t address, uint8_t subAddress, uint8_t data)
+{
+    if (address == AK8963_ADDRESS) {
+        _ak[subAddress & 0x1F] = data;
+    }
+    else {
+        writeMPU(subAddress, data);
+    }
+    return true;
+}
+
+bool cpi2c_readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    if (address == AK8963_ADDRESS) {
+        for (uint8_t k=0; k<count; ++k) {
+            dest[k] = _ak[(subAddress+k) & 0x1F];
+        }
+    }
+    else {
+        readMPU(subAddress, count, dest);
+    }
+    return true;
+}
+
+void cpspi_writeRegister(uint8_t subAddress, uint8_t data)
+{
+    writeMPU(subAddress, data);
+}
+
+bool cpspi_readRegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    readMPU(subAddress, count, dest);
+    return true;
+}
+
+// Full-duplex: the first byte out is the register address, the data comes back behind it,
+// or follows it for a write
+bool cpspi_transfer(const uint8_t * send, uint8_t * recv, uint8_t count)
+{
+    memset(recv, 0, count);
+
+    if (send[0] & 0x80) {
+        readMPU(send[0], count-1, &recv[1]);
+    }
+    else {
+        for (uint8_t k=1; k<count; ++k) {
+            writeMPU(send[0]+k-1, send[k]);
+        }
+    }
+
+    return true;
+}
+
+// Nothing to wait for
+void delay(uint32_t msec)
+{
+    (void)msec;
+}
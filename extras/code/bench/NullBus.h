@@ -0,0 +1,29 @@
+/*
+   NullBus.h: In-memory stand-in for CrossPlatformDataBus, for benchmarking without hardware
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Provides cpi2c_* and cpspi_* over a register file that reports a still, level sensor: data
+// is always ready, the FIFO always holds a full batch, and slave 0 writes go straight to an
+// emulated AK8963.  With no bus time to wait for, a benchmark run measures the CPU cost alone.
+// Resets the register file and sets the WHO_AM_I value the device class under test expects.
+void nullbus_begin(uint8_t whoAmI);
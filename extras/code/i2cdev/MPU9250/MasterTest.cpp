@@ -76,14 +76,13 @@ void setup()
 
 void loop()
 {  
-    static float ax, ay, az, gx, gy, gz, mx, my, mz, temperature;
+    static MPUIMU::Sample_t sample;
 
     if (imu.checkNewData())  {
 
-        imu.readAccelerometer(ax, ay, az);
-        imu.readGyrometer(gx, gy, gz);
-        imu.readMagnetometer(mx, my, mz);
-        temperature = imu.readTemperature();
+        // Accelerometer, gyrometer, and thermometer in one burst, which takes in the
+        // magnetometer only when a new reading is due; sample.mag holds the last one
+        imu.readAll(sample);
     }
 
     // Report at 4 HZ
@@ -93,9 +92,9 @@ void loop()
 
         usec_prev = usec_curr;
 
-        printf("\nax = %d  ay = %d  az = %d mg\n", (int)(1000*ax), (int)(1000*ay), (int)(1000*az));
-        printf("gx = %+2.2f  gy = %+2.2f  gz = %+2.2f deg/s\n", gx, gy, gz);
-        printf("mx = %d  my = %d  mz = %d mG\n", (int)mx, (int)my, (int)mz);
-        printf("Gyro temperature is %+1.1f degrees C\n", temperature);  
+        printf("\nax = %d  ay = %d  az = %d mg\n", (int)(1000*sample.accel[0]), (int)(1000*sample.accel[1]), (int)(1000*sample.accel[2]));
+        printf("gx = %+2.2f  gy = %+2.2f  gz = %+2.2f deg/s\n", sample.gyro[0], sample.gyro[1], sample.gyro[2]);
+        printf("mx = %d  my = %d  mz = %d mG (%u samples old)\n", (int)sample.mag[0], (int)sample.mag[1], (int)sample.mag[2], sample.magAge);
+        printf("Gyro temperature is %+1.1f degrees C\n", sample.temperature);  
     }
 }
@@ -85,7 +85,7 @@ void setup()
 
 void loop()
 {  
-    static float ax, ay, az, gx, gy, gz, mx, my, mz, temperature;
+    static MPUIMU::Sample_t sample;
 
     // If INTERRUPT_PIN goes high, either all data registers have new data
     // or the accel wake on motion threshold has been crossed
@@ -95,10 +95,8 @@ void loop()
 
         if (imu.checkNewData())  { // data ready interrupt is detected
 
-            imu.readAccelerometer(ax, ay, az);
-            imu.readGyrometer(gx, gy, gz);
-            imu.readMagnetometer(mx, my, mz);
-            temperature = imu.readTemperature();
+            // Accelerometer, gyrometer, thermometer, and magnetometer in one burst
+            imu.readAll(sample);
         }
     }
 
@@ -112,11 +110,11 @@ void loop()
 
         printf("\n");
 
-        printf("ax = %d  ay = %d  az = %d mg\n", (int)(1000*ax), (int)(1000*ay), (int)(1000*az));
-        printf("gx = %+2.2f  gy = %+2.2f  gz = %+2.2f deg/s\n", gx, gy, gz);
-        printf("mx = %d  my = %d  mz = %d mG\n", (int)mx, (int)my, (int)mz);
+        printf("ax = %d  ay = %d  az = %d mg\n", (int)(1000*sample.accel[0]), (int)(1000*sample.accel[1]), (int)(1000*sample.accel[2]));
+        printf("gx = %+2.2f  gy = %+2.2f  gz = %+2.2f deg/s\n", sample.gyro[0], sample.gyro[1], sample.gyro[2]);
+        printf("mx = %d  my = %d  mz = %d mG\n", (int)sample.mag[0], (int)sample.mag[1], (int)sample.mag[2]);
 
         // Print temperature in degrees Centigrade      
-        printf("Gyro temperature is %+1.1f degrees C\n", temperature);  
+        printf("Gyro temperature is %+1.1f degrees C\n", sample.temperature);  
     }
 }
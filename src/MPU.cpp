@@ -22,27 +22,99 @@
 
 #include "MPU.h"
 
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+// Microsecond clock for the read-latency counter
+#if defined(MPU_STATS)
+#if defined(__arm__) && (defined(STM32F303) || defined(STM32F405xx))
+extern "C" { uint32_t micros(void); }
+#elif defined(__linux__) && !defined(__arm__)
+#include <time.h>
+#endif
+#endif
+
 MPUIMU::MPUIMU(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor)
 {
     _aScale = ascale;
     _gScale = gscale;
     _sampleRateDivisor = sampleRateDivisor;
+    _sampleRate = 1000.f / (1 + sampleRateDivisor);
 
-    float avals[4] = {2, 4, 8, 16};
-    _aRes = getRes(ascale, avals);
+    _aRes = accelResolution(ascale);
+    _gRes = gyroResolution(gscale);
 
-    float gvals[4] = {250, 500, 1000, 2000};
-    _gRes = getRes(gscale, gvals);
+    for (uint8_t k=0; k<3; ++k) {
+        _accelBias[k] = 0;
+        _gyroBias[k] = 0;
+        _gyroTrim[k] = 0;
+        _gyroBiasSubtracted[k] = 0;
+        _accelBiasRaw[k] = 0;
+        _gyroBiasRaw[k] = 0;
+    }
 
-}
+    for (uint8_t k=0; k<6; ++k) {
+        _gyroOffsets[k] = 0;
+    }
 
-float MPUIMU::getRes(uint8_t scale, float vals[4])
-{
-    return vals[scale] / 32768.f;
+    _warmStart = false;
+
+    memset(&_selfTest, 0, sizeof(_selfTest));
+
+    _asyncState = ASYNC_IDLE;
+    _asyncFrames = NULL;
+    _asyncMaxFrames = 0;
+    _asyncFrameCount = 0;
+    _sampleHandler = NULL;
+    _sampleContext = NULL;
+    _fifoHandler = NULL;
+    _fifoContext = NULL;
+
+    _cacheEnabled = false;
+    invalidateRegisterCache();
+
+    _subtractGyroBias = false;
+
+    _tempSensitivity = 1;
+    _tempOffset = 0;
+
+    _maxBurst = 255;
+
+    _fifoSensors = 0;
+    _fifoFrameSize = 0;
+    _fifoSize = 512;
+    _fifoOverflowed = false;
+
+    _i2c = 0;
+    _i2cClock = 0;
+
+    _probedId = 0;
+
+    _calibrationEpoch = 0;
+
+    _intPinConfig = 0;
+
+    _dataReady = false;
+    _dataNotified = false;
+    _dataSynced = false;
+    _dataTime = 0;
+    _dataPeriod = 0;
+    _dataRate = 0;
+
+    _dmpOutputs = 0;
+    _dmpSavedRate = 0;
+    _dmpRate = DMP_SAMPLE_RATE;
+
+    resetStats();
 }
 
 uint8_t MPUIMU::getId()
 {
+    if (_probedId) {
+        return _probedId;
+    }
+
     return readMPURegister(WHO_AM_I);  // Read WHO_AM_I register for MPU-9250
 }
 
@@ -59,14 +131,7 @@ void MPUIMU::readAccelerometer(float & ax, float & ay, float & az)
 
     readMPURegisters(ACCEL_XOUT_H, 6, &rawData[0]);  // Read the six raw data registers into data array
 
-    int16_t x  = ((int16_t)rawData[0] << 8) | rawData[1] ;  // Turn the MSB and LSB into a signed 16-bit value
-    int16_t y  = ((int16_t)rawData[2] << 8) | rawData[3] ;  
-    int16_t z  = ((int16_t)rawData[4] << 8) | rawData[5] ; 
-
-    // Convert the accleration value into g's
-    ax = (float)x*_aRes - _accelBias[0];  
-    ay = (float)y*_aRes - _accelBias[1];   
-    az = (float)z*_aRes - _accelBias[2];  
+    decodeAccel(rawData, ax, ay, az);
 }
 
 void MPUIMU::readGyrometer(float & gx, float & gy, float & gz)
@@ -75,14 +140,127 @@ void MPUIMU::readGyrometer(float & gx, float & gy, float & gz)
 
     readMPURegisters(GYRO_XOUT_H, 6, &rawData[0]);  // Read the six raw data registers sequentially into data array
 
-    int16_t x = ((int16_t)rawData[0] << 8) | rawData[1] ;  // Turn the MSB and LSB into a signed 16-bit value
-    int16_t y = ((int16_t)rawData[2] << 8) | rawData[3] ;  
-    int16_t z = ((int16_t)rawData[4] << 8) | rawData[5] ; 
+    decodeGyro(rawData, gx, gy, gz);
+}
+
+bool MPUIMU::readAccelRaw(int16_t & x, int16_t & y, int16_t & z)
+{
+    uint8_t rawData[6];
+
+    readMPURegisters(ACCEL_XOUT_H, 6, &rawData[0]);
+
+    x = ((int16_t)rawData[0] << 8) | rawData[1];
+    y = ((int16_t)rawData[2] << 8) | rawData[3];
+    z = ((int16_t)rawData[4] << 8) | rawData[5];
+
+    return true;
+}
+
+bool MPUIMU::readGyroRaw(int16_t & x, int16_t & y, int16_t & z)
+{
+    uint8_t rawData[6];
+
+    readMPURegisters(GYRO_XOUT_H, 6, &rawData[0]);
+
+    x = ((int16_t)rawData[0] << 8) | rawData[1];
+    y = ((int16_t)rawData[2] << 8) | rawData[3];
+    z = ((int16_t)rawData[4] << 8) | rawData[5];
+
+    return true;
+}
+
+static int16_t subtractSaturated(int16_t raw, int16_t bias)
+{
+    int32_t d = (int32_t)raw - bias;
+    return d > 32767 ? 32767 : d < -32768 ? -32768 : (int16_t)d;
+}
+
+void MPUIMU::unbiasRawAccel(int16_t & x, int16_t & y, int16_t & z)
+{
+    x = subtractSaturated(x, _accelBiasRaw[0]);
+    y = subtractSaturated(y, _accelBiasRaw[1]);
+    z = subtractSaturated(z, _accelBiasRaw[2]);
+}
+
+void MPUIMU::unbiasRawGyro(int16_t & x, int16_t & y, int16_t & z)
+{
+    x = subtractSaturated(x, _gyroBiasRaw[0]);
+    y = subtractSaturated(y, _gyroBiasRaw[1]);
+    z = subtractSaturated(z, _gyroBiasRaw[2]);
+}
+
+void MPUIMU::scaleRawAccel(int16_t xraw, int16_t yraw, int16_t zraw, float & x, float & y, float & z)
+{
+    // Convert the accleration value into g's
+    x = (float)xraw*_aRes - _accelBias[0];  
+    y = (float)yraw*_aRes - _accelBias[1];   
+    z = (float)zraw*_aRes - _accelBias[2];  
+}
 
+void MPUIMU::scaleRawGyro(int16_t xraw, int16_t yraw, int16_t zraw, float & x, float & y, float & z)
+{
     // Convert the gyro value into degrees per second
-    gx = (float)x*_gRes;  
-    gy = (float)y*_gRes;  
-    gz = (float)z*_gRes; 
+    x = (float)xraw*_gRes;  
+    y = (float)yraw*_gRes;  
+    z = (float)zraw*_gRes; 
+
+    x -= _gyroBiasSubtracted[0];
+    y -= _gyroBiasSubtracted[1];
+    z -= _gyroBiasSubtracted[2];
+}
+
+// Raw counts in, Q16.16 g out, bias removed
+void MPUIMU::scaleRawAccelFixed(int16_t xraw, int16_t yraw, int16_t zraw, int32_t & x, int32_t & y, int32_t & z)
+{
+    unbiasRawAccel(xraw, yraw, zraw);
+
+    int32_t factor = accelFixedFactor(_aScale);
+    x = (int32_t)xraw * factor;
+    y = (int32_t)yraw * factor;
+    z = (int32_t)zraw * factor;
+}
+
+// Raw counts in, Q16.16 degrees/second out, bias removed
+void MPUIMU::scaleRawGyroFixed(int16_t xraw, int16_t yraw, int16_t zraw, int32_t & x, int32_t & y, int32_t & z)
+{
+    unbiasRawGyro(xraw, yraw, zraw);
+
+    int32_t factor = gyroFixedFactor(_gScale);
+    x = (int32_t)xraw * factor;
+    y = (int32_t)yraw * factor;
+    z = (int32_t)zraw * factor;
+}
+
+// Settles the gyro bias that the output subtracts, and mirrors the biases in counts; call whenever
+// the biases change
+void MPUIMU::updateRawBiases(void)
+{
+    for (uint8_t k=0; k<3; ++k) {
+        _gyroBiasSubtracted[k] = (_subtractGyroBias ? _gyroBias[k] : 0) + _gyroTrim[k];
+        _accelBiasRaw[k] = (int16_t)lroundf(_accelBias[k] / _aRes);
+        _gyroBiasRaw[k]  = (int16_t)lroundf(_gyroBiasSubtracted[k] / _gRes);
+    }
+
+    _calibrationEpoch++;
+}
+
+void MPUIMU::setBiases(const float accelBias[3], const float gyroBias[3])
+{
+    for (uint8_t k=0; k<3; ++k) {
+        _accelBias[k] = accelBias[k];
+        _gyroBias[k] = gyroBias[k];
+    }
+
+    updateRawBiases();
+}
+
+void MPUIMU::readAll(Sample_t & sample)
+{
+    uint8_t rawData[BURST_SIZE];  // accel, temperature, and gyro register data stored here
+
+    readMPURegisters(ACCEL_XOUT_H, prepareBurst(), &rawData[0]);  // ACCEL_XOUT_H through GYRO_ZOUT_L are contiguous
+
+    decodeBurst(rawData, sample);
 }
 
 int16_t MPUIMU::readRawTemperature(void)
@@ -92,12 +270,244 @@ int16_t MPUIMU::readRawTemperature(void)
     return ((int16_t)rawData[0] << 8) | rawData[1] ;  // Turn the MSB and LSB into a 16-bit value
 }
 
+void MPUIMU::enableFifo(uint8_t sensors)
+{
+    _fifoSensors = sensors & (FIFO_ACCEL | FIFO_GYRO | FIFO_TEMP);
+
+    _fifoFrameSize = getFrameSize(_fifoSensors);
+
+    writeConfigRegister(FIFO_EN, 0x00);              // Stop filling while we reset
+    uint8_t c = readConfigRegister(USER_CTRL) & ~0x44; // Preserve I2C master mode bit
+    writeConfigRegister(USER_CTRL, c | 0x04);        // Reset FIFO
+    writeConfigRegister(USER_CTRL, c | 0x40);        // Enable FIFO
+    writeConfigRegister(FIFO_EN, _fifoSensors);
+
+    _fifoOverflowed = false;
+}
+
+uint8_t MPUIMU::getFrameSize(uint8_t sensors)
+{
+    // Each enabled sensor contributes two bytes per axis
+    uint8_t size = 0;
+    if (sensors & FIFO_ACCEL) size += 6;
+    if (sensors & FIFO_TEMP)  size += 2;
+    for (uint8_t k=0; k<3; ++k) {
+        if (sensors & (0x40 >> k)) size += 2;
+    }
+    return size;
+}
+
+void MPUIMU::getScaling(Scaling_t & scaling)
+{
+    scaling.sensors = _fifoSensors ? _fifoSensors : (FIFO_ACCEL | FIFO_TEMP | FIFO_GYRO);
+    scaling.aRes = _aRes;
+    scaling.gRes = _gRes;
+    for (uint8_t k=0; k<3; ++k) {
+        scaling.accelBias[k] = _accelBias[k];
+        scaling.gyroBias[k] = _gyroBiasSubtracted[k];
+    }
+    scaling.tempSensitivity = _tempSensitivity;
+    scaling.tempOffset = _tempOffset;
+}
+
+void MPUIMU::disableFifo(void)
+{
+    writeConfigRegister(FIFO_EN, 0x00);
+    uint8_t c = readConfigRegister(USER_CTRL);
+    writeConfigRegister(USER_CTRL, c & ~0x40);
+
+    _fifoSensors = 0;
+    _fifoFrameSize = 0;
+}
+
+void MPUIMU::resetFifo(void)
+{
+    uint8_t c = readConfigRegister(USER_CTRL);
+    writeConfigRegister(USER_CTRL, c | 0x04); // FIFO_RST bit clears itself
+
+    _fifoOverflowed = false;
+}
+
+uint16_t MPUIMU::getFifoCount(void)
+{
+    uint8_t data[2];
+    readMPURegisters(FIFO_COUNTH, 2, &data[0]);
+    uint16_t count = (((uint16_t)data[0] << 8) | data[1]) & 0x1FFF;
+
+    // A FIFO without room for another frame drops its oldest bytes at the next sample (as countFifo()
+    // reckons it); with INT_ANYRD_2CLEAR, INT_STATUS may never show it
+    if (count + _fifoFrameSize > _fifoSize) {
+        _fifoOverflowed = true;
+    }
+
+    return count;
+}
+
+bool MPUIMU::checkFifoOverflow(void)
+{
+    noteIntStatus(readMPURegister(INT_STATUS));
+    return fifoOverflowed();
+}
+
+bool MPUIMU::fifoOverflowed(void)
+{
+    bool overflowed = _fifoOverflowed;
+    _fifoOverflowed = false;
+    return overflowed;
+}
+
+uint16_t MPUIMU::drainFifo(uint16_t maxFrames, uint8_t * frames, FifoBurst_t handler, void * context)
+{
+    // Nowhere to put the frames: readFifoRaw(NULL, n) reads nothing rather than calling a NULL handler
+    if (_fifoFrameSize == 0 || (frames == NULL && handler == NULL)) {
+        return 0;
+    }
+
+    uint16_t bytes = getFifoCount();
+    uint16_t available = bytes / _fifoFrameSize;
+    if (available > maxFrames) {
+        available = maxFrames;
+    }
+
+    countFifo(bytes, available);
+
+    uint8_t data[255];
+    uint8_t framesPerBurst = _maxBurst / _fifoFrameSize;
+
+    for (uint16_t done=0; done<available; ) {
+
+        uint16_t n = available - done;
+        if (n > framesPerBurst) n = framesPerBurst;
+
+        if (frames) {
+            readMPURegisters(FIFO_R_W, n*_fifoFrameSize, &frames[done*_fifoFrameSize]);
+        }
+        else {
+            readMPURegisters(FIFO_R_W, n*_fifoFrameSize, data);
+            handler(*this, data, done, n, context);
+        }
+
+        done += n;
+    }
+
+    countSamples(available);
+
+    return available;
+}
+
+// Frames are left in the device's big-endian layout
+uint16_t MPUIMU::readFifoRaw(uint8_t * frames, uint16_t maxFrames)
+{
+    return drainFifo(maxFrames, frames);
+}
+
+void MPUIMU::decodeFifoBurst(MPUIMU & imu, const uint8_t * frames, uint16_t first, uint16_t count, void * context)
+{
+    Sample_t * samples = (Sample_t *)context + first;
+
+    for (uint16_t k=0; k<count; ++k) {
+        imu.decodeFifoFrame(&frames[k*imu._fifoFrameSize], samples[k]);
+    }
+}
+
+uint16_t MPUIMU::readFifo(Sample_t * samples, uint16_t maxSamples)
+{
+    // DMP packets are not frames; readDMP() decodes them
+    if (_dmpOutputs || samples == NULL) {
+        return 0;
+    }
+
+    return drainFifo(maxSamples, NULL, decodeFifoBurst, samples);
+}
+
+uint16_t MPUIMU::readFifoRaw(MPUSpan<uint8_t> frames)
+{
+    if (_fifoFrameSize == 0) {
+        return 0;
+    }
+
+    uint32_t maxFrames = frames.size() / _fifoFrameSize;
+
+    return readFifoRaw(frames.data(), maxFrames > 0xFFFF ? 0xFFFF : (uint16_t)maxFrames);
+}
+
+// The destination, and the scaling taken once for all the bursts
+typedef struct {
+
+    const MPUIMU::SampleArrays_t * out;
+    MPUIMU::Scaling_t              scaling;
+
+} ArraysContext_t;
+
+void MPUIMU::convertFifoBurst(MPUIMU &, const uint8_t * frames, uint16_t first, uint16_t count, void * context)
+{
+    const ArraysContext_t * arrays = (const ArraysContext_t *)context;
+    const SampleArrays_t & out = *arrays->out;
+
+    SampleArrays_t part;
+    for (uint8_t k=0; k<3; ++k) {
+        part.accel[k] = out.accel[k] ? out.accel[k] + first : NULL;
+        part.gyro[k] = out.gyro[k] ? out.gyro[k] + first : NULL;
+    }
+    part.temperature = out.temperature ? out.temperature + first : NULL;
+
+    convertFrames(frames, count, arrays->scaling, part);
+}
+
+uint16_t MPUIMU::readFifo(const SampleArrays_t & out, uint16_t maxSamples)
+{
+    // DMP packets are not frames; readDMP() decodes them
+    if (_dmpOutputs) {
+        return 0;
+    }
+
+    ArraysContext_t arrays;
+    arrays.out = &out;
+    getScaling(arrays.scaling);
+
+    return drainFifo(maxSamples, NULL, convertFifoBurst, &arrays);
+}
+
+void MPUIMU::decodeFifoFrame(const uint8_t * frame, Sample_t & sample)
+{
+    const uint8_t * p = frame;
+
+    for (uint8_t k=0; k<3; ++k) {
+        sample.accel[k] = 0;
+        sample.gyro[k] = 0;
+        sample.mag[k] = 0;
+    }
+    sample.temperature = 0;
+    sample.magAge = MAG_AGE_NONE;
+    sample.timestamp = 0;
+
+    if (_fifoSensors & FIFO_ACCEL) {
+        for (uint8_t k=0; k<3; ++k, p+=2) {
+            int16_t raw = ((int16_t)p[0] << 8) | p[1];
+            sample.accel[k] = (float)raw*_aRes - _accelBias[k];
+        }
+    }
+
+    if (_fifoSensors & FIFO_TEMP) {
+        sample.temperature = scaleTemperature(((int16_t)p[0] << 8) | p[1]);
+        p += 2;
+    }
+
+    for (uint8_t k=0; k<3; ++k) {
+        if (_fifoSensors & (0x40 >> k)) {
+            int16_t raw = ((int16_t)p[0] << 8) | p[1];
+            sample.gyro[k] = (float)raw*_gRes - _gyroBiasSubtracted[k];
+            p += 2;
+        }
+    }
+}
+
 // Function which accumulates gyro and accelerometer data after device initialization. It calculates the average
 // of the at-rest readings and then loads the resulting offsets into accelerometer and gyro bias registers.
 void MPUIMU::calibrate(void)
 {  
     // reset device
-    writeMPURegister(PWR_MGMT_1, 0x80); // Write a one to bit 7 reset bit; toggle reset device
+    writeConfigRegister(PWR_MGMT_1, 0x80); // Write a one to bit 7 reset bit; toggle reset device
     delay(100);
 
     // get stable time source; Auto select clock source to be PLL gyroscope reference if ready 
@@ -174,12 +584,16 @@ void MPUIMU::calibrate(void)
     data[5] = (-gyro_bias[2]/4)       & 0xFF;
 
     // Push gyro biases to hardware registers
+    for (uint8_t k=0; k<6; ++k) {
+        _gyroOffsets[k] = data[k];
+    }
     pushGyroBiases(data);
 
     // Output scaled gyro biases for display in the main program
-    _gyroBias[0] = (float) gyro_bias[0]/(float) gyrosensitivity;  
-    _gyroBias[1] = (float) gyro_bias[1]/(float) gyrosensitivity;
-    _gyroBias[2] = (float) gyro_bias[2]/(float) gyrosensitivity;
+    float gyroBias[3];
+    gyroBias[0] = (float) gyro_bias[0]/(float) gyrosensitivity;  
+    gyroBias[1] = (float) gyro_bias[1]/(float) gyrosensitivity;
+    gyroBias[2] = (float) gyro_bias[2]/(float) gyrosensitivity;
 
     // Construct the accelerometer biases for push to the hardware accelerometer bias registers. These registers contain
     // factory trim values which must be added to the calculated accelerometer biases; on boot up these registers will hold
@@ -224,12 +638,596 @@ void MPUIMU::calibrate(void)
     //  writeMPURegister(ZA_OFFSET_L, data[5]);
 
     // Output scaled accelerometer biases for display in the main program
-    _accelBias[0] = (float)accel_bias[0]/(float)accelsensitivity; 
-    _accelBias[1] = (float)accel_bias[1]/(float)accelsensitivity;
-    _accelBias[2] = (float)accel_bias[2]/(float)accelsensitivity;
+    float accelBias[3];
+    accelBias[0] = (float)accel_bias[0]/(float)accelsensitivity; 
+    accelBias[1] = (float)accel_bias[1]/(float)accelsensitivity;
+    accelBias[2] = (float)accel_bias[2]/(float)accelsensitivity;
+
+    setBiases(accelBias, gyroBias);
+}
+
+// Accumulates FIFO frames until every axis mean is known to SELF_TEST_PRECISION of its factory trim,
+// rather than for a fixed count: on a quiet device that takes SELF_TEST_MIN_SAMPLES
+uint16_t MPUIMU::sampleSelfTest(const float factoryTrim[6], float mean[6])
+{
+    uint8_t frames[SELF_TEST_BATCH*12];
+    float ref[6], sum[6], squares[6];
+    uint16_t n = 0;
+
+    enableFifo(FIFO_ACCEL | FIFO_GYRO);
+
+    // A device that stops producing frames gets a few batches' grace
+    for (uint8_t idle=0; n<SELF_TEST_MAX_SAMPLES && idle<8; ) {
+
+        delay(SELF_TEST_BATCH); // milliseconds at 1 kHz
+
+        uint16_t count = readFifoRaw(frames, SELF_TEST_BATCH);
+        if (count == 0) {
+            idle++;
+            continue;
+        }
+        idle = 0;
+
+        for (uint16_t f=0; f<count && n<SELF_TEST_MAX_SAMPLES; ++f, ++n) {
+            for (uint8_t k=0; k<6; ++k) {
+                float v = (int16_t)(((int16_t)frames[12*f+2*k] << 8) | frames[12*f+2*k+1]);
+                if (n == 0) {
+                    ref[k] = v;
+                    sum[k] = 0;
+                    squares[k] = 0;
+                }
+                v -= ref[k];
+                sum[k] += v;
+                squares[k] += v*v;
+            }
+        }
+
+        if (n < SELF_TEST_MIN_SAMPLES) {
+            continue;
+        }
+
+        // Squared standard error of each mean against its allowance
+        bool settled = true;
+        for (uint8_t k=0; k<6; ++k) {
+            float m = sum[k] / n;
+            float allowed = SELF_TEST_PRECISION * factoryTrim[k];
+            if (allowed != 0 && (squares[k] / n - m*m) / n > allowed*allowed) {
+                settled = false;
+            }
+        }
+        if (settled) {
+            break;
+        }
+    }
+
+    disableFifo();
+
+    for (uint8_t k=0; k<6; ++k) {
+        mean[k] = n ? ref[k] + sum[k] / n : 0;
+    }
+
+    return n;
+}
+
+bool MPUIMU::evaluateSelfTest(const float normal[6], const float test[6], const float factoryTrim[6], uint16_t samples)
+{
+    _selfTest.samples = samples;
+    _selfTest.passed = samples > 0;
+
+    for (uint8_t k=0; k<6; ++k) {
+
+        _selfTest.response[k] = test[k] - normal[k];
+        _selfTest.factoryTrim[k] = factoryTrim[k];
+
+        // Axes without a factory code cannot be judged
+        _selfTest.change[k] = factoryTrim[k] != 0 ? 100.f * _selfTest.response[k] / factoryTrim[k] - 100.f : 0;
+
+        // As ever, only a response too far above the trim fails; change shows the other side
+        if (_selfTest.change[k] >= SELF_TEST_LIMIT) {
+            _selfTest.passed = false;
+        }
+    }
+
+    return _selfTest.passed;
 }
 
 bool MPUIMU::checkNewData(void)
 {
-    return (bool)(readMPURegister(INT_STATUS) & 0x01);
+    uint8_t status = readMPURegister(INT_STATUS);
+    noteIntStatus(status);
+    return (bool)(status & 0x01);
+}
+
+void MPUIMU::setInterruptPin(bool latched, bool clearOnAnyRead, bool activeLow, bool openDrain)
+{
+    uint8_t c = readConfigRegister(INT_PIN_CFG) & ~(INT_ACTL | INT_OPEN | INT_LATCH_EN | INT_ANYRD_2CLEAR);
+
+    if (activeLow)      c |= INT_ACTL;
+    if (openDrain)      c |= INT_OPEN;
+    if (latched)        c |= INT_LATCH_EN;
+    if (clearOnAnyRead) c |= INT_ANYRD_2CLEAR;
+
+    writeConfigRegister(INT_PIN_CFG, c);
+}
+
+bool MPUIMU::checkNewData(uint32_t usec)
+{
+    if (_dataNotified) {
+
+        if (!_dataReady) {
+            return false;
+        }
+
+        _dataReady = false;
+
+        // Any read would do with clear-on-any-read, and that is the caller's next
+        if ((_intPinConfig & (INT_LATCH_EN | INT_ANYRD_2CLEAR)) == INT_LATCH_EN) {
+            noteIntStatus(readMPURegister(INT_STATUS));
+        }
+    }
+
+    else if (getDataWait(usec) > 0 || !checkNewData()) {
+        return false;
+    }
+
+    _dataTime = usec;
+    _dataSynced = true;
+
+    return true;
+}
+
+uint32_t MPUIMU::getDataWait(uint32_t usec)
+{
+    if (!_dataSynced || _sampleRate <= 0) {
+        return 0;
+    }
+
+    if (_dataRate != _sampleRate) {
+        _dataRate = _sampleRate;
+        _dataPeriod = (uint32_t)(1e6f / _sampleRate);
+    }
+
+    // Early by an eighth of a period, for the difference between the two clocks and for finding the
+    // last sample late
+    uint32_t start = _dataPeriod - _dataPeriod / 8;
+    uint32_t elapsed = usec - _dataTime;
+
+    return elapsed < start ? start - elapsed : 0;
+}
+
+void MPUIMU::adjustGyroBias(const float residual[3], float applied[3])
+{
+    // A device that subtracts its calibration bias takes the residual into it; one that leaves that
+    // bias in the output (the MPU6x00) subtracts the residual alone
+    float gyroBias[3];
+
+    if (!hasGyroOffsets()) {
+        for (uint8_t k=0; k<3; ++k) {
+            gyroBias[k] = _gyroBias[k];
+            if (_subtractGyroBias) {
+                gyroBias[k] += residual[k];
+            }
+            else {
+                _gyroTrim[k] += residual[k];
+            }
+            applied[k] = residual[k];
+        }
+        setBiases(_accelBias, gyroBias);
+        return;
+    }
+
+    // Offsets are in counts at 1000 degrees/second full scale, and added to the output
+    static const float OFFSET_PER_DPS = 32768.f / 1000;
+
+    uint8_t data[12];
+
+    for (uint8_t k=0; k<3; ++k) {
+
+        int32_t offset = (int16_t)(((uint16_t)_gyroOffsets[2*k] << 8) | _gyroOffsets[2*k+1]);
+        int32_t updated = offset - lroundf(residual[k] * OFFSET_PER_DPS);
+        if (updated > 32767) updated = 32767;
+        if (updated < -32768) updated = -32768;
+
+        applied[k] = (offset - updated) / OFFSET_PER_DPS;
+        gyroBias[k] = _gyroBias[k] + applied[k];
+
+        _gyroOffsets[2*k]   = data[2*k]   = (updated >> 8) & 0xFF;
+        _gyroOffsets[2*k+1] = data[2*k+1] = updated & 0xFF;
+    }
+
+    pushGyroBiases(data);
+
+    // The offsets subtract the bias in hardware, so here it is only recorded
+    setBiases(_accelBias, gyroBias);
+}
+
+void MPUIMU::getStats(Stats_t & stats)
+{
+#if defined(MPU_STATS)
+    stats.transactions   = _stats.transactions;
+    stats.bytes          = _stats.bytes;
+    stats.failures       = _stats.failures;
+    stats.fifoOverflows  = _stats.fifoOverflows;
+    stats.framesLost     = _stats.framesLost;
+    stats.maxReadLatency = _stats.maxReadLatency;
+    stats.samples        = _stats.samples;
+#else
+    memset(&stats, 0, sizeof(stats));
+#endif
+}
+
+void MPUIMU::resetStats(void)
+{
+#if defined(MPU_STATS)
+    _stats.transactions   = 0;
+    _stats.bytes          = 0;
+    _stats.failures       = 0;
+    _stats.fifoOverflows  = 0;
+    _stats.framesLost     = 0;
+    _stats.maxReadLatency = 0;
+    _stats.samples        = 0;
+
+    _statsFifoTime = statsClock();
+    _statsFifoLeft = 0;
+#endif
+}
+
+#if defined(MPU_STATS)
+
+uint32_t MPUIMU::statsClock(void)
+{
+#if defined(ARDUINO) || defined(__arm__)
+    return micros();
+#elif defined(__linux__)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+    return 0; // no clock: latency is not tracked
+#endif
+}
+
+void MPUIMU::countRead(uint8_t count, bool ok, uint32_t start)
+{
+    uint32_t latency = statsClock() - start;
+
+    _stats.transactions++;
+    _stats.bytes += count;
+    if (!ok) _stats.failures++;
+    if (latency > _stats.maxReadLatency) _stats.maxReadLatency = latency;
+}
+
+// A full FIFO has been overwriting its oldest frames since it filled.  The frames lost are those
+// produced since the last look that are not there now, or at least one when there is no clock.
+void MPUIMU::countFifo(uint16_t bytes, uint16_t taken)
+{
+    uint32_t now = statsClock();
+    uint16_t held = bytes / _fifoFrameSize;
+
+    if (bytes + _fifoFrameSize > _fifoSize) {
+        uint32_t produced = (uint32_t)((now - _statsFifoTime) * 1e-6f * _sampleRate);
+        uint32_t arrived = held - (_statsFifoLeft < held ? _statsFifoLeft : held);
+        _stats.framesLost += produced > arrived ? produced - arrived : 1;
+    }
+
+    _statsFifoTime = now;
+    _statsFifoLeft = held - taken;
+}
+
+#endif // MPU_STATS
+
+// FNV-1a over everything preceding the checksum field
+static uint32_t calibrationChecksum(const MPUIMU::Calibration_t & calibration)
+{
+    const uint8_t * bytes = (const uint8_t *)&calibration;
+    uint32_t hash = 2166136261u;
+    for (uint16_t k=0; k<offsetof(MPUIMU::Calibration_t, checksum); ++k) {
+        hash = (hash ^ bytes[k]) * 16777619u;
+    }
+    return hash;
+}
+
+void MPUIMU::getCalibration(Calibration_t & calibration)
+{
+    memset(&calibration, 0, sizeof(calibration));
+
+    calibration.version = CALIBRATION_VERSION;
+    calibration.size = sizeof(calibration);
+    for (uint8_t k=0; k<3; ++k) {
+        calibration.magScale[k] = 1;
+        calibration.magAdjustment[k] = 128; // unity sensitivity adjustment
+    }
+
+    exportCalibration(calibration);
+
+    calibration.checksum = calibrationChecksum(calibration);
+}
+
+bool MPUIMU::setCalibration(const Calibration_t & calibration)
+{
+    if (calibration.version != CALIBRATION_VERSION || calibration.size != sizeof(calibration) ||
+            calibration.checksum != calibrationChecksum(calibration)) {
+        return false;
+    }
+
+    importCalibration(calibration);
+
+    _warmStart = true;
+
+    return true;
+}
+
+void MPUIMU::exportCalibration(Calibration_t & calibration)
+{
+    for (uint8_t k=0; k<3; ++k) {
+        calibration.accelBias[k] = _accelBias[k];
+        calibration.gyroBias[k] = _gyroBias[k];
+    }
+
+    for (uint8_t k=0; k<6; ++k) {
+        calibration.gyroOffsets[k] = _gyroOffsets[k];
+    }
+}
+
+void MPUIMU::importCalibration(const Calibration_t & calibration)
+{
+    for (uint8_t k=0; k<6; ++k) {
+        _gyroOffsets[k] = calibration.gyroOffsets[k];
+    }
+
+    setBiases(calibration.accelBias, calibration.gyroBias);
+}
+
+void MPUIMU::pushCalibration(void)
+{
+    uint8_t data[12] = {0};
+
+    for (uint8_t k=0; k<6; ++k) {
+        data[k] = _gyroOffsets[k];
+    }
+
+    pushGyroBiases(data);
+}
+
+void MPUIMU::enableRegisterCache(void)
+{
+    invalidateRegisterCache();
+    _cacheEnabled = true;
+}
+
+void MPUIMU::disableRegisterCache(void)
+{
+    _cacheEnabled = false;
+    invalidateRegisterCache();
+}
+
+void MPUIMU::invalidateRegisterCache(void)
+{
+    for (uint8_t k=0; k<sizeof(_cacheValid); ++k) {
+        _cacheValid[k] = 0;
+    }
+}
+
+bool MPUIMU::isCacheable(uint8_t subAddress)
+{
+    if (subAddress < CACHE_FIRST || subAddress >= CACHE_FIRST + CACHE_SIZE) {
+        return false;
+    }
+
+    // I2C_SLV4_CTRL clears its enable bit when the transfer is done; I2C_SLV4_DI and I2C_MST_STATUS are results
+    if (subAddress >= I2C_SLV4_CTRL && subAddress <= I2C_MST_STATUS) {
+        return false;
+    }
+
+    // Interrupt status, sensor data, and motion status
+    if (subAddress > INT_ENABLE && subAddress < I2C_SLV0_DO) {
+        return false;
+    }
+
+    // Self-clearing
+    return subAddress != SIGNAL_PATH_RESET;
+}
+
+void MPUIMU::writeConfigRegister(uint8_t subAddress, uint8_t data)
+{
+    // A device reset restores every register to its default
+    if (subAddress == PWR_MGMT_1 && (data & 0x80)) {
+        writeMPURegister(subAddress, data);
+        invalidateRegisterCache();
+        _intPinConfig = 0;
+        return;
+    }
+
+    if (subAddress == INT_PIN_CFG) {
+        _intPinConfig = data;
+    }
+
+    if (!_cacheEnabled || !isCacheable(subAddress)) {
+        writeMPURegister(subAddress, data);
+        return;
+    }
+
+    // The USER_CTRL reset bits clear themselves, so they are always written but never remembered
+    uint8_t strobes = (subAddress == USER_CTRL) ? (data & 0x0F) : 0;
+    uint8_t value = data & ~strobes;
+
+    uint8_t k = subAddress - CACHE_FIRST;
+    uint8_t bit = 1 << (k & 7);
+
+    if (!strobes && (_cacheValid[k>>3] & bit) && _cache[k] == value) {
+        return;
+    }
+
+    writeMPURegister(subAddress, data);
+
+    _cache[k] = value;
+    _cacheValid[k>>3] |= bit;
+}
+
+uint8_t MPUIMU::readConfigRegister(uint8_t subAddress)
+{
+    if (!_cacheEnabled || !isCacheable(subAddress)) {
+        return readMPURegister(subAddress);
+    }
+
+    uint8_t k = subAddress - CACHE_FIRST;
+    uint8_t bit = 1 << (k & 7);
+
+    if (!(_cacheValid[k>>3] & bit)) {
+        _cache[k] = readMPURegister(subAddress);
+        if (subAddress == USER_CTRL) {
+            _cache[k] &= ~0x0F;
+        }
+        _cacheValid[k>>3] |= bit;
+    }
+
+    return _cache[k];
+}
+
+void MPUIMU::writeConfigRegisters(uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    if (subAddress <= INT_PIN_CFG && subAddress + count > INT_PIN_CFG) {
+        _intPinConfig = data[INT_PIN_CFG - subAddress];
+    }
+
+    // Skipped only when the cache knows every register already holds its value
+    bool unchanged = _cacheEnabled;
+
+    for (uint8_t j=0; j<count && unchanged; ++j) {
+        uint8_t k = subAddress + j - CACHE_FIRST;
+        unchanged = isCacheable(subAddress+j) && (_cacheValid[k>>3] & (1 << (k & 7))) && _cache[k] == data[j];
+    }
+
+    if (unchanged) {
+        return;
+    }
+
+    writeMPURegisters(subAddress, count, data);
+
+    if (!_cacheEnabled) {
+        return;
+    }
+
+    for (uint8_t j=0; j<count; ++j) {
+        if (isCacheable(subAddress+j)) {
+            uint8_t k = subAddress + j - CACHE_FIRST;
+            _cache[k] = data[j];
+            _cacheValid[k>>3] |= 1 << (k & 7);
+        }
+    }
+}
+
+void MPUIMU::writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    // As in a burst, DMP memory and the FIFO take every byte through their one register
+    bool step = subAddress != DMP_REG && subAddress != FIFO_R_W;
+
+    for (uint8_t k=0; k<count; ++k) {
+        writeMPURegister(step ? subAddress+k : subAddress, data[k]);
+    }
+}
+
+void MPUIMU::onSampleReady(SampleHandler_t handler, void * context)
+{
+    _sampleHandler = handler;
+    _sampleContext = context;
+}
+
+void MPUIMU::onFifoReady(FifoHandler_t handler, void * context)
+{
+    _fifoHandler = handler;
+    _fifoContext = context;
+}
+
+bool MPUIMU::startRead(void)
+{
+    if (_asyncState != ASYNC_IDLE) {
+        return false;
+    }
+
+    _asyncState = ASYNC_SAMPLE;
+
+    startSampleRead();
+
+    return true;
+}
+
+bool MPUIMU::startFifoRead(uint8_t * frames, uint16_t maxFrames)
+{
+    if (_asyncState != ASYNC_IDLE || _fifoFrameSize == 0) {
+        return false;
+    }
+
+    _asyncFrames = frames;
+    _asyncMaxFrames = maxFrames;
+    _asyncState = ASYNC_FIFO_COUNT;
+
+    startMPURead(FIFO_COUNTH, 2, _asyncBuffer);
+
+    return true;
+}
+
+void MPUIMU::startMPURead(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    readMPURegisters(subAddress, count, dest);
+
+    completeMPURead();
+}
+
+void MPUIMU::startSampleRead(void)
+{
+    startMPURead(ACCEL_XOUT_H, prepareBurst(), _asyncBuffer);
+}
+
+void MPUIMU::decodeSampleRead(Sample_t & sample)
+{
+    decodeBurst(_asyncBuffer, sample);
+}
+
+void MPUIMU::completeMPURead(void)
+{
+    switch (_asyncState) {
+
+        case ASYNC_SAMPLE: {
+            Sample_t sample;
+            decodeSampleRead(sample);
+            _asyncState = ASYNC_IDLE; // so the handler may start the next read
+            if (_sampleHandler) {
+                _sampleHandler(sample, _sampleContext);
+            }
+            break;
+        }
+
+        case ASYNC_FIFO_COUNT: {
+            uint16_t bytes = (((uint16_t)_asyncBuffer[0] << 8) | _asyncBuffer[1]) & 0x1FFF;
+            uint16_t frames = bytes / _fifoFrameSize;
+            uint16_t perBurst = _maxBurst / _fifoFrameSize;
+            if (frames > _asyncMaxFrames) frames = _asyncMaxFrames;
+            if (frames > perBurst) frames = perBurst;
+            _asyncFrameCount = frames;
+            countFifo(bytes, frames);
+            if (frames == 0) {
+                _asyncState = ASYNC_IDLE;
+                if (_fifoHandler) {
+                    _fifoHandler(_asyncFrames, 0, _fifoContext);
+                }
+            }
+            else {
+                _asyncState = ASYNC_FIFO_DATA;
+                startMPURead(FIFO_R_W, frames * _fifoFrameSize, _asyncFrames);
+            }
+            break;
+        }
+
+        case ASYNC_FIFO_DATA:
+            countSamples(_asyncFrameCount);
+            _asyncState = ASYNC_IDLE;
+            if (_fifoHandler) {
+                _fifoHandler(_asyncFrames, _asyncFrameCount, _fifoContext);
+            }
+            break;
+
+        default:
+            break;
+    }
 }
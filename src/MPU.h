@@ -23,6 +23,9 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "MPUSpan.h"
 
 // One ifdef needed to support delay() cross-platform
 #if defined(ARDUINO)
@@ -42,6 +45,8 @@ void delay(uint32_t msec);
 
 class MPUIMU {
 
+    friend class MPUFactory; // hands its probe to the device it constructs
+
     public:
 
         typedef enum {
@@ -79,8 +84,316 @@ class MPUIMU {
 
         } Error_t;
 
+        // Bits of the FIFO_EN register; frames appear in the FIFO in this (register) order
+        typedef enum {
+
+            FIFO_ACCEL = 0x08,
+            FIFO_GYRO  = 0x70,
+            FIFO_TEMP  = 0x80
+
+        } FifoSensor_t;
+
+        typedef struct {
+
+            float accel[3];     // g
+            float gyro[3];      // degrees per second
+            float temperature;  // degrees Centigrade
+            float mag[3];       // milliGauss; zero on devices without a magnetometer
+            uint16_t magAge;    // samples since mag last changed, zero when new; else MAG_AGE_NONE
+            uint64_t timestamp; // microseconds; zero unless set by the acquisition layer
+
+        } Sample_t;
+
+        // magAge without a magnetometer reading: none yet, or no magnetometer
+        static const uint16_t MAG_AGE_NONE = 0xFFFF;
+
+        // What convertFrames() needs to know about the device, so frames can be converted
+        // away from it (e.g. when reading back a log)
+        typedef struct {
+
+            uint8_t sensors;        // FifoSensor_t mask describing the frame layout
+            float   aRes;
+            float   gRes;
+            float   accelBias[3];
+            float   gyroBias[3];    // zero when the device removes gyro bias in hardware
+            float   tempSensitivity;
+            float   tempOffset;
+
+        } Scaling_t;
+
+        // Structure-of-arrays destination: accel[axis][frame] etc.; NULL pointers are skipped
+        typedef struct {
+
+            float * accel[3];
+            float * gyro[3];
+            float * temperature;
+
+        } SampleArrays_t;
+
+        // Calibration that can be stored (EEPROM, flash, a file) and restored with setCalibration()
+        // before begin(), which then skips self-test and calibration
+        typedef struct {
+
+            uint16_t version;
+            uint16_t size;
+            float    accelBias[3];
+            float    gyroBias[3];
+            float    magBias[3];        // magnetometer fields are used by the MPU9250 only
+            float    magScale[3];
+            uint8_t  gyroOffsets[6];    // hardware gyro offset registers, XG_OFFSET_H first
+            uint8_t  magAdjustment[3];  // AK8963 ASAX, ASAY, ASAZ fuse ROM values
+            uint8_t  reserved[3];
+            uint32_t checksum;
+
+        } Calibration_t;
+
+        static const uint16_t CALIBRATION_VERSION = 1;
+
+        void getCalibration(Calibration_t & calibration);
+
+        // Returns false, changing nothing, if the version, size, or checksum does not match
+        bool setCalibration(const Calibration_t & calibration);
+
+        // Outcome of the self-test begin() runs, per axis: accelerometer x, y, z, then gyrometer x, y, z
+        typedef struct {
+
+            float    response[6];       // self-test response, counts at the test's full scale
+            float    factoryTrim[6];    // expected response from the factory self-test codes
+            float    change[6];         // response relative to factory trim, percent; zero without a code
+            uint16_t samples;           // per phase; zero when begin() skipped the test
+            bool     passed;
+
+        } SelfTestResult_t;
+
+        void getSelfTestResult(SelfTestResult_t & result) { result = _selfTest; }
+
+        // Counts changes to the corrections applied to samples (calibration, setCalibration(), bias
+        // tracking, magnetometer calibration), so that a sample can be tagged with the ones it got
+        uint32_t getCalibrationEpoch(void) { return _calibrationEpoch; }
+
+        // Full-scale resolutions in g and degrees/second per LSB, usable at compile time
+        static constexpr float accelResolution(Ascale_t ascale) { return (float)(2 << ascale) / 32768.f; }
+        static constexpr float gyroResolution(Gscale_t gscale)  { return (float)(250 << gscale) / 32768.f; }
+
+        // Q16.16 fixed-point conversion of bias-corrected counts; integer multiplies only
+        static const uint8_t FIXED_POINT_BITS = 16;
+        static constexpr int32_t accelFixedFactor(Ascale_t ascale) { return 4 << ascale; }
+        static constexpr int32_t gyroFixedFactor(Gscale_t gscale)  { return 500 << gscale; }
+        template <Ascale_t ASCALE> static int32_t accelToFixed(int16_t raw) { return (int32_t)raw * accelFixedFactor(ASCALE); }
+        template <Gscale_t GSCALE> static int32_t gyroToFixed(int16_t raw)  { return (int32_t)raw * gyroFixedFactor(GSCALE); }
+
         void readAccelerometer(float & ax, float & ay, float & az);
 
+        // Raw counts as read from the sensor, and conversions that work on them
+        bool readAccelRaw(int16_t & x, int16_t & y, int16_t & z);
+        bool readGyroRaw(int16_t & x, int16_t & y, int16_t & z);
+        void unbiasRawAccel(int16_t & x, int16_t & y, int16_t & z);
+        void unbiasRawGyro(int16_t & x, int16_t & y, int16_t & z);
+        void scaleRawAccel(int16_t xraw, int16_t yraw, int16_t zraw, float & x, float & y, float & z);
+        void scaleRawGyro(int16_t xraw, int16_t yraw, int16_t zraw, float & x, float & y, float & z);
+        void scaleRawAccelFixed(int16_t xraw, int16_t yraw, int16_t zraw, int32_t & x, int32_t & y, int32_t & z);
+        void scaleRawGyroFixed(int16_t xraw, int16_t yraw, int16_t zraw, int32_t & x, int32_t & y, int32_t & z);
+
+        bool checkNewData(void);
+
+        // INT pin behaviour (INT_PIN_CFG), for use after begin(), which sets each device's default; the
+        // bypass bits are left alone.  A latched pin stays asserted until INT_STATUS is read, or with
+        // clearOnAnyRead until any register is; otherwise it pulses for 50 microseconds.
+        void setInterruptPin(bool latched, bool clearOnAnyRead=true, bool activeLow=false, bool openDrain=false);
+
+        bool isInterruptLatched(void) { return _intPinConfig & INT_LATCH_EN; }
+
+        // Data-ready waiting without spinning on INT_STATUS.  usec is any free-running microsecond clock,
+        // e.g. micros().  Once notifyDataReady() has been called from the INT pin's interrupt handler (or
+        // by a thread that sleeps on the pin), checkNewData(usec) answers from that, reading INT_STATUS
+        // only to release a latched pin.  Without a pin it predicts the next sample from the sample rate
+        // and when data was last found ready, and reads INT_STATUS only from an eighth of a period before
+        // the prediction until the sample turns up.
+        void notifyDataReady(void) { _dataReady = true; _dataNotified = true; }
+
+        bool checkNewData(uint32_t usec);
+
+        // Microseconds before checkNewData(usec) will next read the device, zero if it would now: how
+        // long a caller that can sleep may sleep
+        uint32_t getDataWait(uint32_t usec);
+
+        // Removes a further gyro bias, in degrees/second still present in the output: through the hardware
+        // offset registers on devices that have them, else in the software scaling, which on devices that
+        // leave the calibration bias in the output (the MPU6x00) subtracts only the residuals given here.
+        // applied gets what was actually removed, which the offset registers quantize to 1/32.8
+        // degrees/second.
+        void adjustGyroBias(const float residual[3], float applied[3]);
+
+        // Hot-path counters, kept only when the library is built with MPU_STATS defined (for every
+        // translation unit alike, since it changes the class layout); otherwise getStats() reports
+        // zeros and the bookkeeping compiles away.  Each counter is a word written only by the
+        // thread doing the reads, so another thread can poll getStats() without locking.
+        typedef struct {
+
+            uint32_t transactions;   // bus transfers, register writes included
+            uint32_t bytes;          // data bytes moved, register addresses not included
+            uint32_t failures;       // transfers the bus reported as failed
+            uint32_t fifoOverflows;  // INT_STATUS reads with FIFO_OFLOW_INT set
+            uint32_t framesLost;     // FIFO frames overwritten before they were read, estimated
+            uint32_t maxReadLatency; // microseconds, worst single read transfer
+            uint32_t samples;        // samples delivered by readAll(), the FIFO reads, and the async reads
+
+        } Stats_t;
+
+#if defined(MPU_STATS)
+        static const bool STATS_ENABLED = true;
+#else
+        static const bool STATS_ENABLED = false;
+#endif
+
+        void getStats(Stats_t & stats);
+
+        // From the reading thread only
+        void resetStats(void);
+
+        // Optional write-through shadow of the configuration registers: unchanged writes are skipped
+        // and reads are answered from memory.  Off by default.
+        void enableRegisterCache(void);
+        void disableRegisterCache(void);
+        void invalidateRegisterCache(void);
+
+        // Rate in Hz at which new data (and FIFO frames) are produced with the current configuration
+        float getSampleRate(void) { return _sampleRate; }
+
+        // Reads accelerometer, thermometer, and gyrometer in a single BURST_SIZE-byte burst
+        virtual void readAll(Sample_t & sample);
+
+        // Non-blocking reads, e.g. started from the data-ready ISR: the handler gets the result
+        // when the transfer completes, which is before startRead() returns unless the transport
+        // overrides startMPURead() with a DMA or interrupt-driven one.  Both return false while
+        // an earlier read is still in flight.
+        typedef void (*SampleHandler_t)(const Sample_t & sample, void * context);
+        typedef void (*FifoHandler_t)(const uint8_t * frames, uint16_t count, void * context);
+
+        void onSampleReady(SampleHandler_t handler, void * context=NULL);
+        void onFifoReady(FifoHandler_t handler, void * context=NULL);
+
+        bool startRead(void);
+
+        // Reads at most one bus transfer's worth of frames into the caller's buffer, which must
+        // stay valid until the handler runs
+        bool startFifoRead(uint8_t * frames, uint16_t maxFrames);
+
+        bool readBusy(void) { return _asyncState != ASYNC_IDLE; }
+
+        // FIFO streaming: enable with a mask of FifoSensor_t values, then drain periodically
+        void     enableFifo(uint8_t sensors);
+        void     disableFifo(void);
+        void     resetFifo(void);
+        uint16_t getFifoCount(void);
+        bool     checkFifoOverflow(void);
+
+        // Whether the FIFO has overflowed since the last call or resetFifo(), as INT_STATUS reads made
+        // anyway and FIFO counts that reached the FIFO size showed it; no bus access.  checkFifoOverflow()
+        // is the same after a read of INT_STATUS.
+        bool     fifoOverflowed(void);
+
+        // Zero while the DMP has the FIFO (isDMPEnabled()): read its packets with readDMP().  Zero, too,
+        // for a NULL buffer, with the FIFO left as it was.
+        uint16_t readFifo(Sample_t * samples, uint16_t maxSamples);
+        uint16_t readFifoRaw(uint8_t * frames, uint16_t maxFrames);
+        uint8_t  getFifoFrameSize(void) { return _fifoFrameSize; }
+
+        // The FIFO reads into a caller's buffer, returning how many samples (or whole frames) they
+        // wrote; nothing is allocated.  The SampleArrays_t one converts each burst with convertFrames().
+        uint16_t readFifo(MPUSpan<Sample_t> samples) { return readFifo(samples.data(), samples.size16()); }
+        uint16_t readFifoRaw(MPUSpan<uint8_t> frames);
+        uint16_t readFifo(const SampleArrays_t & out, uint16_t maxSamples);
+
+        static uint8_t getFrameSize(uint8_t sensors);
+
+        // Scaling for the current FIFO layout, or for readAll() bursts when the FIFO is off
+        void getScaling(Scaling_t & scaling);
+
+        // Batch conversion of big-endian frames, vectorized with NEON, AVX2, or SSE2 where available
+        static void convertFrames(const uint8_t * frames, uint16_t count, const Scaling_t & scaling, SampleArrays_t & out);
+
+        // Digital Motion Processor.  The firmware is the caller's (e.g. InvenSense's MotionDriver image for
+        // the part), and so are its feature settings, which it keeps at addresses of its own in DMP memory.
+        // Load it after begin(), write any settings with setupDMPFeatures() or writeDMPMemory(), then
+        // enableDMP() with the outputs that the settings select; the DMP then writes one packet to the FIFO per output period,
+        // in DmpOutput_t order, and readDMP() drains and decodes them.
+        typedef enum {
+
+            DMP_QUAT    = 0x01, // 3- or 6-axis quaternion, four big-endian Q30 values, w first
+            DMP_ACCEL   = 0x02, // raw accelerometer counts
+            DMP_GYRO    = 0x04, // raw gyrometer counts
+            DMP_GESTURE = 0x08  // tap and orientation events
+
+        } DmpOutput_t;
+
+        typedef enum {
+
+            DMP_EVENT_TAP         = 0x01,
+            DMP_EVENT_ORIENTATION = 0x02
+
+        } DmpEvent_t;
+
+        typedef struct {
+
+            float   quat[4];      // w, x, y, z
+            int16_t accel[3];
+            int16_t gyro[3];
+            uint8_t events;       // DmpEvent_t mask
+            uint8_t tapDirection; // 1..6 for +X, -X, +Y, -Y, +Z, -Z
+            uint8_t tapCount;
+            uint8_t orientation;  // 0..3, as the firmware's orientation feature reports it
+
+        } DmpPacket_t;
+
+        // Writes the image from address zero, checking each chunk, and sets where the DMP starts
+        bool loadDMPFirmware(const uint8_t * image, uint16_t size, uint16_t startAddress);
+
+        // Features of InvenSense's MotionDriver 6.12 image (dmp_memory[], 3062 bytes, started at 0x0400),
+        // which setupDMPFeatures() writes at the addresses that image keeps them at, as the driver's
+        // dmp_enable_feature() and dmp_set_fifo_rate() do.  Other images keep their settings elsewhere.
+        typedef enum {
+
+            DMP_FEATURE_LP_QUAT        = 0x01, // 3-axis (gyrometer only) quaternion
+            DMP_FEATURE_6X_LP_QUAT     = 0x02, // 6-axis quaternion; takes precedence over the 3-axis one
+            DMP_FEATURE_TAP            = 0x04,
+            DMP_FEATURE_ANDROID_ORIENT = 0x08,
+            DMP_FEATURE_SEND_ACCEL     = 0x10,
+            DMP_FEATURE_SEND_GYRO      = 0x20, // raw, not the calibrated counts
+            DMP_FEATURE_GYRO_CAL       = 0x40  // the firmware's own bias tracking while still
+
+        } DmpFeature_t;
+
+        static const uint16_t DMP_MOTIONDRIVER_SIZE  = 3062;
+        static const uint16_t DMP_MOTIONDRIVER_START = 0x0400;
+
+        // Call after loadDMPFirmware() and before enableDMP(), with a DmpFeature_t mask and a packet rate
+        // that divides DMP_SAMPLE_RATE (others round up).  Taps are taken along all axes, singly, at the
+        // driver's default thresholds for the current accelerometer scale.  Returns the DmpOutput_t mask
+        // to pass to enableDMP(), or zero for an empty mask or a rate above DMP_SAMPLE_RATE.
+        uint8_t setupDMPFeatures(uint8_t features, uint16_t rate=DMP_SAMPLE_RATE);
+
+        // DMP memory is banked 256 bytes at a time; transfers are split at bank boundaries
+        void writeDMPMemory(uint16_t address, uint16_t count, const uint8_t * data);
+        void readDMPMemory(uint16_t address, uint16_t count, uint8_t * data);
+
+        // Runs the DMP at its 200 Hz input rate (the sample rate and filter are set for it, and put back by
+        // disableDMP()), with the FIFO given to it and its interrupt enabled.  readFifoRaw() and the
+        // asynchronous FIFO reads then hand out whole packets of getFifoFrameSize() bytes, and
+        // getSampleRate() is the packet rate; readFifo() returns zero, since the packets are not frames.
+        static const uint16_t DMP_SAMPLE_RATE = 200;
+
+        void     enableDMP(uint8_t outputs);
+        void     disableDMP(void);
+        bool     isDMPEnabled(void) { return _dmpOutputs != 0; }
+
+        // Packets that fail the quaternion check, or an overflowed FIFO, reset the FIFO
+        uint16_t readDMP(DmpPacket_t * packets, uint16_t maxPackets);
+        uint16_t readDMP(MPUSpan<DmpPacket_t> packets) { return readDMP(packets.data(), packets.size16()); }
+
+        static uint8_t getDMPPacketSize(uint8_t outputs);
+        static bool    parseDMPPacket(const uint8_t * data, uint8_t outputs, DmpPacket_t & packet);
+
     protected:
 
         const uint8_t MPU_ADDRESS               = 0x68;
@@ -197,16 +510,173 @@ class MPUIMU {
         static const uint8_t ZA_OFFSET_L        = 0x7E;
         static const uint8_t I2C_SLV0_EN        = 0x80;
         static const uint8_t I2C_READ_FLAG      = 0x80;
+        static const uint8_t I2C_SLV0_NACK      = 0x01;  // in I2C_MST_STATUS, cleared by reading it
+
+        // INT_PIN_CFG bits
+        static const uint8_t INT_ACTL           = 0x80;
+        static const uint8_t INT_OPEN           = 0x40;
+        static const uint8_t INT_LATCH_EN       = 0x20;
+        static const uint8_t INT_ANYRD_2CLEAR   = 0x10;
 
         Ascale_t _aScale;
         Gscale_t _gScale;
         uint8_t  _sampleRateDivisor;
+        float    _sampleRate;
 
         float   _aRes;
         float   _gRes;
         float _accelBias[3];
         float _gyroBias[3];
 
+        // Devices that cannot hold gyro biases in hardware subtract them in software
+        bool _subtractGyroBias;
+
+        // What adjustGyroBias() removes in software from a device that does not subtract _gyroBias;
+        // it outlasts calibrate() and setCalibration(), which leave that bias in the output anyway
+        float _gyroTrim[3];
+
+        // The gyro bias that the output paths subtract: _gyroBias where it is subtracted, plus
+        // _gyroTrim, as updateRawBiases() settles it
+        float _gyroBiasSubtracted[3];
+
+        // Biases in counts at the configured scale, for the integer output path
+        int16_t _accelBiasRaw[3];
+        int16_t _gyroBiasRaw[3];
+
+        void updateRawBiases(void);
+
+        // Every change to _accelBias and _gyroBias goes through here, so that the output paths follow
+        void setBiases(const float accelBias[3], const float gyroBias[3]);
+
+        // Temperature conversion: degrees = raw / _tempSensitivity + _tempOffset
+        float _tempSensitivity;
+        float _tempOffset;
+
+        // Largest transfer readMPURegisters() will be asked for in one call;
+        // I^2C subclasses lower this where the platform's Wire buffer is small
+        uint8_t _maxBurst;
+
+        uint8_t  _fifoSensors;
+        uint8_t  _fifoFrameSize;
+        uint16_t _fifoSize;      // bytes
+        bool     _fifoOverflowed;
+
+        // Cross-platform support: handle from cpi2c_open(); unused by SPI devices
+        uint8_t _i2c;
+
+        // I^2C clock in Hz as reported by mpui2c_open(), zero when unknown
+        uint32_t _i2cClock;
+
+        // DmpOutput_t mask while the DMP feeds the FIFO, else zero; and SMPLRT_DIV, CONFIG, GYRO_CONFIG
+        // and the sample rate from before enableDMP()
+        uint8_t _dmpOutputs;
+        uint8_t _dmpSavedConfig[3];
+        float   _dmpSavedRate;
+
+        // Packet rate that setupDMPFeatures() set the firmware's divider for
+        float   _dmpRate;
+
+        // WHO_AM_I as MPUFactory read it, else zero.  When set, getId() returns it, and the I^2C
+        // devices' begin() keeps the _i2c and _i2cClock that the factory opened instead of reopening.
+        uint8_t _probedId;
+
+        volatile uint32_t _calibrationEpoch;
+
+        // INT_PIN_CFG as last written through writeConfigRegister() or writeConfigRegisters()
+        uint8_t _intPinConfig;
+
+        // For checkNewData(usec): a pending notifyDataReady(), whether one ever came, and when data was
+        // last found ready (valid once _dataSynced), with the sample period for the rate in _dataRate
+        volatile bool _dataReady;
+        bool     _dataNotified;
+        bool     _dataSynced;
+        uint32_t _dataTime;
+        uint32_t _dataPeriod;
+        float    _dataRate;
+
+        // Gyro offsets last pushed to hardware, and whether begin() should restore them instead of calibrating
+        uint8_t _gyroOffsets[6];
+        bool    _warmStart;
+
+        // Self-test sampling: FIFO bursts of SELF_TEST_BATCH frames at 1 kHz, each phase ending once
+        // the standard error of every axis mean is within SELF_TEST_PRECISION of its factory trim
+        static const uint8_t  SELF_TEST_BATCH       = 8;
+        static const uint16_t SELF_TEST_MIN_SAMPLES = 32;
+        static const uint16_t SELF_TEST_MAX_SAMPLES = 200;
+        static constexpr float SELF_TEST_PRECISION  = 0.01f;
+        static constexpr float SELF_TEST_LIMIT      = 14.f; // percent
+
+        SelfTestResult_t _selfTest;
+
+        // Means of accelerometer and gyrometer counts at the current configuration
+        uint16_t sampleSelfTest(const float factoryTrim[6], float mean[6]);
+
+        // Fills _selfTest from the two phases and returns whether it passed
+        bool    evaluateSelfTest(const float normal[6], const float test[6], const float factoryTrim[6], uint16_t samples);
+
+        // Configuration access through the register cache; registers written with writeMPURegister()
+        // directly are not tracked, so code doing that must not rely on the cache afterward
+        void    writeConfigRegister(uint8_t subAddress, uint8_t data);
+        uint8_t readConfigRegister(uint8_t subAddress);
+
+        // Consecutive configuration registers in one transfer where the transport allows; not for
+        // PWR_MGMT_1 resets or the USER_CTRL reset bits, which writeConfigRegister() handles
+        void    writeConfigRegisters(uint8_t subAddress, uint8_t count, const uint8_t * data);
+
+        // XG_OFFSET_H through PWR_MGMT_2
+        static const uint8_t CACHE_FIRST = 0x13;
+        static const uint8_t CACHE_SIZE  = 0x6D - CACHE_FIRST;
+
+        bool    _cacheEnabled;
+        uint8_t _cache[CACHE_SIZE];
+        uint8_t _cacheValid[(CACHE_SIZE+7)/8];
+
+        static bool isCacheable(uint8_t subAddress);
+
+        typedef enum {
+
+            ASYNC_IDLE,
+            ASYNC_SAMPLE,
+            ASYNC_FIFO_COUNT,
+            ASYNC_FIFO_DATA
+
+        } AsyncState_t;
+
+        // Large enough for the longest BURST_SIZE
+        static const uint8_t ASYNC_BUFFER_SIZE = 24;
+
+        volatile AsyncState_t _asyncState;
+        uint8_t               _asyncBuffer[ASYNC_BUFFER_SIZE];
+        uint8_t             * _asyncFrames;
+        uint16_t              _asyncMaxFrames;
+        uint16_t              _asyncFrameCount;
+
+        SampleHandler_t _sampleHandler;
+        void          * _sampleContext;
+        FifoHandler_t   _fifoHandler;
+        void          * _fifoContext;
+
+        // Asynchronous transport: begin reading count bytes into dest and call completeMPURead()
+        // once they are there (e.g. from the DMA-complete interrupt).  The default just reads.
+        virtual void startMPURead(uint8_t subAddress, uint8_t count, uint8_t * dest);
+
+        void completeMPURead(void);
+
+        // The asynchronous counterparts of prepareBurst()/readMPURegisters()/decodeBurst()
+        virtual void startSampleRead(void);
+        virtual void decodeSampleRead(Sample_t & sample);
+
+        virtual void exportCalibration(Calibration_t & calibration);
+        virtual void importCalibration(const Calibration_t & calibration);
+        void pushCalibration(void);
+
+        // readAll() reads from ACCEL_XOUT_H as many bytes as prepareBurst() returns, at most BURST_SIZE,
+        // and passes them to decodeBurst().  Subclasses that extend the burst hide all three, so that
+        // MPUBusDevice can dispatch statically.
+        static const uint8_t BURST_SIZE = 14;
+        uint8_t prepareBurst(void) { return BURST_SIZE; }
+        void decodeBurst(const uint8_t * rawData, Sample_t & sample);
+
         MPUIMU(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor);
 
         static float getAres(Ascale_t ascale);
@@ -216,22 +686,139 @@ class MPUIMU {
 
         void calibrate(void);
 
-        bool checkNewData(void);
-
         uint8_t readMPURegister(uint8_t subAddress);
 
         void    readGyrometer(float & gx, float & gy, float & gz);
 
         int16_t readRawTemperature(void);
 
+        float   scaleTemperature(int16_t raw);
+
+        void    decodeFifoFrame(const uint8_t * frame, Sample_t & sample);
+
+        // The drain behind readFifoRaw() and readFifo(): takes every complete frame, up to maxFrames, in
+        // as few bursts as _maxBurst allows, each straight into frames when it is given, else into a
+        // buffer of its own that goes to the handler with the index of the burst's first frame.  With
+        // neither, it reads nothing and returns zero.
+        typedef void (*FifoBurst_t)(MPUIMU & imu, const uint8_t * frames, uint16_t first, uint16_t count, void * context);
+
+        uint16_t drainFifo(uint16_t maxFrames, uint8_t * frames, FifoBurst_t handler=NULL, void * context=NULL);
+
+        // The handlers for readFifo(): into Sample_t, and into SampleArrays_t through convertFrames()
+        static void decodeFifoBurst(MPUIMU & imu, const uint8_t * frames, uint16_t first, uint16_t count, void * context);
+        static void convertFifoBurst(MPUIMU & imu, const uint8_t * frames, uint16_t first, uint16_t count, void * context);
+
+        // Bookkeeping for getStats(): transports call countRead() with statsClock() taken before
+        // the transfer, and countWrite() after each register write
+#if defined(MPU_STATS)
+        volatile Stats_t _stats;
+        uint32_t         _statsFifoTime;
+        uint16_t         _statsFifoLeft;
+
+        static uint32_t statsClock(void);
+
+        void countRead(uint8_t count, bool ok, uint32_t start);
+        void countFifo(uint16_t bytes, uint16_t taken);
+
+        void countWrite(bool ok)
+        {
+            _stats.transactions++;
+            _stats.bytes++;
+            if (!ok) _stats.failures++;
+        }
+
+        void countSamples(uint16_t count) { _stats.samples += count; }
+
+        void countIntStatus(uint8_t status)
+        {
+            if (status & 0x10) _stats.fifoOverflows++;
+        }
+#else
+        static uint32_t statsClock(void) { return 0; }
+        void countRead(uint8_t count, bool ok, uint32_t start) { (void)count; (void)ok; (void)start; }
+        void countFifo(uint16_t bytes, uint16_t taken) { (void)bytes; (void)taken; }
+        void countWrite(bool ok) { (void)ok; }
+        void countSamples(uint16_t count) { (void)count; }
+        void countIntStatus(uint8_t status) { (void)status; }
+#endif
+
+        // Every INT_STATUS read goes through here, so that a FIFO overflow it clears is not lost
+        void noteIntStatus(uint8_t status)
+        {
+            if (status & 0x10) _fifoOverflowed = true;
+            countIntStatus(status);
+        }
+
+        void    decodeAll(const uint8_t rawData[14], Sample_t & sample);
+
+        // The scaling of six big-endian accelerometer or gyro bytes, shared by every read path
+        void    decodeAccel(const uint8_t rawData[6], float & ax, float & ay, float & az);
+        void    decodeGyro(const uint8_t rawData[6], float & gx, float & gy, float & gz);
+
         virtual void pushGyroBiases(uint8_t data[12]) { (void)data; }
 
+        // Whether pushGyroBiases() reaches hardware offset registers
+        virtual bool hasGyroOffsets(void) { return false; }
+
         virtual void readAccelOffsets(uint8_t data[12], int32_t accel_bias_reg[3]) { (void)data; (void)accel_bias_reg; }
 
         virtual void writeMPURegister(uint8_t subAddress, uint8_t data) = 0;
 
-        virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) = 0;
+        // One register at a time unless the transport can do better
+        virtual void writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data);
 
-        static float getRes(uint8_t scale, float vals[4]);
+        virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) = 0;
 
 }; // class MPU
+
+// Inlined so that MPUBusDevice hot paths compile to straight-line code
+inline float MPUIMU::scaleTemperature(int16_t raw)
+{
+    return (float)raw / _tempSensitivity + _tempOffset;
+}
+
+inline void MPUIMU::decodeAccel(const uint8_t rawData[6], float & ax, float & ay, float & az)
+{
+    int16_t x = ((int16_t)rawData[0] << 8) | rawData[1];  // Turn the MSB and LSB into a signed 16-bit value
+    int16_t y = ((int16_t)rawData[2] << 8) | rawData[3];
+    int16_t z = ((int16_t)rawData[4] << 8) | rawData[5];
+
+    // Convert the accleration value into g's
+    ax = (float)x*_aRes - _accelBias[0];
+    ay = (float)y*_aRes - _accelBias[1];
+    az = (float)z*_aRes - _accelBias[2];
+}
+
+inline void MPUIMU::decodeGyro(const uint8_t rawData[6], float & gx, float & gy, float & gz)
+{
+    int16_t x = ((int16_t)rawData[0] << 8) | rawData[1];
+    int16_t y = ((int16_t)rawData[2] << 8) | rawData[3];
+    int16_t z = ((int16_t)rawData[4] << 8) | rawData[5];
+
+    // Convert the gyro value into degrees per second, less the bias that the device leaves in
+    gx = (float)x*_gRes - _gyroBiasSubtracted[0];
+    gy = (float)y*_gRes - _gyroBiasSubtracted[1];
+    gz = (float)z*_gRes - _gyroBiasSubtracted[2];
+}
+
+inline void MPUIMU::decodeAll(const uint8_t rawData[14], Sample_t & sample)
+{
+    decodeAccel(&rawData[0], sample.accel[0], sample.accel[1], sample.accel[2]);
+    decodeGyro(&rawData[8], sample.gyro[0], sample.gyro[1], sample.gyro[2]);
+
+    sample.temperature = scaleTemperature(((int16_t)rawData[6] << 8) | rawData[7]);
+}
+
+inline void MPUIMU::decodeBurst(const uint8_t * rawData, Sample_t & sample)
+{
+    decodeAll(rawData, sample);
+
+    sample.mag[0] = 0;
+    sample.mag[1] = 0;
+    sample.mag[2] = 0;
+    sample.magAge = MAG_AGE_NONE;
+
+    sample.timestamp = 0;
+
+    countSamples(1);
+}
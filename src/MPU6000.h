@@ -28,17 +28,5 @@ class MPU6000 : public MPU6x00 {
 
         MPU6000(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor=0);
 
-        Error_t begin(void);
-
-        void readGyrometer(float & gx, float & gy, float & gz);
-
-        // Currently necessary for F4 controllers only
-        bool readAccelRaw(int16_t & x, int16_t & y, int16_t & z);
-        bool readGyroRaw(int16_t & x, int16_t & y, int16_t & z);
-        void scaleRawAccel(int16_t xraw, int16_t yraw, int16_t zraw, float & x, float & y, float & z);
-        void scaleRawGyro(int16_t xraw, int16_t yraw, int16_t zraw, float & x, float & y, float & z);
-
-    protected:
-
-        virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) override;
+        Error_t begin(uint32_t sensorClock=MPUSPI_SENSOR_CLOCK);
 }; 
@@ -20,28 +20,43 @@
 
 #include "MPU6050.h"
 
+#include "MPUI2C.h"
+
 #include "CrossPlatformI2C_Core.h"
 
 MPU6050::MPU6050(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor) : 
     MPU6xx0(ascale, gscale, sampleRateDivisor)
 {
+#if defined(ARDUINO)
+    _maxBurst = 32; // Wire library buffer size
+#endif
 }
 
-MPUIMU::Error_t MPU6050::begin(uint8_t bus)
+MPUIMU::Error_t MPU6050::begin(uint8_t bus, uint32_t clock)
 {
-    _i2c = cpi2c_open(MPU_ADDRESS, bus);
+    if (!_probedId) {
+        _i2cClock = clock;
+        _i2c = mpui2c_open(MPU_ADDRESS, bus, _i2cClock);
+    }
 
     return MPU6xx0::begin();
 }
 
 void MPU6050::writeMPURegister(uint8_t subAddress, uint8_t data)
 {
-    cpi2c_writeRegister(_i2c, subAddress, data);
+    countWrite(cpi2c_writeRegister(_i2c, subAddress, data));
+}
+
+void MPU6050::writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    countWrite(mpui2c_writeRegisters(_i2c, subAddress, count, data));
 }
 
 void MPU6050::readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
 {
-    cpi2c_readRegisters(_i2c, subAddress, count, dest);
+    uint32_t start = statsClock();
+    bool ok = mpui2c_readRegisters(_i2c, subAddress, count, dest);
+    countRead(count, ok, start);
 }
 
 
@@ -28,16 +28,17 @@ class MPU6050 : public MPU6xx0 {
 
         MPU6050(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor=0);
 
-        Error_t begin(uint8_t bus=1);
+        // The MPU6050 has no SPI, so ask for Fast-mode I^2C by default
+        Error_t begin(uint8_t bus=1, uint32_t clock=400000);
+
+        // Bus clock in Hz, zero when the platform does not say
+        uint32_t getBusClock(void) { return _i2cClock; }
 
     protected:
 
         virtual void writeMPURegister(uint8_t subAddress, uint8_t data) override;
 
-        virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) override;
-
-    private:
+        virtual void writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data) override;
 
-        // Cross-platform support
-        uint8_t  _i2c;
+        virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) override;
 }; 
@@ -30,11 +30,11 @@ class MPU6500 : public MPU6x00 {
 
         MPU6500(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor=0);
 
-        Error_t begin(void);
+        Error_t begin(uint32_t sensorClock=MPUSPI_SENSOR_CLOCK);
 
         bool checkNewData(void);
 
-        void readGyrometer(float & gx, float & gy, float & gz);
+        using MPUIMU::checkNewData;
 
     protected:
 
@@ -42,6 +42,4 @@ class MPU6500 : public MPU6x00 {
         static const uint8_t SELF_TEST_X_GYRO  = 0x00;                  
         static const uint8_t SELF_TEST_Y_GYRO  = 0x01;
         static const uint8_t SELF_TEST_Z_GYRO  = 0x02;
-
-        virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) override;
 }; 
@@ -0,0 +1,52 @@
+/*
+   MPU6500_Mock.cpp: MPU6500 backed by an MPUSimulator instead of a bus
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPU6500_Mock.h"
+
+MPU6500_Mock::MPU6500_Mock(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor) :
+    MPU6500(ascale, gscale, sampleRateDivisor), _sim(0x70)
+{
+}
+
+MPUIMU::Error_t MPU6500_Mock::begin(void)
+{
+    // As for MPU9250_Mock, startup transfers stand in for the delays between them
+    uint32_t transferTime = _sim.getTransferTime();
+    _sim.setTransferTime(MPUSimulator::STARTUP_TRANSFER_TIME);
+
+    Error_t error = MPU6500::begin();
+
+    _sim.setTransferTime(transferTime);
+
+    return error;
+}
+
+void MPU6500_Mock::writeMPURegister(uint8_t subAddress, uint8_t data)
+{
+    _sim.writeRegister(MPUSimulator::MPU_ADDRESS, subAddress, data);
+    countWrite(true);
+}
+
+void MPU6500_Mock::readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    uint32_t start = statsClock();
+    _sim.readRegisters(MPUSimulator::MPU_ADDRESS, subAddress, count, dest);
+    countRead(count, true, start);
+}
@@ -20,14 +20,15 @@
 
 #include "MPU6x00.h"
 
-#include "CrossPlatformSPI.h"
+#include "MPUSPI.h"
 
 MPU6x00::MPU6x00(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor) : 
     MPU6xx0(ascale, gscale, sampleRateDivisor)
 {
+    _subtractGyroBias = false; // MPU6000 and MPU6500 report gyro without bias removal
 }
 
-MPUIMU::Error_t MPU6x00::begin(void)
+MPUIMU::Error_t MPU6x00::begin(uint32_t sensorClock)
 {
     //if (getId() != MPU_ADDRESS) {
     //    return ERROR_IMU_ID;
@@ -37,45 +38,70 @@ MPUIMU::Error_t MPU6x00::begin(void)
     //    return ERROR_SELFTEST;
     //}
 
-    cpspi_writeRegister(PWR_MGMT_1, 0x80);
+    mpuspi_setSensorClock(0);
+
+    invalidateRegisterCache(); // the writes below bypass the register cache
+
+    writeMPURegister(PWR_MGMT_1, 0x80);
     delay(100);
 
-    cpspi_writeRegister(SIGNAL_PATH_RESET, 0x80);
+    writeMPURegister(SIGNAL_PATH_RESET, 0x80);
     delay(100);
 
-    cpspi_writeRegister(PWR_MGMT_1, 0x00);
+    writeMPURegister(PWR_MGMT_1, 0x00);
     delay(100);
 
-    cpspi_writeRegister(PWR_MGMT_1, INV_CLK_PLL);
+    writeMPURegister(PWR_MGMT_1, INV_CLK_PLL);
     delay(15);
 
-    cpspi_writeRegister(GYRO_CONFIG, _gScale << 3);
+    writeMPURegister(GYRO_CONFIG, _gScale << 3);
     delay(15);
 
-    cpspi_writeRegister(ACCEL_CONFIG, _aScale << 3);
+    writeMPURegister(ACCEL_CONFIG, _aScale << 3);
     delay(15);
 
-    cpspi_writeRegister(CONFIG, 0); // no DLPF bits
+    writeMPURegister(CONFIG, 0); // no DLPF bits
     delay(15);
 
-    cpspi_writeRegister(SMPLRT_DIV, _sampleRateDivisor); 
+    writeMPURegister(SMPLRT_DIV, _sampleRateDivisor); 
+    _sampleRate = 8000.f / (1 + _sampleRateDivisor); // gyro output rate is 8 kHz with the DLPF off
     delay(100);
 
     // Data ready interrupt configuration
-    cpspi_writeRegister(INT_PIN_CFG, 0x10);  
+    writeConfigRegister(INT_PIN_CFG, 0x10);  
     delay(15);
 
-    cpspi_writeRegister(INT_ENABLE, 0x01); 
+    writeMPURegister(INT_ENABLE, 0x01); 
     delay(15);
 
-    _accelBias[0] = 0;
-    _accelBias[1] = 0;
-    _accelBias[2] = 0;
+    // Biases restored by setCalibration() are kept; otherwise there is no accelerometer calibration
+    if (_warmStart) {
+        pushCalibration();
+    }
+    else {
+        const float accelBias[3] = {0, 0, 0};
+        setBiases(accelBias, _gyroBias);
+    }
+
+    mpuspi_setSensorClock(sensorClock);
 
     return ERROR_NONE;
 }
 
 void MPU6x00::writeMPURegister(uint8_t subAddress, uint8_t data)
 {
-    cpspi_writeRegister(subAddress, data);
+    mpuspi_writeRegister(subAddress, data);
+    countWrite(true);
+}
+
+void MPU6x00::writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    countWrite(mpuspi_writeRegisters(subAddress, count, data));
+}
+
+void MPU6x00::readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    uint32_t start = statsClock();
+    bool ok = mpuspi_readRegisters(subAddress, count, dest);
+    countRead(count, ok, start);
 }
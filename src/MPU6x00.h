@@ -21,6 +21,7 @@
 #pragma once
 
 #include "MPU6xx0.h"
+#include "MPUSPI.h"
 
 class MPU6x00 : public MPU6xx0 {
 
@@ -30,7 +31,12 @@ class MPU6x00 : public MPU6xx0 {
 
     protected:
 
-        Error_t begin(void);
+        // Configures the device at MPUSPI_REGISTER_CLOCK, then reads its sensor registers at sensorClock
+        Error_t begin(uint32_t sensorClock);
 
         virtual void writeMPURegister(uint8_t subAddress, uint8_t data) override;
+
+        virtual void writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data) override;
+
+        virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) override;
 }; 
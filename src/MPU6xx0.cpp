@@ -32,6 +32,12 @@ bool MPU6xx0::checkNewData(void)
 MPU6xx0::MPU6xx0(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor) : 
     MPUIMU(ascale, gscale, sampleRateDivisor)
 {
+    _subtractGyroBias = true;
+
+    _tempSensitivity = 340.f;
+    _tempOffset = 36.53f;
+
+    _fifoSize = 1024;
 }
 
 MPUIMU::Error_t MPU6xx0::begin(void)
@@ -40,31 +46,28 @@ MPUIMU::Error_t MPU6xx0::begin(void)
         return ERROR_IMU_ID;
     }
 
-    if (!selfTest()) {
-        return ERROR_SELFTEST;
-    }
+    // A calibration restored with setCalibration() makes the self-test and calibration unnecessary
+    if (!_warmStart) {
 
+        if (!selfTest()) {
+            return ERROR_SELFTEST;
+        }
 
-    calibrate();
+        calibrate();
+    }
 
     init();
 
-    return ERROR_NONE;
-}
-
-void MPU6xx0::readGyrometer(float & gx, float & gy, float & gz)
-{
-    MPUIMU::readGyrometer(gx, gy, gz);
+    if (_warmStart) {
+        pushCalibration();
+    }
 
-    gx -= _gyroBias[0];
-    gy -= _gyroBias[1];  
-    gz -= _gyroBias[2];   
+    return ERROR_NONE;
 }
 
 float MPU6xx0::readTemperature()
 {
-    int16_t t = MPUIMU::readRawTemperature();
-    return ((float) t) / 340. + 36.53; // Temperature in degrees Centigrade
+    return scaleTemperature(MPUIMU::readRawTemperature()); // Temperature in degrees Centigrade
 }
 
 // Configure the motion detection control for low power accelerometer mode
@@ -76,98 +79,104 @@ void MPU6xx0::lowPowerAccelOnly()
     // threshold for some time sets this flag, motion above the threshold turns it off). The high-pass filter takes gravity out
     // consideration for these threshold evaluations; otherwise, the flags would be set all the time!
 
-    uint8_t c = readMPURegister(PWR_MGMT_1);
-    writeMPURegister(PWR_MGMT_1, c & ~0x30); // Clear sleep and cycle bits [5:6]
-    writeMPURegister(PWR_MGMT_1, c |  0x30); // Set sleep and cycle bits [5:6] to zero to make sure accelerometer is running
+    uint8_t c = readConfigRegister(PWR_MGMT_1);
+    writeConfigRegister(PWR_MGMT_1, c & ~0x30); // Clear sleep and cycle bits [5:6]
+    writeConfigRegister(PWR_MGMT_1, c |  0x30); // Set sleep and cycle bits [5:6] to zero to make sure accelerometer is running
 
-    c = readMPURegister(PWR_MGMT_2);
-    writeMPURegister(PWR_MGMT_2, c & ~0x38); // Clear standby XA, YA, and ZA bits [3:5]
-    writeMPURegister(PWR_MGMT_2, c |  0x00); // Set XA, YA, and ZA bits [3:5] to zero to make sure accelerometer is running
+    c = readConfigRegister(PWR_MGMT_2);
+    writeConfigRegister(PWR_MGMT_2, c & ~0x38); // Clear standby XA, YA, and ZA bits [3:5]
+    writeConfigRegister(PWR_MGMT_2, c |  0x00); // Set XA, YA, and ZA bits [3:5] to zero to make sure accelerometer is running
 
-    c = readMPURegister(ACCEL_CONFIG);
-    writeMPURegister(ACCEL_CONFIG, c & ~0x07); // Clear high-pass filter bits [2:0]
+    c = readConfigRegister(ACCEL_CONFIG);
+    writeConfigRegister(ACCEL_CONFIG, c & ~0x07); // Clear high-pass filter bits [2:0]
     // Set high-pass filter to 0) reset (disable), 1) 5 Hz, 2) 2.5 Hz, 3) 1.25 Hz, 4) 0.63 Hz, or 7) Hold
-    writeMPURegister(ACCEL_CONFIG,  c | 0x00);  // Set ACCEL_HPF to 0; reset mode disbaling high-pass filter
+    writeConfigRegister(ACCEL_CONFIG,  c | 0x00);  // Set ACCEL_HPF to 0; reset mode disbaling high-pass filter
 
-    c = readMPURegister(CONFIG);
-    writeMPURegister(CONFIG, c & ~0x07); // Clear low-pass filter bits [2:0]
-    writeMPURegister(CONFIG, c |  0x00);  // Set DLPD_CFG to 0; 260 Hz bandwidth, 1 kHz rate
+    c = readConfigRegister(CONFIG);
+    writeConfigRegister(CONFIG, c & ~0x07); // Clear low-pass filter bits [2:0]
+    writeConfigRegister(CONFIG, c |  0x00);  // Set DLPD_CFG to 0; 260 Hz bandwidth, 1 kHz rate
 
-    c = readMPURegister(INT_ENABLE);
-    writeMPURegister(INT_ENABLE, c & ~0xFF);  // Clear all interrupts
-    writeMPURegister(INT_ENABLE, 0x40);  // Enable motion threshold (bits 5) interrupt only
+    c = readConfigRegister(INT_ENABLE);
+    writeConfigRegister(INT_ENABLE, c & ~0xFF);  // Clear all interrupts
+    writeConfigRegister(INT_ENABLE, 0x40);  // Enable motion threshold (bits 5) interrupt only
 
     // Motion detection interrupt requires the absolute value of any axis to lie above the detection threshold
     // for at least the counter duration
-    writeMPURegister(MOT_THR, 0x80); // Set motion detection to 0.256 g; LSB = 2 mg
-    writeMPURegister(MOT_DUR, 0x01); // Set motion detect duration to 1  ms; LSB is 1 ms @ 1 kHz rate
+    writeConfigRegister(MOT_THR, 0x80); // Set motion detection to 0.256 g; LSB = 2 mg
+    writeConfigRegister(MOT_DUR, 0x01); // Set motion detect duration to 1  ms; LSB is 1 ms @ 1 kHz rate
 
     delay (100);  // Add delay for accumulation of samples
 
-    c = readMPURegister(ACCEL_CONFIG);
-    writeMPURegister(ACCEL_CONFIG, c & ~0x07); // Clear high-pass filter bits [2:0]
-    writeMPURegister(ACCEL_CONFIG, c |  0x07);  // Set ACCEL_HPF to 7; hold the initial accleration value as a referance
+    c = readConfigRegister(ACCEL_CONFIG);
+    writeConfigRegister(ACCEL_CONFIG, c & ~0x07); // Clear high-pass filter bits [2:0]
+    writeConfigRegister(ACCEL_CONFIG, c |  0x07);  // Set ACCEL_HPF to 7; hold the initial accleration value as a referance
 
-    c = readMPURegister(PWR_MGMT_2);
-    writeMPURegister(PWR_MGMT_2, c & ~0xC7); // Clear standby XA, YA, and ZA bits [3:5] and LP_WAKE_CTRL bits [6:7]
-    writeMPURegister(PWR_MGMT_2, c |  0x47); // Set wakeup frequency to 5 Hz, and disable XG, YG, and ZG gyros (bits [0:2])
+    c = readConfigRegister(PWR_MGMT_2);
+    writeConfigRegister(PWR_MGMT_2, c & ~0xC7); // Clear standby XA, YA, and ZA bits [3:5] and LP_WAKE_CTRL bits [6:7]
+    writeConfigRegister(PWR_MGMT_2, c |  0x47); // Set wakeup frequency to 5 Hz, and disable XG, YG, and ZG gyros (bits [0:2])
 
-    c = readMPURegister(PWR_MGMT_1);
-    writeMPURegister(PWR_MGMT_1, c & ~0x20); // Clear sleep and cycle bit 5
-    writeMPURegister(PWR_MGMT_1, c |  0x20); // Set cycle bit 5 to begin low power accelerometer motion interrupts
+    c = readConfigRegister(PWR_MGMT_1);
+    writeConfigRegister(PWR_MGMT_1, c & ~0x20); // Clear sleep and cycle bit 5
+    writeConfigRegister(PWR_MGMT_1, c |  0x20); // Set cycle bit 5 to begin low power accelerometer motion interrupts
 
 }
 
 void MPU6xx0::init(void)
 {
     // wake up device-don't need this here if using calibration function below
-    //  writeMPURegister(PWR_MGMT_1, 0x00); // Clear sleep mode bit (6), enable all sensors
+    //  writeConfigRegister(PWR_MGMT_1, 0x00); // Clear sleep mode bit (6), enable all sensors
     //  delay(100); // Delay 100 ms for PLL to get established on x-axis gyro; should check for PLL ready interrupt
 
     // get stable time source
-    writeMPURegister(PWR_MGMT_1, 0x01);  // Set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001
+    writeConfigRegister(PWR_MGMT_1, 0x01);  // Set clock source to be PLL with x-axis gyroscope reference, bits 2:0 = 001
+
+    // SMPLRT_DIV through ACCEL_CONFIG in one transfer
+    uint8_t c[4];
+
+    // Set sample rate = gyroscope output rate/(1 + SMPLRT_DIV)
+    c[0] = 0x04;  // Use a 200 Hz rate; the same rate set in CONFIG below
+    _sampleRate = 1000.f / (1 + 0x04);
 
     // Configure Gyro and Accelerometer
     // Disable FSYNC and set accelerometer and gyro bandwidth to 44 and 42 Hz, respectively;
     // DLPF_CFG = bits 2:0 = 010; this sets the sample rate at 1 kHz for both
     // Maximum delay time is 4.9 ms corresponding to just over 200 Hz sample rate
-    writeMPURegister(CONFIG, 0x03);
-
-    // Set sample rate = gyroscope output rate/(1 + SMPLRT_DIV)
-    writeMPURegister(SMPLRT_DIV, 0x04);  // Use a 200 Hz rate; the same rate set in CONFIG above
+    c[1] = 0x03;
 
-    // Set gyroscope full scale range
+    // Set gyroscope full scale range, with self-test off
     // Range selects FS_SEL and AFS_SEL are 0 - 3, so 2-bit values are left-shifted into positions 4:3
-    uint8_t c =  readMPURegister(GYRO_CONFIG);
-    writeMPURegister(GYRO_CONFIG, c & ~0xE0); // Clear self-test bits [7:5]
-    writeMPURegister(GYRO_CONFIG, c & ~0x18); // Clear AFS bits [4:3]
-    writeMPURegister(GYRO_CONFIG, c | _gScale << 3); // Set full scale range for the gyro
+    c[2] = readConfigRegister(GYRO_CONFIG) & ~0xF8;
+    c[2] |= _gScale << 3;
+
+    // Set accelerometer full scale range, with self-test off
+    c[3] = readConfigRegister(ACCEL_CONFIG) & ~0xF8;
+    c[3] |= _aScale << 3;
 
-    // Set accelerometer configuration
-    c =  readMPURegister(ACCEL_CONFIG);
-    writeMPURegister(ACCEL_CONFIG, c & ~0xE0); // Clear self-test bits [7:5]
-    writeMPURegister(ACCEL_CONFIG, c & ~0x18); // Clear AFS bits [4:3]
-    writeMPURegister(ACCEL_CONFIG, c | _aScale << 3); // Set full scale range for the accelerometer
+    writeConfigRegisters(SMPLRT_DIV, 4, c);
 
     // Configure Interrupts and Bypass Enable
     // Set interrupt pin active high, push-pull, and clear on read of INT_STATUS, enable I2C_BYPASS_EN so additional chips
     // can join the I2C bus and all can be controlled by the Arduino as master
-    writeMPURegister(INT_PIN_CFG, 0x22);
-    writeMPURegister(INT_ENABLE, 0x01);  // Enable data ready (bit 0) interrupt
+    uint8_t interrupts[2] = {
+        0x22,   // INT_PIN_CFG
+        0x01    // INT_ENABLE: data ready (bit 0)
+    };
+    writeConfigRegisters(INT_PIN_CFG, 2, interrupts);
 }
 
 // Accelerometer and gyroscope self test; check calibration wrt factory settings.
-// Should return percent deviation from factory trim values, +/- 14 or less deviation is a pass.
+// The self-test response (output with self-test on, less output with it off) should be within
+// 14 percent of the factory trim.
 bool MPU6xx0::selfTest(void)
 {
+    // The self-test reconfigures the device behind the register cache's back
+    invalidateRegisterCache();
+
     uint8_t rawData[4];
     uint8_t selfTest[6];
     float factoryTrim[6];
+    float normal[6], test[6];
 
-    // Configure the accelerometer for self-test
-    writeMPURegister(ACCEL_CONFIG, 0xF0); // Enable self test on all three axes and set accelerometer range to +/- 8 g
-    writeMPURegister(GYRO_CONFIG,  0xE0); // Enable self test on all three axes and set gyro range to +/- 250 degrees/s
-    delay(250);  // Delay a while to let the device execute the self-test
     rawData[0] = readMPURegister(SELF_TEST_X_ACCEL); // X-axis self-test results
     rawData[1] = readMPURegister(SELF_TEST_Y_ACCEL); // Y-axis self-test results
     rawData[2] = readMPURegister(SELF_TEST_Z_ACCEL); // Z-axis self-test results
@@ -180,34 +189,42 @@ bool MPU6xx0::selfTest(void)
     selfTest[3] = rawData[0]  & 0x1F ; // XG_TEST result is a five-bit unsigned integer
     selfTest[4] = rawData[1]  & 0x1F ; // YG_TEST result is a five-bit unsigned integer
     selfTest[5] = rawData[2]  & 0x1F ; // ZG_TEST result is a five-bit unsigned integer
-    // Process results to allow final comparison with factory set values
+    // Process results to allow final comparison with factory set values; a code of zero has no trim
     factoryTrim[0] = (4096.0 * 0.34) * (pow( (0.92 / 0.34) , (((float)selfTest[0] - 1.0) / 30.0))); // FT[Xa] factory trim calculation
     factoryTrim[1] = (4096.0 * 0.34) * (pow( (0.92 / 0.34) , (((float)selfTest[1] - 1.0) / 30.0))); // FT[Ya] factory trim calculation
     factoryTrim[2] = (4096.0 * 0.34) * (pow( (0.92 / 0.34) , (((float)selfTest[2] - 1.0) / 30.0))); // FT[Za] factory trim calculation
     factoryTrim[3] =  ( 25.0 * 131.0) * (pow( 1.046 , ((float)selfTest[3] - 1.0) ));         // FT[Xg] factory trim calculation
     factoryTrim[4] =  (-25.0 * 131.0) * (pow( 1.046 , ((float)selfTest[4] - 1.0) ));         // FT[Yg] factory trim calculation
     factoryTrim[5] =  ( 25.0 * 131.0) * (pow( 1.046 , ((float)selfTest[5] - 1.0) ));         // FT[Zg] factory trim calculation
+    for (uint8_t k=0; k<6; ++k) {
+        if (selfTest[k] == 0) {
+            factoryTrim[k] = 0;
+        }
+    }
 
-    //  Output self-test results and factory trim calculation if desired
-    //  Serial.println(selfTest[0]); Serial.println(selfTest[1]); Serial.println(selfTest[2]);
-    //  Serial.println(selfTest[3]); Serial.println(selfTest[4]); Serial.println(selfTest[5]);
-    //  Serial.println(factoryTrim[0]); Serial.println(factoryTrim[1]); Serial.println(factoryTrim[2]);
-    //  Serial.println(factoryTrim[3]); Serial.println(factoryTrim[4]); Serial.println(factoryTrim[5]);
+    // The device powers up asleep
+    writeMPURegister(PWR_MGMT_1, 0x01);    // PLL with x-axis gyroscope reference
+    writeMPURegister(SMPLRT_DIV, 0x00);    // 1 kHz
+    writeMPURegister(CONFIG, 0x02);        // 94 Hz accelerometer and 98 Hz gyro bandwidth, 1 kHz rate
+    writeMPURegister(ACCEL_CONFIG, 0x10);  // +/- 8 g, the range the factory trim is for
+    writeMPURegister(GYRO_CONFIG,  0x00);  // +/- 250 degrees/s
+    delay(35);  // Gyro start-up time
 
-    // Report results as a ratio of (STR - FT)/FT; the change from Factory Trim of the Self-Test Response
-    // To get to percent, must multiply by 100 and subtract result from 100
-    float tolerances[6];
-    for (int i = 0; i < 6; i++) {
-        tolerances[i] = 100.0 + 100.0 * ((float)selfTest[i] - factoryTrim[i]) / factoryTrim[i]; // Report percent differences
-    }
+    uint16_t samples = sampleSelfTest(factoryTrim, normal);
 
-    // Check results
-    for (uint8_t k=0; k<6; ++k) {
-        if (tolerances[k] >= 14.f) {
-            return false;
-        }
+    // Configure the accelerometer for self-test
+    writeMPURegister(ACCEL_CONFIG, 0xF0); // Enable self test on all three axes and set accelerometer range to +/- 8 g
+    writeMPURegister(GYRO_CONFIG,  0xE0); // Enable self test on all three axes and set gyro range to +/- 250 degrees/s
+    delay(25);  // Delay a while to let the device stabilize
+
+    uint16_t testSamples = sampleSelfTest(factoryTrim, test);
+    if (testSamples < samples) {
+        samples = testSamples;
     }
 
-    // Success!
-    return true;
+    writeMPURegister(ACCEL_CONFIG, 0x00);
+    writeMPURegister(GYRO_CONFIG,  0x00);
+
+    // Report results as a ratio of (STR - FT)/FT; the change from Factory Trim of the Self-Test Response
+    return evaluateSelfTest(normal, test, factoryTrim, samples);
 }
@@ -32,9 +32,11 @@ class MPU6xx0 : public MPUIMU {
 
         bool        checkNewData(void);
 
+        using MPUIMU::checkNewData;
+
         void        lowPowerAccelOnly(void);
 
-        void        readGyrometer(float & gx, float & gy, float & gz);
+        using MPUIMU::readGyrometer;
 
         float       readTemperature(void);
 
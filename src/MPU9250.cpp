@@ -24,6 +24,18 @@
 
 #include <math.h>
 
+#if defined(__linux__)
+#include <atomic>
+#endif
+
+// Orders the magnetometer correction against its sequence number for readers on other cores
+static inline void magBarrier(void)
+{
+#if defined(__linux__)
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+}
+
 MPU9250::MPU9250(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale, 
         Mmode_t mmode, uint8_t sampleRateDivisor, bool passthru) : 
     MPUIMU(ascale, gscale, sampleRateDivisor)
@@ -32,20 +44,21 @@ MPU9250::MPU9250(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale,
     _mScale = mscale;
     _mMode = mmode;
 
-    _sampleRateDivisor = sampleRateDivisor;
-
     _passthru = passthru;
+
+    // Passthru mode has always run the gyro at 41 Hz; master mode leaves CONFIG at its reset value
+    _gyroBandwidth = passthru ? GYRO_DLPF_41HZ : GYRO_DLPF_250HZ;
+    _accelBandwidth = ACCEL_DLPF_41HZ;
+    updateSampleRate();
+
+    _tempSensitivity = 333.87f;
+    _tempOffset = 21.0f;
 }
 
 
 void MPU9250::pushGyroBiases(uint8_t data[12])
 {
-    writeMPURegister(XG_OFFSET_H, data[0]);
-    writeMPURegister(XG_OFFSET_L, data[1]);
-    writeMPURegister(YG_OFFSET_H, data[2]);
-    writeMPURegister(YG_OFFSET_L, data[3]);
-    writeMPURegister(ZG_OFFSET_H, data[4]);
-    writeMPURegister(ZG_OFFSET_L, data[5]);
+    writeConfigRegisters(XG_OFFSET_H, 6, data); // XG_OFFSET_H through ZG_OFFSET_L
 }
 
 void MPU9250::readAccelOffsets(uint8_t data[12], int32_t accel_bias_reg[3])
@@ -67,23 +80,35 @@ MPUIMU::Error_t MPU9250::runTests(void)
 
     reset(); // start by resetting MPU9250
 
-    if (!selfTest()) {
-        return ERROR_SELFTEST;
-    }
+    // Biases restored by setCalibration() take the place of the self-test and calibration
+    if (!_warmStart) {
 
-    // Calibrate gyro and accelerometers, load biases in bias registers.
-    // Comment out if using pre-measured, pre-stored accel/gyro offset biases.
-    calibrate(); 
+        if (!selfTest()) {
+            return ERROR_SELFTEST;
+        }
+
+        // Calibrate gyro and accelerometers, load biases in bias registers.
+        calibrate(); 
+    }
 
     initMPU6500(_aScale, _gScale, _sampleRateDivisor, _passthru); 
 
+    // initMPU6500() resets the device, so the gyro offsets, whether calibrated above or restored,
+    // are pushed after it
+    pushCalibration();
+
     // check AK8963 WHO AM I register, expected value is 0x48 (decimal 72)
     if (getAK8963CID() != 0x48) {
         return ERROR_MAG_ID;
     }
 
-    // Get magnetometer calibration from AK8963 ROM
-    initAK8963(_mScale, _mMode, _magCalibration);
+    // Get magnetometer calibration from AK8963 ROM, unless it was restored
+    if (_warmStart) {
+        startAK8963(_mScale, _mMode);
+    }
+    else {
+        initAK8963(_mScale, _mMode, _magCalibration);
+    }
 
     return ERROR_NONE;
 }
@@ -111,32 +136,32 @@ void MPU9250::accelWakeOnMotion()
     // Set accelerometer sample rate configuration
     // It is possible to get a 4 kHz sample rate from the accelerometer by choosing 1 for
     // accel_fchoice_b bit [3]; in this case the bandwidth is 1.13 kHz
-    uint8_t c = readMPURegister(ACCEL_CONFIG2); // get current ACCEL_CONFIG2 register value
+    uint8_t c = readConfigRegister(ACCEL_CONFIG2); // get current ACCEL_CONFIG2 register value
     c = c & ~0x0F; // Clear accel_fchoice_b (bit 3) and A_DLPFG (bits [2:0])  
     c = c | 0x01;  // Set accelerometer rate to 1 kHz and bandwidth to 184 Hz
-    writeMPURegister(ACCEL_CONFIG2, c); // Write new ACCEL_CONFIG2 register value
+    writeConfigRegister(ACCEL_CONFIG2, c); // Write new ACCEL_CONFIG2 register value
 
     // Configure Interrupts and Bypass Enable
     // Set interrupt pin active high, push-pull, hold interrupt pin level HIGH until interrupt cleared,
     // clear on read of INT_STATUS, and enable I2C_BYPASS_EN so additional chips 
     // can join the I2C bus and all can be controlled by the Arduino as master 
-    writeMPURegister(INT_PIN_CFG, 0x12);  // INT is 50 microsecond pulse and any read to clear  
-    writeMPURegister(INT_ENABLE, 0x41);   // Enable data ready (bit 0) and wake on motion (bit 6)  interrupt
+    writeConfigRegister(INT_PIN_CFG, 0x12);  // INT is 50 microsecond pulse and any read to clear  
+    writeConfigRegister(INT_ENABLE, 0x41);   // Enable data ready (bit 0) and wake on motion (bit 6)  interrupt
 
     // enable wake on motion detection logic (bit 7) and compare current sample to previous sample (bit 6)
-    writeMPURegister(MOT_DETECT_CTRL, 0xC0);  
+    writeConfigRegister(MOT_DETECT_CTRL, 0xC0);  
 
     // set accel threshold for wake up at  mG per LSB, 1 - 255 LSBs == 0 - 1020 mg), pic 0x19 for 25 mg
-    writeMPURegister(MOT_THR, 0x19);
+    writeConfigRegister(MOT_THR, 0x19);
 
     // set sample rate in low power mode
     /* choices are 0 == 0.24 Hz, 1 == 0.49 Hz, 2 == 0.98 Hz, 3 == 1.958 Hz, 4 == 3.91 Hz, 5 == 7.81 Hz
      *             6 == 15.63 Hz, 7 == 31.25 Hz, 8 == 62.50 Hz, 9 = 125 Hz, 10 == 250 Hz, and 11 == 500 Hz
      */
-    writeMPURegister(LP_ACCEL_ODR, 0x02);
+    writeConfigRegister(LP_ACCEL_ODR, 0x02);
 
-    c = readMPURegister(PWR_MGMT_1);
-    writeMPURegister(PWR_MGMT_1, c | 0x20);     // Write bit 5 to enable accel cycling
+    c = readConfigRegister(PWR_MGMT_1);
+    writeConfigRegister(PWR_MGMT_1, c | 0x20);     // Write bit 5 to enable accel cycling
 
     gyroMagSleep();
     delay(100); // Wait for all registers to reset 
@@ -150,7 +175,7 @@ void MPU9250::reset()
     }
 
     // reset device
-    writeMPURegister(PWR_MGMT_1, 0x80); // Set bit 7 to reset MPU9250
+    writeConfigRegister(PWR_MGMT_1, 0x80); // Set bit 7 to reset MPU9250
 
     if (!_passthru) {
     	writeMPURegister(USER_CTRL, I2C_MST_EN); // re-enable internal I2C bus
@@ -162,25 +187,26 @@ void MPU9250::reset()
 
 bool MPU9250::checkWakeOnMotion()
 {
-    return (readMPURegister(INT_STATUS) & 0x40);
+    uint8_t status = readMPURegister(INT_STATUS);
+    noteIntStatus(status);
+    return (status & 0x40);
 }
 
 
 float MPU9250::readTemperature()
 {
-    int16_t t = MPUIMU::readRawTemperature();
-    return ((float)t) / 333.87f + 21.0f; // Gyro chip temperature in degrees Centigrade)
+    return scaleTemperature(MPUIMU::readRawTemperature()); // Gyro chip temperature in degrees Centigrade
 }
 
 void MPU9250::initMPU6500(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor, bool passthru)
 {  
     // wake up device
-    //writeMPURegister(PWR_MGMT_1, 0x00); // Clear sleep mode bit (6), enable all sensors 
-    writeMPURegister(PWR_MGMT_1, 0x80); // Clear sleep mode bit (6), enable all sensors 
+    //writeConfigRegister(PWR_MGMT_1, 0x00); // Clear sleep mode bit (6), enable all sensors 
+    writeConfigRegister(PWR_MGMT_1, 0x80); // Clear sleep mode bit (6), enable all sensors 
     delay(100); // Wait for all registers to reset 
 
     // get stable time source
-    writeMPURegister(PWR_MGMT_1, 0x01);  // Auto select clock source to be PLL gyroscope reference if ready else
+    writeConfigRegister(PWR_MGMT_1, 0x01);  // Auto select clock source to be PLL gyroscope reference if ready else
     delay(200); 
 
     // ----------------------------------
@@ -190,64 +216,130 @@ void MPU9250::initMPU6500(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDi
     // minimum delay time for this setting is 5.9 ms, which means sensor fusion update rates cannot
     // be higher than 1 / 0.0059 = 170 Hz
     // DLPF_CFG = bits 2:0 = 011; this limits the sample rate to 1000 Hz for both
-    // With the MPU9250, it is possible to get gyro sample rates of 32 kHz (!), 8 kHz, or 1 kHz
-    if (passthru) writeMPURegister(CONFIG, 0x03);  
-
+    // With the MPU9250, it is possible to get gyro sample rates of 32 kHz (!), 8 kHz, or 1 kHz;
+    // see setBandwidth()
     // Set sample rate = gyroscope output rate/(1 + SMPLRT_DIV)
-    writeMPURegister(SMPLRT_DIV, sampleRateDivisor);  // Use a 200 Hz rate; a rate consistent with the filter update rate 
-    // determined inset in CONFIG above
+    _sampleRateDivisor = sampleRateDivisor;
+    writeBandwidth();
 
     // Set gyroscope full scale range
     // Range selects FS_SEL and AFS_SEL are 0 - 3, so 2-bit values are left-shifted into positions 4:3
-    uint8_t c = readMPURegister(GYRO_CONFIG); // get current GYRO_CONFIG register value
+    uint8_t c = readConfigRegister(GYRO_CONFIG); // get current GYRO_CONFIG register value
     // c = c & ~0xE0; // Clear self-test bits [7:5] 
-    c = c & ~0x02; // Clear Fchoice bits [1:0] 
     c = c & ~0x18; // Clear AFS bits [4:3]
     c = c | gscale << 3; // Set full scale range for the gyro
-    // c =| 0x00; // Set Fchoice for the gyro to 11 by writing its inverse to bits 1:0 of GYRO_CONFIG
-    writeMPURegister(GYRO_CONFIG, c ); // Write new GYRO_CONFIG value to register
+    writeConfigRegister(GYRO_CONFIG, c ); // Write new GYRO_CONFIG value to register
 
     // Set accelerometer full-scale range configuration
-    c = readMPURegister(ACCEL_CONFIG); // get current ACCEL_CONFIG register value
+    c = readConfigRegister(ACCEL_CONFIG); // get current ACCEL_CONFIG register value
     // c = c & ~0xE0; // Clear self-test bits [7:5] 
     c = c & ~0x18;  // Clear AFS bits [4:3]
     c = c | ascale << 3; // Set full scale range for the accelerometer 
-    writeMPURegister(ACCEL_CONFIG, c); // Write new ACCEL_CONFIG register value
+    writeConfigRegister(ACCEL_CONFIG, c); // Write new ACCEL_CONFIG register value
 
-    // Set accelerometer sample rate configuration
-    // It is possible to get a 4 kHz sample rate from the accelerometer by choosing 1 for
-    // accel_fchoice_b bit [3]; in this case the bandwidth is 1.13 kHz
-    c = readMPURegister(ACCEL_CONFIG2); // get current ACCEL_CONFIG2 register value
-    c = c & ~0x0F; // Clear accel_fchoice_b (bit 3) and A_DLPFG (bits [2:0])  
-    c = c | 0x03;  // Set accelerometer rate to 1 kHz and bandwidth to 41 Hz
-    writeMPURegister(ACCEL_CONFIG2, c); // Write new ACCEL_CONFIG2 register value
-
-    // The accelerometer, gyro, and thermometer are set to 1 kHz sample rates, 
-    // but all these rates are further reduced by a factor of 5 to 200 Hz because of the SMPLRT_DIV setting
+    // The accelerometer, gyro, and thermometer are set to 1 kHz sample rates by default, 
+    // but all these rates are further reduced by a factor of (1 + SMPLRT_DIV)
 
     // Configure Interrupts and Bypass Enable
     // Set interrupt pin active high, push-pull, hold interrupt pin level HIGH until interrupt cleared,
     // clear on read of INT_STATUS, and enable I2C_BYPASS_EN so additional chips 
     // can join the I2C bus and all can be controlled by the Arduino as master
     if (passthru) {
-        //writeMPURegister(INT_PIN_CFG, 0x22);    
-        writeMPURegister(INT_PIN_CFG, 0x12);  // INT is 50 microsecond pulse and any read to clear  
+        //writeConfigRegister(INT_PIN_CFG, 0x22);    
+        writeConfigRegister(INT_PIN_CFG, 0x12);  // INT is 50 microsecond pulse and any read to clear  
     }
 
     else {
 
         // enable master mode
-        writeMPURegister(USER_CTRL, I2C_MST_EN);
+        writeConfigRegister(USER_CTRL, I2C_MST_EN);
     }
 
-    writeMPURegister(INT_ENABLE, 0x01);  // Enable data ready (bit 0) interrupt
+    writeConfigRegister(INT_ENABLE, 0x01);  // Enable data ready (bit 0) interrupt
     delay(100);
+
+    _initialized = true;
+}
+
+bool MPU9250::setBandwidth(GyroBandwidth_t gyro, AccelBandwidth_t accel, uint8_t sampleRateDivisor)
+{
+    if (gyro > GYRO_BYPASS_3600HZ || (gyro > GYRO_BYPASS_8800HZ && gyro != GYRO_BYPASS_3600HZ)) {
+        return false;
+    }
+
+    if (accel > ACCEL_BYPASS_1130HZ) {
+        return false;
+    }
+
+    // SMPLRT_DIV is only effective when Fchoice_b is 00 and 0 < DLPF_CFG < 7
+    if (sampleRateDivisor > 0 && (gyro < GYRO_DLPF_184HZ || gyro > GYRO_DLPF_5HZ)) {
+        return false;
+    }
+
+    _gyroBandwidth = gyro;
+    _accelBandwidth = accel;
+    _sampleRateDivisor = sampleRateDivisor;
+
+    if (_initialized) {
+        writeBandwidth();
+    }
+    else {
+        updateSampleRate();
+    }
+
+    return true;
+}
+
+void MPU9250::writeBandwidth(void)
+{
+    // SMPLRT_DIV through ACCEL_CONFIG2, written back in one transfer
+    uint8_t c[5];
+    for (uint8_t k=0; k<5; ++k) {
+        c[k] = readConfigRegister(SMPLRT_DIV+k);
+    }
+
+    c[0] = _sampleRateDivisor;
+
+    c[CONFIG-SMPLRT_DIV] &= ~0x07; // Clear DLPF_CFG bits [2:0]
+    c[CONFIG-SMPLRT_DIV] |= _gyroBandwidth & 0x07;
+
+    c[GYRO_CONFIG-SMPLRT_DIV] &= ~0x03; // Clear Fchoice_b bits [1:0]
+    c[GYRO_CONFIG-SMPLRT_DIV] |= _gyroBandwidth >> 3;
+
+    c[ACCEL_CONFIG2-SMPLRT_DIV] &= ~0x0F; // Clear accel_fchoice_b (bit 3) and A_DLPFG (bits [2:0])  
+    c[ACCEL_CONFIG2-SMPLRT_DIV] |= _accelBandwidth;
+
+    writeConfigRegisters(SMPLRT_DIV, 5, c);
+
+    updateSampleRate();
+}
+
+void MPU9250::updateSampleRate(void)
+{
+    if (_gyroBandwidth >= GYRO_BYPASS_8800HZ) {
+        _sampleRate = 32000;
+    }
+    else if (_gyroBandwidth == GYRO_DLPF_250HZ || _gyroBandwidth == GYRO_DLPF_3600HZ) {
+        _sampleRate = 8000;
+    }
+    else {
+        _sampleRate = 1000.f / (1 + _sampleRateDivisor);
+    }
+}
+
+float MPU9250::getAccelSampleRate(void)
+{
+    if (_accelBandwidth == ACCEL_BYPASS_1130HZ) {
+        return 4000;
+    }
+
+    // The accelerometer runs at 1 kHz, decimated by SMPLRT_DIV only when the gyro is at 1 kHz as well
+    return _sampleRate < 1000 ? _sampleRate : 1000;
 }
 
 void MPU9250::calibrateMagnetometer(void)
 {
     uint16_t ii = 0, sample_count = 0;
-    int32_t mag_bias[3] = {0, 0, 0}, mag_scale[3] = {0, 0, 0};
     int16_t mag_max[3] = {-32767, -32767, -32767}, mag_min[3] = {32767, 32767, 32767}, mag_temp[3] = {0, 0, 0};
 
     if(_mMode == M_8Hz) sample_count = 128;  // at 8 Hz ODR, new mag data is available every 125 ms
@@ -266,90 +358,120 @@ void MPU9250::calibrateMagnetometer(void)
         if(_mMode == M_100Hz) delay(12);  // at 100 Hz ODR, new mag data is available every 10 ms
     }
 
-    // Get hard iron correction
-    mag_bias[0]  = (mag_max[0] + mag_min[0])/2;  // get average x mag bias in counts
-    mag_bias[1]  = (mag_max[1] + mag_min[1])/2;  // get average y mag bias in counts
-    mag_bias[2]  = (mag_max[2] + mag_min[2])/2;  // get average z mag bias in counts
+    publishMagCorrection(mag_min, mag_max);
+}
 
-    _magBias[0] = (float) mag_bias[0]*_mRes*_magCalibration[0];  // save mag biases in G for main program
-    _magBias[1] = (float) mag_bias[1]*_mRes*_magCalibration[1];   
-    _magBias[2] = (float) mag_bias[2]*_mRes*_magCalibration[2];  
+void MPU9250::publishMagCorrection(const int16_t magMin[3], const int16_t magMax[3])
+{
+    int32_t mag_bias[3], mag_scale[3];
+
+    // Get hard iron correction
+    mag_bias[0]  = ((int32_t)magMax[0] + magMin[0])/2;  // get average x mag bias in counts
+    mag_bias[1]  = ((int32_t)magMax[1] + magMin[1])/2;  // get average y mag bias in counts
+    mag_bias[2]  = ((int32_t)magMax[2] + magMin[2])/2;  // get average z mag bias in counts
 
     // Get soft iron correction estimate
-    mag_scale[0]  = (mag_max[0] - mag_min[0])/2;  // get average x axis max chord length in counts
-    mag_scale[1]  = (mag_max[1] - mag_min[1])/2;  // get average y axis max chord length in counts
-    mag_scale[2]  = (mag_max[2] - mag_min[2])/2;  // get average z axis max chord length in counts
+    mag_scale[0]  = ((int32_t)magMax[0] - magMin[0])/2;  // get average x axis max chord length in counts
+    mag_scale[1]  = ((int32_t)magMax[1] - magMin[1])/2;  // get average y axis max chord length in counts
+    mag_scale[2]  = ((int32_t)magMax[2] - magMin[2])/2;  // get average z axis max chord length in counts
 
     float avg_rad = mag_scale[0] + mag_scale[1] + mag_scale[2];
     avg_rad /= 3.0;
 
+    _magSequence++;
+    magBarrier();
+
+    _magBias[0] = (float) mag_bias[0]*_mRes*_magCalibration[0];  // save mag biases in mG for main program
+    _magBias[1] = (float) mag_bias[1]*_mRes*_magCalibration[1];   
+    _magBias[2] = (float) mag_bias[2]*_mRes*_magCalibration[2];  
+
     _magScale[0] = avg_rad/((float)mag_scale[0]);
     _magScale[1] = avg_rad/((float)mag_scale[1]);
     _magScale[2] = avg_rad/((float)mag_scale[2]);
-}
 
+    magBarrier();
+    _magSequence++;
 
-// Accelerometer and gyroscope self test; check calibration wrt factory settings
-// Checks percent deviation from factory trim values, +/- 14 or less deviation is a pass
-bool MPU9250::selfTest(void)
+    _calibrationEpoch++;
+}
+
+void MPU9250::startMagCalibration(float minSpan)
 {
-    uint8_t rawData[6] = {0, 0, 0, 0, 0, 0};
-    uint8_t selfTest[6];
-    int32_t gAvg[3] = {0}, aAvg[3] = {0}, aSTAvg[3] = {0}, gSTAvg[3] = {0};
-    float factoryTrim[6];
-    uint8_t FS = 0;
+    for (uint8_t k=0; k<3; ++k) {
+        _magMin[k] = 32767;
+        _magMax[k] = -32767;
+    }
 
-    writeMPURegister(SMPLRT_DIV, 0x00);    // Set gyro sample rate to 1 kHz
-    writeMPURegister(CONFIG, 0x02);        // Set gyro sample rate to 1 kHz and DLPF to 92 Hz
-    writeMPURegister(GYRO_CONFIG, 1<<FS);  // Set full scale range for the gyro to 250 dps
-    writeMPURegister(ACCEL_CONFIG2, 0x02); // Set accelerometer rate to 1 kHz and bandwidth to 92 Hz
-    writeMPURegister(ACCEL_CONFIG, 1<<FS); // Set full scale range for the accelerometer to 2 g
+    // In counts, leaving out the few percent of the fuse ROM adjustment
+    float span = minSpan / _mRes;
+    _magMinSpan = span > 32767 ? 32767 : span < 2 ? 2 : (int16_t)span;
+
+    _magCalibrating = true;
+}
 
-    for( int ii = 0; ii < 200; ii++) {  // get average current values of gyro and acclerometer
+void MPU9250::stopMagCalibration(void)
+{
+    _magCalibrating = false;
+}
 
-        readMPURegisters(ACCEL_XOUT_H, 6, &rawData[0]);        // Read the six raw data registers into data array
-        aAvg[0] += (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ;  // Turn the MSB and LSB into a signed 16-bit value
-        aAvg[1] += (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;  
-        aAvg[2] += (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ; 
+void MPU9250::updateMagCalibration(const int16_t magCount[3])
+{
+    bool widened = false;
 
-        readMPURegisters(GYRO_XOUT_H, 6, &rawData[0]);       // Read the six raw data registers sequentially into data array
-        gAvg[0] += (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ;  // Turn the MSB and LSB into a signed 16-bit value
-        gAvg[1] += (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;  
-        gAvg[2] += (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ; 
+    for (uint8_t k=0; k<3; ++k) {
+        if (magCount[k] > _magMax[k]) {
+            _magMax[k] = magCount[k];
+            widened = true;
+        }
+        if (magCount[k] < _magMin[k]) {
+            _magMin[k] = magCount[k];
+            widened = true;
+        }
     }
 
-    for (int ii =0; ii < 3; ii++) {  // Get average of 200 values and store as average current readings
-        aAvg[ii] /= 200;
-        gAvg[ii] /= 200;
+    if (!widened) {
+        return;
     }
 
-    // Configure the accelerometer for self-test
-    writeMPURegister(ACCEL_CONFIG, 0xE0); // Enable self test on all three axes and set accelerometer range to +/- 2 g
-    writeMPURegister(GYRO_CONFIG,  0xE0); // Enable self test on all three axes and set gyro range to +/- 250 degrees/s
-    delay(25);  // Delay a while to let the device stabilize
+    for (uint8_t k=0; k<3; ++k) {
+        if ((int32_t)_magMax[k] - _magMin[k] < _magMinSpan) {
+            return;
+        }
+    }
 
-    for( int ii = 0; ii < 200; ii++) {  // get average self-test values of gyro and acclerometer
+    publishMagCorrection(_magMin, _magMax);
+}
 
-        readMPURegisters(ACCEL_XOUT_H, 6, &rawData[0]);  // Read the six raw data registers into data array
-        aSTAvg[0] += (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ;  // Turn the MSB and LSB into a signed 16-bit value
-        aSTAvg[1] += (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;  
-        aSTAvg[2] += (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ; 
+void MPU9250::getMagCorrection(float bias[3], float scale[3])
+{
+    uint32_t sequence;
 
-        readMPURegisters(GYRO_XOUT_H, 6, &rawData[0]);  // Read the six raw data registers sequentially into data array
-        gSTAvg[0] += (int16_t)(((int16_t)rawData[0] << 8) | rawData[1]) ;  // Turn the MSB and LSB into a signed 16-bit value
-        gSTAvg[1] += (int16_t)(((int16_t)rawData[2] << 8) | rawData[3]) ;  
-        gSTAvg[2] += (int16_t)(((int16_t)rawData[4] << 8) | rawData[5]) ; 
-    }
+    do {
+        sequence = _magSequence;
+        magBarrier();
 
-    for (int ii =0; ii < 3; ii++) {  // Get average of 200 values and store as average self-test readings
-        aSTAvg[ii] /= 200;
-        gSTAvg[ii] /= 200;
-    }   
+        for (uint8_t k=0; k<3; ++k) {
+            bias[k] = _magBias[k];
+            scale[k] = _magScale[k];
+        }
 
-    // Configure the gyro and accelerometer for normal operation
-    writeMPURegister(ACCEL_CONFIG, 0x00);  
-    writeMPURegister(GYRO_CONFIG,  0x00);  
-    delay(25);  // Delay a while to let the device stabilize
+        magBarrier();
+
+    } while ((sequence & 1) || sequence != _magSequence);
+}
+
+
+// Accelerometer and gyroscope self test; check calibration wrt factory settings
+// Checks percent deviation from factory trim values, +/- 14 or less deviation is a pass
+bool MPU9250::selfTest(void)
+{
+    // The self-test reconfigures the device behind the register cache's back
+    invalidateRegisterCache();
+
+    uint8_t selfTest[6];
+    float factoryTrim[6];
+    float normal[6], test[6];
+    uint8_t FS = 0;
 
     // Retrieve accelerometer and gyro factory Self-Test Code from USR_Reg
     selfTest[0] = readMPURegister(SELF_TEST_X_ACCEL); // X-axis accel self-test results
@@ -360,35 +482,37 @@ bool MPU9250::selfTest(void)
     selfTest[5] = readMPURegister(MPU6500::SELF_TEST_Z_GYRO);  // Z-axis gyro self-test results
 
     // Retrieve factory self-test value from self-test code reads
-    factoryTrim[0] = (float)(2620/1<<FS)*(pow( 1.01 , ((float)selfTest[0] - 1.0) )); // FT[Xa] factory trim calculation
-    factoryTrim[1] = (float)(2620/1<<FS)*(pow( 1.01 , ((float)selfTest[1] - 1.0) )); // FT[Ya] factory trim calculation
-    factoryTrim[2] = (float)(2620/1<<FS)*(pow( 1.01 , ((float)selfTest[2] - 1.0) )); // FT[Za] factory trim calculation
-    factoryTrim[3] = (float)(2620/1<<FS)*(pow( 1.01 , ((float)selfTest[3] - 1.0) )); // FT[Xg] factory trim calculation
-    factoryTrim[4] = (float)(2620/1<<FS)*(pow( 1.01 , ((float)selfTest[4] - 1.0) )); // FT[Yg] factory trim calculation
-    factoryTrim[5] = (float)(2620/1<<FS)*(pow( 1.01 , ((float)selfTest[5] - 1.0) )); // FT[Zg] factory trim calculation
-
-    // Report results as a ratio of (STR - FT)/FT; the change from Factory Trim of the Self-Test Response
-    // To get percent, must multiply by 100
-    float tolerances[6];
-    for (int i = 0; i < 3; i++) {
-        tolerances[i]   = 100.0f*((float)(aSTAvg[i] - aAvg[i]))/factoryTrim[i] - 100.0f;   // Report percent differences
-        tolerances[i+3] = 100.0f*((float)(gSTAvg[i] - gAvg[i]))/factoryTrim[i+3] - 100.0f; // Report percent differences
+    for (uint8_t k=0; k<6; ++k) {
+        factoryTrim[k] = (float)(2620/1<<FS)*(pow( 1.01 , ((float)selfTest[k] - 1.0) )); // FT factory trim calculation
     }
 
-    // Check results
-    for (uint8_t k=0; k<6; ++k) {
-        if (tolerances[k] >= 14.f) {
-            return false;
-        }
+    writeMPURegister(SMPLRT_DIV, 0x00);    // Set gyro sample rate to 1 kHz
+    writeMPURegister(CONFIG, 0x02);        // Set gyro sample rate to 1 kHz and DLPF to 92 Hz
+    writeMPURegister(GYRO_CONFIG, FS<<3);  // Set full scale range for the gyro to 250 dps, DLPF on
+    writeMPURegister(ACCEL_CONFIG2, 0x02); // Set accelerometer rate to 1 kHz and bandwidth to 92 Hz
+    writeMPURegister(ACCEL_CONFIG, FS<<3); // Set full scale range for the accelerometer to 2 g
+
+    // Get average current values of gyro and acclerometer
+    uint16_t samples = sampleSelfTest(factoryTrim, normal);
+
+    // Configure the accelerometer for self-test
+    writeMPURegister(ACCEL_CONFIG, 0xE0); // Enable self test on all three axes and set accelerometer range to +/- 2 g
+    writeMPURegister(GYRO_CONFIG,  0xE0); // Enable self test on all three axes and set gyro range to +/- 250 degrees/s
+    delay(25);  // Delay a while to let the device stabilize
+
+    // Get average self-test values of gyro and acclerometer
+    uint16_t testSamples = sampleSelfTest(factoryTrim, test);
+    if (testSamples < samples) {
+        samples = testSamples;
     }
 
-    // Success!
-    return true;
-}
+    // Configure the gyro and accelerometer for normal operation
+    writeMPURegister(ACCEL_CONFIG, 0x00);  
+    writeMPURegister(GYRO_CONFIG,  0x00);  
+    delay(25);  // Delay a while to let the device stabilize
 
-void MPU9250::readGyrometer(float & gx, float & gy, float & gz)
-{
-    MPUIMU::readGyrometer(gx, gy, gz);
+    // Report results as a ratio of (STR - FT)/FT; the change from Factory Trim of the Self-Test Response
+    return evaluateSelfTest(normal, test, factoryTrim, samples);
 }
 
 
@@ -409,8 +533,8 @@ void MPU9250::gyroMagSleep()
     uint8_t temp = 0;
     temp = readAK8963Register(AK8963_CNTL);
     writeAK8963Register(AK8963_CNTL, temp & ~(0x0F) ); // Clear bits 0 - 3 to power down magnetometer  
-    temp = readMPURegister(PWR_MGMT_1);
-    writeMPURegister(PWR_MGMT_1, temp | 0x10);     // Write bit 4 to enable gyro standby
+    temp = readConfigRegister(PWR_MGMT_1);
+    writeConfigRegister(PWR_MGMT_1, temp | 0x10);     // Write bit 4 to enable gyro standby
     delay(10); // Wait for all registers to reset 
 }
 
@@ -419,19 +543,127 @@ void MPU9250::gyroMagWake(Mmode_t mmode)
     uint8_t temp = 0;
     temp = readAK8963Register(AK8963_CNTL);
     writeAK8963Register(AK8963_CNTL, temp | mmode ); // Reset normal mode for  magnetometer  
-    temp = readMPURegister(PWR_MGMT_1);
-    writeMPURegister(PWR_MGMT_1, 0x01);   // return gyro and accel normal mode
+    temp = readConfigRegister(PWR_MGMT_1);
+    writeConfigRegister(PWR_MGMT_1, 0x01);   // return gyro and accel normal mode
     delay(10); // Wait for all registers to reset 
 }
 
+void MPU9250::enterMotionCycle(uint16_t thresholdMg, LowPowerAccelRate_t rate)
+{
+    writeAK8963Register(AK8963_CNTL, 0x00); // Power down magnetometer
+
+    writeConfigRegister(PWR_MGMT_1, INV_CLK_PLL); // Accelerometer running, not cycling
+    writeConfigRegister(PWR_MGMT_2, 0x07);        // Disable the gyro axes
+
+    uint8_t c = readConfigRegister(ACCEL_CONFIG2);
+    writeConfigRegister(ACCEL_CONFIG2, (c & ~0x0F) | ACCEL_DLPF_184HZ); // Bandwidth the motion logic expects
+
+    c = readConfigRegister(INT_ENABLE);
+    writeConfigRegister(INT_ENABLE, c | 0x40);    // Wake on motion
+
+    writeConfigRegister(MOT_DETECT_CTRL, 0xC0);   // Compare each sample with the previous one
+
+    uint16_t threshold = thresholdMg / 4;
+    writeConfigRegister(MOT_THR, threshold < 1 ? 1 : threshold > 255 ? 255 : threshold);
+
+    writeConfigRegister(LP_ACCEL_ODR, rate);
+    writeConfigRegister(PWR_MGMT_1, INV_CLK_PLL | 0x20); // Start cycling
+}
+
+void MPU9250::exitMotionCycle(void)
+{
+    writeConfigRegister(PWR_MGMT_1, INV_CLK_PLL); // Stop cycling
+    writeConfigRegister(PWR_MGMT_2, 0x00);        // Enable the gyro axes
+
+    uint8_t c = readConfigRegister(ACCEL_CONFIG2);
+    writeConfigRegister(ACCEL_CONFIG2, (c & ~0x0F) | _accelBandwidth);
+
+    writeAK8963Register(AK8963_CNTL, _mScale << 4 | _mMode);
+}
+
 void MPU9250::readMagnetometer(float & mx, float & my, float & mz)
 {
-    int16_t magCount[3];
-    readMagData(magCount);
+    readMagData(_magCount);
+
+    scaleMagData(_magCount, mx, my, mz);
+}
+
+uint16_t MPU9250::magDecimation(void)
+{
+    if (_magScheduleRate != _sampleRate || _magScheduleMode != _mMode) {
+
+        _magScheduleRate = _sampleRate;
+        _magScheduleMode = _mMode;
+
+        float samples = MAG_LEAD * _sampleRate / (_mMode == M_8Hz ? 8 : 100);
 
+        _magDecimation = samples < 1 ? 1 : samples > 65535 ? 65535 : (uint16_t)samples;
+    }
+
+    return _magDecimation;
+}
+
+uint16_t MPU9250::magLead(void)
+{
+    uint16_t decimation = magDecimation();
+
+    if (_magLead > decimation) {
+        _magLead = decimation;
+    }
+
+    return _magLead;
+}
+
+bool MPU9250::magDue(void)
+{
+    return _magAge == MAG_AGE_NONE || _magAge + 1 >= magLead();
+}
+
+void MPU9250::holdMag(bool fresh, Sample_t & sample)
+{
+    if (magDue()) {
+        _magDueReads++;
+    }
+
+    if (fresh) {
+
+        // A reading already waiting at the first due read means the host reads slower than the IMU
+        // and the window opened late; more than one read with nothing new means it opened early
+        if (_magAge != MAG_AGE_NONE) {
+            if (_magDueReads <= 1 && _magLead > 1) {
+                _magLead--;
+            }
+            else if (_magDueReads > 2) {
+                _magLead++;
+            }
+        }
+
+        _magDueReads = 0;
+        _magAge = 0;
+    }
+    else if (_magAge < MAG_AGE_NONE - 1) {
+        _magAge++;
+    }
+
+    if (_magAge == MAG_AGE_NONE) {
+        sample.mag[0] = sample.mag[1] = sample.mag[2] = 0;
+    }
+    else {
+        scaleMagData(_magCount, sample.mag[0], sample.mag[1], sample.mag[2]);
+    }
+
+    sample.magAge = _magAge;
+}
+
+void MPU9250::scaleMagData(const int16_t magCount[3], float & mx, float & my, float & mz)
+{
     // Calculate the magnetometer values in milliGauss
     // Include factory calibration per data sheet and user environmental corrections
     // Get actual magnetometer value, this depends on scale being set
+    if (_magCalibrating) {
+        updateMagCalibration(magCount);
+    }
+
     mx = (float)magCount[0]*_mRes*_magCalibration[0] - _magBias[0];  
     my = (float)magCount[1]*_mRes*_magCalibration[1] - _magBias[1];  
     mz = (float)magCount[2]*_mRes*_magCalibration[2] - _magBias[2];  
@@ -440,16 +672,34 @@ void MPU9250::readMagnetometer(float & mx, float & my, float & mz)
     mz *= _magScale[2]; 
 }
 
+void MPU9250::getMagScaling(MagScaling_t & scaling)
+{
+    float bias[3], scale[3];
+    getMagCorrection(bias, scale);
+
+    for (uint8_t k=0; k<3; ++k) {
+        scaling.scale[k] = _mRes * _magCalibration[k] * scale[k];
+        scaling.bias[k]  = bias[k] * scale[k];
+    }
+}
+
 void MPU9250::readMagData(int16_t * destination)
 {
     uint8_t rawData[7];  // x/y/z gyro register data, ST2 register stored here, must read ST2 at end of data acquisition
     readAK8963Registers(AK8963_XOUT_L, 7, &rawData[0]);  // Read the six raw data and ST2 registers sequentially into data array
+    parseMagData(rawData, destination);
+}
+
+bool MPU9250::parseMagData(const uint8_t rawData[7], int16_t * destination)
+{
     uint8_t c = rawData[6]; // End data read by reading ST2 register
     if(!(c & 0x08)) { // Check if magnetic sensor overflow set, if not then report data
         destination[0] = ((int16_t)rawData[1] << 8) | rawData[0] ;  // Turn the MSB and LSB into a signed 16-bit value
         destination[1] = ((int16_t)rawData[3] << 8) | rawData[2] ;  // Data stored as little Endian
         destination[2] = ((int16_t)rawData[5] << 8) | rawData[4] ; 
+        return true;
     }
+    return false;
 }
 
 void MPU9250::initAK8963(Mscale_t mscale, Mmode_t Mmode, float * magCalibration)
@@ -461,12 +711,20 @@ void MPU9250::initAK8963(Mscale_t mscale, Mmode_t Mmode, float * magCalibration)
     writeAK8963Register(AK8963_CNTL, 0x0F); // Enter Fuse ROM access mode
     delay(10);
     readAK8963Registers(AK8963_ASAX, 3, &rawData[0]);  // Read the x-, y-, and z-axis calibration values
+    for (uint8_t k=0; k<3; ++k) {
+        _magAdjustment[k] = rawData[k];
+    }
     magCalibration[0] =  (float)(rawData[0] - 128)/256.0f + 1.0f;   // Return x-axis sensitivity adjustment values, etc.
     magCalibration[1] =  (float)(rawData[1] - 128)/256.0f + 1.0f;  
     magCalibration[2] =  (float)(rawData[2] - 128)/256.0f + 1.0f; 
     _magCalibration[0] = magCalibration[0];
     _magCalibration[1] = magCalibration[1];
     _magCalibration[2] = magCalibration[2];
+    startAK8963(mscale, Mmode);
+}
+
+void MPU9250::startAK8963(Mscale_t mscale, Mmode_t Mmode)
+{
     _mMode = Mmode;
     writeAK8963Register(AK8963_CNTL, 0x00); // Power down magnetometer  
     delay(10);
@@ -476,3 +734,26 @@ void MPU9250::initAK8963(Mscale_t mscale, Mmode_t Mmode, float * magCalibration)
     writeAK8963Register(AK8963_CNTL, mscale << 4 | Mmode); // Set magnetometer data resolution and sample ODR
     delay(10);
 }
+
+void MPU9250::exportCalibration(Calibration_t & calibration)
+{
+    MPUIMU::exportCalibration(calibration);
+
+    getMagCorrection(calibration.magBias, calibration.magScale);
+
+    for (uint8_t k=0; k<3; ++k) {
+        calibration.magAdjustment[k] = _magAdjustment[k];
+    }
+}
+
+void MPU9250::importCalibration(const Calibration_t & calibration)
+{
+    MPUIMU::importCalibration(calibration);
+
+    for (uint8_t k=0; k<3; ++k) {
+        _magBias[k] = calibration.magBias[k];
+        _magScale[k] = calibration.magScale[k];
+        _magAdjustment[k] = calibration.magAdjustment[k];
+        _magCalibration[k] = (float)(_magAdjustment[k] - 128)/256.0f + 1.0f;
+    }
+}
@@ -47,22 +47,123 @@ class MPU9250 : public MPUIMU {
 
         } Mmode_t;
 
+        // Gyro and thermometer bandwidth, with the resulting gyro output rate; each value holds
+        // Fchoice_b (GYRO_CONFIG bits [1:0]) in bits [4:3] and DLPF_CFG (CONFIG bits [2:0]) in bits [2:0]
+        typedef enum {
+
+            GYRO_DLPF_250HZ    = 0x00, // 8 kHz
+            GYRO_DLPF_184HZ    = 0x01, // 1 kHz
+            GYRO_DLPF_92HZ     = 0x02, // 1 kHz
+            GYRO_DLPF_41HZ     = 0x03, // 1 kHz
+            GYRO_DLPF_20HZ     = 0x04, // 1 kHz
+            GYRO_DLPF_10HZ     = 0x05, // 1 kHz
+            GYRO_DLPF_5HZ      = 0x06, // 1 kHz
+            GYRO_DLPF_3600HZ   = 0x07, // 8 kHz
+            GYRO_BYPASS_8800HZ = 0x08, // 32 kHz
+            GYRO_BYPASS_3600HZ = 0x10  // 32 kHz
+
+        } GyroBandwidth_t;
+
+        // Accelerometer bandwidth, with the resulting accelerometer output rate; each value is
+        // accel_fchoice_b (bit 3) and A_DLPFCFG (bits [2:0]) of ACCEL_CONFIG2
+        typedef enum {
+
+            ACCEL_DLPF_460HZ    = 0x00, // 1 kHz
+            ACCEL_DLPF_184HZ    = 0x01, // 1 kHz
+            ACCEL_DLPF_92HZ     = 0x02, // 1 kHz
+            ACCEL_DLPF_41HZ     = 0x03, // 1 kHz
+            ACCEL_DLPF_20HZ     = 0x04, // 1 kHz
+            ACCEL_DLPF_10HZ     = 0x05, // 1 kHz
+            ACCEL_DLPF_5HZ      = 0x06, // 1 kHz
+            ACCEL_BYPASS_1130HZ = 0x08  // 4 kHz
+
+        } AccelBandwidth_t;
+
+        // Accelerometer rates in the low-power cycle (LP_ACCEL_ODR)
+        typedef enum {
+
+            LP_ACCEL_0_24HZ,
+            LP_ACCEL_0_49HZ,
+            LP_ACCEL_0_98HZ,
+            LP_ACCEL_1_95HZ,
+            LP_ACCEL_3_91HZ,
+            LP_ACCEL_7_81HZ,
+            LP_ACCEL_15_63HZ,
+            LP_ACCEL_31_25HZ,
+            LP_ACCEL_62_50HZ,
+            LP_ACCEL_125HZ,
+            LP_ACCEL_250HZ,
+            LP_ACCEL_500HZ
+
+        } LowPowerAccelRate_t;
+
+        // Can be called before or after begin().  SMPLRT_DIV only takes effect when the gyro runs at 1 kHz,
+        // so a nonzero divisor with any other gyro setting is rejected and nothing is changed.
+        bool  setBandwidth(GyroBandwidth_t gyro, AccelBandwidth_t accel, uint8_t sampleRateDivisor=0);
+
+        float getAccelSampleRate(void);
+
         void  accelWakeOnMotion(void);
 
         bool  checkWakeOnMotion(void);
 
         void  calibrateMagnetometer(void);
 
+        // Incremental alternative to calibrateMagnetometer(), for use while streaming: between start and
+        // stop, each magnetometer reading (readMagnetometer(), readAll(), startRead()) updates the per-axis
+        // extremes in constant time, and one that widens them republishes the hard-iron bias and soft-iron
+        // scale.  Nothing is published until every axis has spanned minSpan milligauss, so that early
+        // estimates cannot distort the output.  Start and stop from the thread doing the reads.
+        void  startMagCalibration(float minSpan=400);
+
+        // Keeps whatever was last published
+        void  stopMagCalibration(void);
+
+        bool  isMagCalibrating(void) { return _magCalibrating; }
+
+        // Bias in milligauss and unitless scale, as a consistent set even while another thread publishes
+        void  getMagCorrection(float bias[3], float scale[3]);
+
         void  gyroMagSleep();
 
         void  gyroMagWake(Mmode_t mmode);
 
-        void  readGyrometer(float & ax, float & ay, float & az);
+        // Non-blocking counterparts of accelWakeOnMotion() and gyroMagWake(), as MPUPowerManager uses them.
+        // enterMotionCycle() leaves only the accelerometer running, duty-cycled at rate, and sets WOM_INT
+        // in INT_STATUS whenever an axis changes by more than thresholdMg (in steps of 4 mg) from one sample
+        // to the next.  exitMotionCycle() is the minimal way back: sensors on, the configured bandwidth,
+        // the magnetometer restarted, and wake-on-motion still armed.  The gyro then needs
+        // GYRO_STARTUP_USEC to settle.
+        static const uint32_t GYRO_STARTUP_USEC = 35000;
+
+        void  enterMotionCycle(uint16_t thresholdMg, LowPowerAccelRate_t rate);
+
+        void  exitMotionCycle(void);
 
+        using MPUIMU::readGyrometer;
+
+        // Reads the AK8963 at every call (in master mode, through slave 0 unless enableMagAutoRead());
+        // streaming code should use readAll(), which reads it only when a new reading is due
         void  readMagnetometer(float & mx, float & my, float & mz);
 
         float readTemperature(void);
 
+        // Magnetometer conversion as a single multiply-subtract: mag = raw * scale - bias;
+        // folds in resolution, factory sensitivity adjustment, and the soft- and hard-iron corrections
+        typedef struct {
+
+            float scale[3];
+            float bias[3];
+
+        } MagScaling_t;
+
+        void getMagScaling(MagScaling_t & scaling);
+
+        // Batch conversion of little-endian AK8963 XOUT_L..ST2 records spaced stride bytes apart;
+        // overflowed records repeat the previous value
+        static void convertMagFrames(const uint8_t * frames, uint16_t count, uint8_t stride, 
+                const MagScaling_t & scaling, float * mag[3]);
+
     protected:
 
         MPU9250(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale, Mmode_t mmode, uint8_t sampleRateDivisor, bool passthru);
@@ -79,8 +180,14 @@ class MPU9250 : public MPUIMU {
 
         virtual void pushGyroBiases(uint8_t data[12]) override;
 
+        virtual bool hasGyroOffsets(void) override { return true; }
+
         virtual void readAccelOffsets(uint8_t data[12], int32_t accel_bias_reg[3]) override;
 
+        virtual void exportCalibration(Calibration_t & calibration) override;
+
+        virtual void importCalibration(const Calibration_t & calibration) override;
+
         virtual void writeAK8963Register(uint8_t subAddress, uint8_t data) = 0;
 
         virtual void readAK8963Registers(uint8_t subAddress, uint8_t count, uint8_t * dest) = 0;
@@ -109,9 +216,36 @@ class MPU9250 : public MPUIMU {
 
         uint8_t readAK8963Register(uint8_t subAddress);
 
+        void    readMagData(int16_t * destination);
+
+        static bool parseMagData(const uint8_t rawData[7], int16_t * destination);
+
+        void    scaleMagData(const int16_t magCount[3], float & mx, float & my, float & mz);
+
+        // Sample-and-hold of the magnetometer in readAll() and startRead(): the AK8963 is read only from
+        // MAG_LEAD of its period after the last new reading until the next one turns up, and each
+        // sample carries the held value with its age
+        static constexpr float MAG_LEAD = 0.9f;
+
+        bool    magDue(void);
+        void    holdMag(bool fresh, Sample_t & sample);
+
+        // IMU samples from one new magnetometer reading to when the next is due
+        uint16_t magDecimation(void);
+
+        // Reads from one new magnetometer reading to when the next is due: magDecimation() for a host
+        // reading every sample, and less for one reading slower, as holdMag() learns from when new
+        // readings turn up
+        uint16_t magLead(void);
+
+        // Samples since _magCount last changed through holdMag()
+        uint16_t _magAge = MAG_AGE_NONE;
+
+        // Most recent non-overflowed magnetometer counts
+        int16_t _magCount[3] = {0,0,0};
+
         Mscale_t _mScale;
         Mmode_t  _mMode;
-        uint8_t  _sampleRateDivisor;
 
         bool    _passthru;
         float   _mRes;
@@ -119,6 +253,7 @@ class MPU9250 : public MPUIMU {
         float   _fuseROMy;
         float   _fuseROMz;
         float   _magCalibration[3];
+        uint8_t _magAdjustment[3] = {128,128,128};
 
         //virtual void writeMPURegsiter(uint8_t subAddress, uint8_t data) = 0;
         virtual void writeRegister(uint8_t address, uint8_t subAddress, uint8_t data) = 0;
@@ -131,12 +266,40 @@ class MPU9250 : public MPUIMU {
         uint8_t getAK8963CID(void);
         float   getMres(Mscale_t mscale);
         void    reset(void);
-        void    readMagData(int16_t * destination);
         void    initAK8963(Mscale_t mscale, Mmode_t Mmode, float * magCalibration);
+        void    startAK8963(Mscale_t mscale, Mmode_t Mmode);
+        void    writeBandwidth(void);
+        void    updateSampleRate(void);
+
+        GyroBandwidth_t  _gyroBandwidth;
+        AccelBandwidth_t _accelBandwidth;
+
+        // Set once initMPU6500() has run, after which setBandwidth() goes straight to the device
+        bool _initialized = false;
 
 
         // These can be overridden by calibrateMagnetometer()
         float _magBias[3] = {0,0,0};
         float _magScale[3] = {1,1,1};
 
+        // Odd while _magBias and _magScale are being replaced
+        volatile uint32_t _magSequence = 0;
+
+        // Extremes for startMagCalibration(), in counts
+        bool    _magCalibrating = false;
+        int16_t _magMin[3];
+        int16_t _magMax[3];
+        int16_t _magMinSpan;
+
+        // IMU samples per magnetometer period at MAG_LEAD, for the sample rate and mode it was computed for
+        uint16_t _magDecimation = 1;
+
+        uint16_t _magLead = 0xFFFF;
+        uint16_t _magDueReads = 0;
+        float    _magScheduleRate = 0;
+        Mmode_t  _magScheduleMode;
+
+        void    updateMagCalibration(const int16_t magCount[3]);
+        void    publishMagCorrection(const int16_t magMin[3], const int16_t magMax[3]);
+
 }; // class MPU9250
@@ -22,9 +22,20 @@
 
 #include "MPU9250_Master.h"
 
+#include <string.h>
+
 MPU9250_Master::MPU9250_Master(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale, Mmode_t mmode, uint8_t sampleRateDivisor) :
     MPU9250(ascale, gscale, mscale, mmode, sampleRateDivisor, false)
 {
+    _magSlaveReady = false;
+    _magAutoRead = false;
+
+    _burstMag = false;
+    memset(_magRaw, 0, sizeof(_magRaw));
+    memset(_magTaken, 0, sizeof(_magTaken));
+
+    _magContinuous = false;
+    _magNack = false;
 }
 
 void MPU9250_Master::initMPU6500(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor) 
@@ -36,22 +47,159 @@ void MPU9250_Master::writeAK8963Register(uint8_t subAddress, uint8_t data)
 {
     uint8_t count = 1;
 
-    writeMPURegister(I2C_SLV0_ADDR, AK8963_ADDRESS); // set slave 0 to the AK8963 and set for write
-    writeMPURegister(I2C_SLV0_REG, subAddress); // set the register to the desired AK8963 sub address
-    writeMPURegister(I2C_SLV0_DO, data); // store the data for write
-    writeMPURegister(I2C_SLV0_CTRL, I2C_SLV0_EN | count); // enable I2C and send 1 byte
+    writeConfigRegister(I2C_SLV0_ADDR, AK8963_ADDRESS); // set slave 0 to the AK8963 and set for write
+    writeConfigRegister(I2C_SLV0_REG, subAddress); // set the register to the desired AK8963 sub address
+    writeConfigRegister(I2C_SLV0_DO, data); // store the data for write
+    writeConfigRegister(I2C_SLV0_CTRL, I2C_SLV0_EN | count); // enable I2C and send 1 byte
+
+    _magSlaveReady = false;
+
+    // Power-down (gyroMagSleep(), enterMotionCycle()), single and fuse ROM modes make no new readings
+    if (subAddress == AK8963_CNTL) {
+        _magContinuous = (data & 0x0F) == _mMode;
+    }
 }
 
 void MPU9250_Master::readAK8963Registers(uint8_t subAddress, uint8_t count, uint8_t* dest)
 {
-    writeMPURegister(I2C_SLV0_ADDR, AK8963_ADDRESS | I2C_READ_FLAG); // set slave 0 to the AK8963 and set for read
-    writeMPURegister(I2C_SLV0_REG, subAddress); // set the register to the desired AK8963 sub address
-    writeMPURegister(I2C_SLV0_CTRL, I2C_SLV0_EN | count); // enable I2C and request the bytes
+    // Data reads take in ST1 as well, which is how the burst tells new data from old
+    bool data = (subAddress == AK8963_XOUT_L && count == 7);
+
+    if (data) {
+
+        // Slave 0 already refreshes the magnetometer data
+        if (_magAutoRead && _magSlaveReady) {
+            readMPURegisters(EXT_SENS_DATA_00 + 1, count, dest);
+            return;
+        }
+
+        subAddress = AK8963_ST1;
+        count = 8;
+    }
+
+    writeConfigRegister(I2C_SLV0_ADDR, AK8963_ADDRESS | I2C_READ_FLAG); // set slave 0 to the AK8963 and set for read
+    writeConfigRegister(I2C_SLV0_REG, subAddress); // set the register to the desired AK8963 sub address
+    writeConfigRegister(I2C_SLV0_CTRL, I2C_SLV0_EN | count); // enable I2C and request the bytes
     delay(1); // takes some time for these registers to fill
-    readMPURegisters(EXT_SENS_DATA_00, count, dest); // read the bytes off the MPU9250 EXT_SENS_DATA registers
+
+    if (data) {
+        uint8_t rawData[8];
+        readMPURegisters(EXT_SENS_DATA_00, count, rawData);
+        memcpy(dest, &rawData[1], 7);
+    }
+    else {
+        readMPURegisters(EXT_SENS_DATA_00, count, dest); // read the bytes off the MPU9250 EXT_SENS_DATA registers
+    }
+
+    // Slave 0 stays enabled, so it now repeats this read at every sample
+    _magSlaveReady = data;
+}
+
+void MPU9250_Master::enableMagAutoRead(void)
+{
+    _magAutoRead = true;
+
+    // Program slave 0 once; any later AK8963 configuration access re-arms it on the next read
+    if (!_magSlaveReady) {
+        readMagData(_magCount);
+    }
+}
+
+void MPU9250_Master::disableMagAutoRead(void)
+{
+    _magAutoRead = false;
+
+    // Stop slave 0 polling the AK8963; the next access that needs it programs it again
+    writeConfigRegister(I2C_SLV0_CTRL, readConfigRegister(I2C_SLV0_CTRL) & ~I2C_SLV0_EN);
+
+    _magSlaveReady = false;
+}
+
+void MPU9250_Master::readAll(Sample_t & sample)
+{
+    uint8_t rawData[BURST_SIZE];  // accel, temperature, gyro, and EXT_SENS_DATA_00..07 register data stored here
+
+    readMPURegisters(ACCEL_XOUT_H, prepareBurst(), &rawData[0]);  // ACCEL_XOUT_H through EXT_SENS_DATA_07 are contiguous
+
+    decodeBurst(rawData, sample);
+}
+
+uint8_t MPU9250_Master::prepareBurst(void)
+{
+    // Point slave 0 at the magnetometer data if some other AK8963 access moved it
+    if (!_magSlaveReady) {
+        readMagData(_magCount);
+    }
+
+    _burstMag = magDue();
+
+    // An overdue reading may only be taken as new if slave 0 has been getting answers
+    _magNack = false;
+    if (_burstMag && magOverdue()) {
+        _magNack = (readMPURegister(I2C_MST_STATUS) & I2C_SLV0_NACK) != 0;
+    }
+
+    return _burstMag ? BURST_SIZE : MPUIMU::BURST_SIZE;
+}
+
+bool MPU9250_Master::magOverdue(void)
+{
+    return _magContinuous && _magAge != MAG_AGE_NONE && _magAge >= 2 * (uint32_t)magDecimation();
+}
+
+void MPU9250_Master::decodeBurst(const uint8_t * rawData, Sample_t & sample)
+{
+    decodeAll(rawData, sample);
+
+    // ST1, the data, and ST2 as slave 0 copied them at this sample.  DRDY is on in the copy only at
+    // the sample after a new reading (slave 0's read of ST2 clears it), so a host reading slower
+    // than the IMU, or out of step with it, sees it only now and then.  Once the magnetometer is
+    // due, data that differs from the last reading taken is new as well; and by twice the due
+    // age a new reading has surely been made, so unchanged data is a reading of an unchanged field.
+    // That last holds only while the AK8963 runs continuously and slave 0 gets its answers; a
+    // powered-down or absent magnetometer just grows magAge.
+    bool fresh = false;
+
+    if (_burstMag) {
+
+        const uint8_t * mag = &rawData[14];
+
+        bool ready = (mag[0] & 0x01) && (!(_magRaw[0] & 0x01) || memcmp(mag, _magRaw, 8) != 0);
+        bool changed = memcmp(&mag[1], _magTaken, 6) != 0;
+        bool overdue = magOverdue() && !_magNack;
+
+        fresh = (ready || changed || overdue) && parseMagData(&mag[1], _magCount);
+
+        if (fresh) {
+            memcpy(_magTaken, &mag[1], 6);
+        }
+
+        memcpy(_magRaw, mag, 8);
+    }
+
+    holdMag(fresh, sample);
+
+    sample.timestamp = 0;
+
+    countSamples(1);
+}
+
+void MPU9250_Master::startSampleRead(void)
+{
+    static_assert(BURST_SIZE <= ASYNC_BUFFER_SIZE, "ASYNC_BUFFER_SIZE too small");
+
+    // Blocks only when slave 0 has to be re-armed, or its NACK checked for an overdue reading
+    startMPURead(ACCEL_XOUT_H, prepareBurst(), _asyncBuffer);
+}
+
+void MPU9250_Master::decodeSampleRead(Sample_t & sample)
+{
+    decodeBurst(_asyncBuffer, sample);
 }
 
 bool MPU9250_Master::checkNewData(void)
 {
-    return (readMPURegister(INT_STATUS) & 0x01);
+    uint8_t status = readMPURegister(INT_STATUS);
+    noteIntStatus(status);
+    return (status & 0x01);
 }
@@ -30,8 +30,28 @@ class MPU9250_Master : public MPU9250 {
 
         bool checkNewData(void);
 
+        using MPUIMU::checkNewData;
+
+        // Reads accelerometer, thermometer, and gyrometer in a single burst, which runs on through
+        // the magnetometer data only while a new magnetometer reading is due (see MPU9250::magDue())
+        virtual void readAll(Sample_t & sample) override;
+
+        // Leave slave 0 copying the AK8963 data, so that readMagnetometer() becomes a plain
+        // EXT_SENS_DATA burst with no register writes or delay.  Disabling stops slave 0 until
+        // the next readAll() or magnetometer read, which need it and set it up again.
+        void enableMagAutoRead(void);
+        void disableMagAutoRead(void);
+
     protected:
 
+        // Burst runs on through EXT_SENS_DATA_07 to pick up the magnetometer: ST1, the data, and ST2
+        static const uint8_t BURST_SIZE = 22;
+        uint8_t prepareBurst(void);
+        void decodeBurst(const uint8_t * rawData, Sample_t & sample);
+
+        virtual void startSampleRead(void) override;
+        virtual void decodeSampleRead(Sample_t & sample) override;
+
         virtual void writeAK8963Register(uint8_t subAddress, uint8_t data) override;
 
         virtual void readAK8963Registers(uint8_t subAddress, uint8_t count, uint8_t* dest) override;
@@ -39,5 +59,25 @@ class MPU9250_Master : public MPU9250 {
 
     private:
 
+        // True when slave 0 is set up to copy AK8963_ST1..AK8963_ST2 into EXT_SENS_DATA_00..07
+        bool _magSlaveReady;
+
+        bool _magAutoRead;
+
+        // Whether the burst under way includes the magnetometer, and the data it last brought
+        bool    _burstMag;
+        uint8_t _magRaw[8];
+
+        // Data bytes of the last reading decodeBurst() took as new
+        uint8_t _magTaken[6];
+
+        // Whether the last CNTL write left the AK8963 measuring continuously in _mMode, and whether
+        // slave 0 was refused since the last check; an overdue reading is taken as new only when
+        // the first holds and the second does not
+        bool    _magContinuous;
+        bool    _magNack;
+
+        bool    magOverdue(void);
+
         void initMPU6500(Ascale_t ascale, Gscale_t gscale, uint8_t sampleRateDivisor);
 };
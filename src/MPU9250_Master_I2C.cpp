@@ -20,6 +20,8 @@
 
 #include "MPU9250_Master_I2C.h"
 
+#include "MPUI2C.h"
+
 #include <CrossPlatformI2C.h>
 
 // One ifdef needed to support delay() cross-platform
@@ -34,32 +36,47 @@ extern void delay(uint32_t msec);
 MPU9250_Master_I2C::MPU9250_Master_I2C(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale, Mmode_t mmode, uint8_t sampleRateDivisor) :
     MPU9250_Master(ascale, gscale, mscale, mmode, sampleRateDivisor)
 {
+#if defined(ARDUINO)
+    _maxBurst = 32; // Wire library buffer size
+#endif
 }
 
-MPUIMU::Error_t MPU9250_Master_I2C::begin(uint8_t bus)
+MPUIMU::Error_t MPU9250_Master_I2C::begin(uint8_t bus, uint32_t clock)
 {
-    _i2c = cpi2c_open(MPU_ADDRESS, bus);
+    if (!_probedId) {
+        _i2cClock = clock;
+        _i2c = mpui2c_open(MPU_ADDRESS, bus, _i2cClock);
+    }
 
     return runTests();
 }
 
 void MPU9250_Master_I2C::readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * data)
 {
-    cpi2c_readRegisters(address, subAddress, count, data);
+    uint32_t start = statsClock();
+    bool ok = cpi2c_readRegisters(address, subAddress, count, data);
+    countRead(count, ok, start);
 }
 
 
 void MPU9250_Master_I2C::writeRegister(uint8_t address, uint8_t subAddress, uint8_t data)
 {
-    cpi2c_writeRegister(address, subAddress, data);
+    countWrite(cpi2c_writeRegister(address, subAddress, data));
 }
 
 void MPU9250_Master_I2C::writeMPURegister(uint8_t subAddress, uint8_t data)
 {
-    cpi2c_writeRegister(_i2c, subAddress, data);
+    countWrite(cpi2c_writeRegister(_i2c, subAddress, data));
+}
+
+void MPU9250_Master_I2C::writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    countWrite(mpui2c_writeRegisters(_i2c, subAddress, count, data));
 }
 
 void MPU9250_Master_I2C::readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
 {
-    cpi2c_readRegisters(_i2c, subAddress, count, dest);
+    uint32_t start = statsClock();
+    bool ok = mpui2c_readRegisters(_i2c, subAddress, count, dest);
+    countRead(count, ok, start);
 }
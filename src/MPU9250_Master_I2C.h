@@ -28,19 +28,20 @@ class MPU9250_Master_I2C : public MPU9250_Master {
 
         MPU9250_Master_I2C(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale, Mmode_t mmode, uint8_t sampleRateDivisor=0);
 
-        Error_t begin(uint8_t bus=1);
+        // Fast-mode I^2C unless asked otherwise
+        Error_t begin(uint8_t bus=1, uint32_t clock=400000);
+
+        // Bus clock in Hz, zero when the platform does not say
+        uint32_t getBusClock(void) { return _i2cClock; }
 
         virtual void writeMPURegister(uint8_t subAddress, uint8_t data) override;
 
+        virtual void writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data) override;
+
         virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) override;
 
         virtual void readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * data) override;
 
         virtual void writeRegister(uint8_t address, uint8_t subAddress, uint8_t data) override;
 
-
-    private:
-
-        // Cross-platform support
-        uint8_t  _i2c;
 };
@@ -20,7 +20,7 @@
 
 #include "MPU9250_Master_SPI.h"
 
-#include <CrossPlatformSPI.h>
+#include "MPUSPI.h"
 
 // One ifdef needed to support delay() cross-platform
 #if defined(ARDUINO)
@@ -36,30 +36,47 @@ MPU9250_Master_SPI::MPU9250_Master_SPI(Ascale_t ascale, Gscale_t gscale, Mscale_
 {
 }
 
-MPUIMU::Error_t MPU9250_Master_SPI::begin(void)
+MPUIMU::Error_t MPU9250_Master_SPI::begin(uint32_t sensorClock)
 {
-    return runTests();
+    mpuspi_setSensorClock(0);
+
+    Error_t error = runTests();
+
+    mpuspi_setSensorClock(sensorClock);
+
+    return error;
 }
 
 void MPU9250_Master_SPI::readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * data)
 {
     (void)address;
-    cpspi_readRegisters(subAddress, count, data);
+    uint32_t start = statsClock();
+    bool ok = mpuspi_readRegisters(subAddress, count, data);
+    countRead(count, ok, start);
 }
 
 
 void MPU9250_Master_SPI::writeRegister(uint8_t address, uint8_t subAddress, uint8_t data)
 {
     (void)address;
-    cpspi_writeRegister(subAddress, data);
+    mpuspi_writeRegister(subAddress, data);
+    countWrite(true);
 }
 
 void MPU9250_Master_SPI::writeMPURegister(uint8_t subAddress, uint8_t data)
 {
-    cpspi_writeRegister(subAddress, data);
+    mpuspi_writeRegister(subAddress, data);
+    countWrite(true);
+}
+
+void MPU9250_Master_SPI::writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    countWrite(mpuspi_writeRegisters(subAddress, count, data));
 }
 
 void MPU9250_Master_SPI::readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
 {
-    cpspi_readRegisters(subAddress, count, dest);
+    uint32_t start = statsClock();
+    bool ok = mpuspi_readRegisters(subAddress, count, dest);
+    countRead(count, ok, start);
 }
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "MPU9250_Master.h"
+#include "MPUSPI.h"
 
 class MPU9250_Master_SPI : public MPU9250_Master {
 
@@ -28,10 +29,13 @@ class MPU9250_Master_SPI : public MPU9250_Master {
 
         MPU9250_Master_SPI(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale, Mmode_t mmode, uint8_t sampleRateDivisor=0);
 
-        Error_t begin(void);
+        // Configures the device at MPUSPI_REGISTER_CLOCK, then reads its sensor registers at sensorClock
+        Error_t begin(uint32_t sensorClock=MPUSPI_SENSOR_CLOCK);
 
         virtual void writeMPURegister(uint8_t subAddress, uint8_t data) override;
 
+        virtual void writeMPURegisters(uint8_t subAddress, uint8_t count, const uint8_t * data) override;
+
         virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) override;
 
         virtual void readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * data) override;
@@ -0,0 +1,66 @@
+/*
+   MPU9250_Mock.cpp: master-mode MPU9250 backed by an MPUSimulator instead of a bus
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPU9250_Mock.h"
+
+MPU9250_Mock::MPU9250_Mock(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale, Mmode_t mmode, uint8_t sampleRateDivisor) :
+    MPU9250_Master(ascale, gscale, mscale, mmode, sampleRateDivisor), _sim(0x71)
+{
+}
+
+MPUIMU::Error_t MPU9250_Mock::begin(void)
+{
+    // Let each startup transfer stand in for the delay() calls around it, so that self-test and
+    // calibration see samples without the clock being advanced by hand
+    uint32_t transferTime = _sim.getTransferTime();
+    _sim.setTransferTime(MPUSimulator::STARTUP_TRANSFER_TIME);
+
+    Error_t error = runTests();
+
+    _sim.setTransferTime(transferTime);
+
+    return error;
+}
+
+void MPU9250_Mock::writeMPURegister(uint8_t subAddress, uint8_t data)
+{
+    _sim.writeRegister(MPUSimulator::MPU_ADDRESS, subAddress, data);
+    countWrite(true);
+}
+
+void MPU9250_Mock::readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    uint32_t start = statsClock();
+    _sim.readRegisters(MPUSimulator::MPU_ADDRESS, subAddress, count, dest);
+    countRead(count, true, start);
+}
+
+void MPU9250_Mock::writeRegister(uint8_t address, uint8_t subAddress, uint8_t data)
+{
+    _sim.writeRegister(address, subAddress, data);
+    countWrite(true);
+}
+
+void MPU9250_Mock::readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    uint32_t start = statsClock();
+    _sim.readRegisters(address, subAddress, count, dest);
+    countRead(count, true, start);
+}
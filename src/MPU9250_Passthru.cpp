@@ -27,6 +27,11 @@
 MPU9250_Passthru::MPU9250_Passthru(Ascale_t ascale, Gscale_t gscale, Mscale_t mscale, Mmode_t mmode, uint8_t sampleRateDivisor) :
     MPU9250(ascale, gscale, mscale, mmode, sampleRateDivisor, true)
 {
+#if defined(ARDUINO)
+    _maxBurst = 32; // Wire library buffer size
+#endif
+
+    _magFresh = false;
 }
 
 MPUIMU::Error_t MPU9250_Passthru::begin(uint8_t i2cbus)
@@ -44,6 +49,58 @@ bool MPU9250_Passthru::checkNewAccelGyroData()
     return MPUIMU::checkNewData();
 }
 
+bool MPU9250_Passthru::checkNewAccelGyroData(uint32_t usec)
+{
+    return MPUIMU::checkNewData(usec);
+}
+
+void MPU9250_Passthru::readAll(Sample_t & sample)
+{
+    uint8_t rawData[BURST_SIZE];
+
+    readMPURegisters(ACCEL_XOUT_H, prepareBurst(), &rawData[0]);
+
+    decodeBurst(rawData, sample);
+}
+
+uint8_t MPU9250_Passthru::prepareBurst(void)
+{
+    _magFresh = false;
+
+    if (magDue()) {
+
+        // ST1, the data, and ST2, whose read lets the AK8963 replace the data
+        uint8_t rawData[8];
+        readAK8963Registers(AK8963_ST1, 8, rawData);
+
+        _magFresh = (rawData[0] & 0x01) && parseMagData(&rawData[1], _magCount);
+    }
+
+    return BURST_SIZE;
+}
+
+void MPU9250_Passthru::decodeBurst(const uint8_t * rawData, Sample_t & sample)
+{
+    decodeAll(rawData, sample);
+
+    holdMag(_magFresh, sample);
+
+    sample.timestamp = 0;
+
+    countSamples(1);
+}
+
+void MPU9250_Passthru::startSampleRead(void)
+{
+    // Blocks for the magnetometer read when one is due
+    startMPURead(ACCEL_XOUT_H, prepareBurst(), _asyncBuffer);
+}
+
+void MPU9250_Passthru::decodeSampleRead(Sample_t & sample)
+{
+    decodeBurst(_asyncBuffer, sample);
+}
+
 bool MPU9250_Passthru::checkNewMagData()
 {
     return readAK8963Register(AK8963_ST1) & 0x01;
@@ -68,23 +125,27 @@ MPUIMU::Error_t MPU9250::begin(uint8_t bus)
 
 void MPU9250_Passthru::readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * data)
 {
-    cpi2c_readRegisters(address, subAddress, count, data);
+    uint32_t start = statsClock();
+    bool ok = cpi2c_readRegisters(address, subAddress, count, data);
+    countRead(count, ok, start);
 }
 
 
 void MPU9250_Passthru::writeRegister(uint8_t address, uint8_t subAddress, uint8_t data)
 {
-    cpi2c_writeRegister(address, subAddress, data);
+    countWrite(cpi2c_writeRegister(address, subAddress, data));
 }
 
 void MPU9250_Passthru::writeMPURegister(uint8_t subAddress, uint8_t data)
 {
-    cpi2c_writeRegister(_i2c, subAddress, data);
+    countWrite(cpi2c_writeRegister(_i2c, subAddress, data));
 }
 
 void MPU9250_Passthru::readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
 {
-    cpi2c_readRegisters(_i2c, subAddress, count, dest);
+    uint32_t start = statsClock();
+    bool ok = cpi2c_readRegisters(_i2c, subAddress, count, dest);
+    countRead(count, ok, start);
 }
 
 
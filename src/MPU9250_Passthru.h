@@ -32,10 +32,24 @@ class MPU9250_Passthru : public MPU9250 {
 
         bool checkNewAccelGyroData(void);
 
+        // As MPUIMU::checkNewData(usec)
+        bool checkNewAccelGyroData(uint32_t usec);
+
         bool checkNewMagData(void);
 
+        // Reads accelerometer, thermometer, and gyrometer in a single burst, and the magnetometer as
+        // well (ST1 first, to see whether it has new data) only while a new reading is due (see
+        // MPU9250::magDue())
+        virtual void readAll(Sample_t & sample) override;
+
     protected:
 
+        uint8_t prepareBurst(void);
+        void decodeBurst(const uint8_t * rawData, Sample_t & sample);
+
+        virtual void startSampleRead(void) override;
+        virtual void decodeSampleRead(Sample_t & sample) override;
+
         virtual void writeMPURegister(uint8_t subAddress, uint8_t data) override;
 
         virtual void readMPURegisters(uint8_t subAddress, uint8_t count, uint8_t * dest) override;
@@ -48,8 +62,8 @@ class MPU9250_Passthru : public MPU9250 {
 
     private:
 
-        // Cross-platform support
-        uint8_t  _i2c;
+        // Whether prepareBurst() found a new magnetometer reading
+        bool _magFresh;
 
         virtual void writeAK8963Register(uint8_t subAddress, uint8_t data) override;
 
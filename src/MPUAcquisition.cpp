@@ -0,0 +1,337 @@
+/* 
+   MPUAcquisition.cpp: Interrupt-driven acquisition thread for Linux targets
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+
+#include "MPUAcquisition.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+MPUAcquisition::MPUAcquisition(MPUIMU & imu) : _imu(imu)
+{
+    _wake = WAKE_POLL;
+    _fd = -1;
+    _periodUsec = 1000;
+    _started = false;
+    _running = false;
+    _dropped = 0;
+    _keepLocal = true;
+}
+
+MPUAcquisition::~MPUAcquisition(void)
+{
+    stop();
+    closePin();
+    _shared.close();
+}
+
+bool MPUAcquisition::share(const char * name, uint32_t capacity, bool keepLocal)
+{
+    if (_started || !_shared.create(name, _imu.getSampleRate(), capacity)) {
+        return false;
+    }
+
+    _keepLocal = keepLocal;
+
+    return true;
+}
+
+uint64_t MPUAcquisition::getTimestamp(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool MPUAcquisition::usePin(const char * chip, uint32_t line)
+{
+    closePin();
+
+    int chipfd = open(chip, O_RDONLY);
+    if (chipfd < 0) {
+        return false;
+    }
+
+    struct gpioevent_request req;
+    memset(&req, 0, sizeof(req));
+    req.lineoffset = line;
+    req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(req.consumer_label, "MPU", sizeof(req.consumer_label)-1);
+
+    int status = ioctl(chipfd, GPIO_GET_LINEEVENT_IOCTL, &req);
+    close(chipfd);
+
+    if (status < 0) {
+        return false;
+    }
+
+    _fd = req.fd;
+    _wake = WAKE_CHARDEV;
+
+    return true;
+}
+
+bool MPUAcquisition::useSysfsPin(uint32_t gpio)
+{
+    closePin();
+
+    char path[64];
+
+    // Exporting an already-exported pin fails harmlessly
+    int fd = open("/sys/class/gpio/export", O_WRONLY);
+    if (fd >= 0) {
+        int n = snprintf(path, sizeof(path), "%u", gpio);
+        ssize_t status = write(fd, path, n);
+        (void)status;
+        close(fd);
+    }
+
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%u/edge", gpio);
+    fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, "rising", 6) == 6;
+    close(fd);
+    if (!ok) {
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%u/value", gpio);
+    _fd = open(path, O_RDONLY);
+    if (_fd < 0) {
+        return false;
+    }
+
+    _wake = WAKE_SYSFS;
+
+    return true;
+}
+
+void MPUAcquisition::usePolling(uint32_t periodUsec)
+{
+    closePin();
+
+    _periodUsec = periodUsec;
+    _wake = WAKE_POLL;
+}
+
+void MPUAcquisition::closePin(void)
+{
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+bool MPUAcquisition::start(int priority)
+{
+    if (_started) {
+        return true;
+    }
+
+    // DMP packets are not samples, and readFifo() takes none of them
+    if (_imu.isDMPEnabled()) {
+        return false;
+    }
+
+    _running = true;
+
+    _stamper.begin(_imu);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    struct sched_param param;
+    param.sched_priority = priority;
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+    // Real-time scheduling needs CAP_SYS_NICE; run unprivileged otherwise
+    if (pthread_create(&_thread, &attr, threadFun, this) != 0) {
+        pthread_attr_destroy(&attr);
+        if (pthread_create(&_thread, NULL, threadFun, this) != 0) {
+            _running = false;
+            return false;
+        }
+    }
+    else {
+        pthread_attr_destroy(&attr);
+    }
+
+    _started = true;
+
+    return true;
+}
+
+void MPUAcquisition::stop(void)
+{
+    if (!_started) {
+        return;
+    }
+
+    _running = false;
+    pthread_join(_thread, NULL);
+    _started = false;
+}
+
+bool MPUAcquisition::read(MPUIMU::Sample_t & sample)
+{
+    return _ring.pop(sample);
+}
+
+uint32_t MPUAcquisition::read(MPUIMU::Sample_t * samples, uint32_t maxSamples)
+{
+    return _ring.pop(samples, maxSamples);
+}
+
+void * MPUAcquisition::threadFun(void * arg)
+{
+    ((MPUAcquisition *)arg)->run();
+    return NULL;
+}
+
+void MPUAcquisition::run(void)
+{
+    while (_running) {
+
+        if (waitForInterrupt()) {
+            acquire(getTimestamp());
+        }
+    }
+}
+
+// Returns true when data should be read; times out periodically so stop() is noticed
+bool MPUAcquisition::waitForInterrupt(void)
+{
+    static const int TIMEOUT_MSEC = 100;
+
+    if (_wake == WAKE_POLL) {
+
+        bool fifo = _imu.getFifoFrameSize() > 0;
+
+        uint32_t wait = fifo ? 0 : _imu.getDataWait((uint32_t)getTimestamp());
+
+        uint32_t usec = wait ? wait : _periodUsec;
+        struct timespec ts = {(time_t)(usec / 1000000), (long)(usec % 1000000) * 1000};
+        nanosleep(&ts, NULL);
+
+        return fifo || _imu.checkNewData((uint32_t)getTimestamp());
+    }
+
+    struct pollfd pfd;
+    pfd.fd = _fd;
+    pfd.events = _wake == WAKE_CHARDEV ? (POLLIN | POLLPRI) : (POLLPRI | POLLERR);
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, TIMEOUT_MSEC) <= 0) {
+        return false;
+    }
+
+    // Consume the event so the next edge wakes us again
+    ssize_t status = 0;
+    if (_wake == WAKE_CHARDEV) {
+        struct gpioevent_data event;
+        status = ::read(_fd, &event, sizeof(event));
+    }
+    else {
+        char value[4];
+        lseek(_fd, 0, SEEK_SET);
+        status = ::read(_fd, value, sizeof(value));
+    }
+    (void)status;
+
+    // Releases the pin if INT_PIN_CFG latches it
+    _imu.notifyDataReady();
+    _imu.checkNewData((uint32_t)getTimestamp());
+
+    return true;
+}
+
+void MPUAcquisition::acquire(uint64_t now)
+{
+    if (_imu.getFifoFrameSize() == 0) {
+
+        // The data registers hold only the newest sample, so a wake a period or more late has lost
+        // the ones in between, and the line would otherwise spread the rest across them
+        if (_stamper.getMissed(now) > 0) {
+            _stamper.reset();
+        }
+
+        MPUIMU::Sample_t sample;
+        _imu.readAll(sample);
+        _stamper.stamp(sample, now);
+        publish(sample);
+    }
+
+    else {
+
+        // Frames accumulated since the previous wake, the newest of which existed by now; a full
+        // batch may have left more, which existed by the end of the read that takes them.  There are
+        // none while the DMP has the FIFO, which start() refuses.
+        uint16_t count = BATCH_SIZE;
+
+        for (bool first=true; count == BATCH_SIZE; first=false) {
+
+            count = _imu.readFifo(_batch, BATCH_SIZE);
+
+            if (!first) {
+                now = getTimestamp();
+            }
+
+            // An overflow drops the oldest bytes, so the frames no longer line up and how many went
+            // is unknown: start over with an empty FIFO and a new line
+            if (_imu.fifoOverflowed()) {
+                _imu.resetFifo();
+                _stamper.reset();
+                return;
+            }
+
+            _stamper.stampBatch(_batch, count, now);
+
+            for (uint16_t k=0; k<count; ++k) {
+                publish(_batch[k]);
+            }
+        }
+    }
+}
+
+void MPUAcquisition::publish(const MPUIMU::Sample_t & sample)
+{
+    if (_shared.isOpen()) {
+        _shared.publish(sample, _imu.getCalibrationEpoch());
+    }
+
+    if (_keepLocal && !_ring.push(sample)) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#endif // __linux__
@@ -0,0 +1,134 @@
+/* 
+   MPUAcquisition.h: Interrupt-driven acquisition thread for Linux targets
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#if defined(__linux__)
+
+#include "MPU.h"
+#include "MPURingBuffer.h"
+#include "MPUSharedRing.h"
+#include "MPUTimestamper.h"
+
+#include <pthread.h>
+#include <atomic>
+
+// Owns the bus for one MPUIMU: a real-time thread sleeps on the INT pin (or a timer),
+// reads a sample or FIFO batch when it fires, and publishes timestamped samples to a
+// lock-free ring that any one consumer thread can drain without touching the bus.
+class MPUAcquisition {
+
+    public:
+
+        static const uint32_t RING_SIZE = 1024; // samples
+
+        MPUAcquisition(MPUIMU & imu);
+
+        ~MPUAcquisition(void);
+
+        // Wake on rising edges of a line on a GPIO character device (e.g. "/dev/gpiochip0", 17)
+        bool usePin(const char * chip, uint32_t line);
+
+        // Wake on rising edges of a legacy sysfs GPIO (/sys/class/gpio/gpioN)
+        bool useSysfsPin(uint32_t gpio);
+
+        // No INT pin: sleep until shortly before each sample is predicted, then check INT_STATUS every
+        // periodUsec until it turns up (see MPUIMU::checkNewData(usec)); or, with the FIFO enabled, read
+        // it every periodUsec
+        void usePolling(uint32_t periodUsec);
+
+        // Daemon mode: publish every sample to a shared-memory ring that other processes open with
+        // MPUSharedRingReader, instead of (or, with keepLocal, as well as) the local ring.  Call before
+        // start(), once the IMU is running, so that the ring records its sample rate.
+        bool share(const char * name, uint32_t capacity=MPUSharedRing::DEFAULT_CAPACITY, bool keepLocal=false);
+
+        // SCHED_FIFO priority for the acquisition thread; falls back to normal
+        // scheduling when the process lacks permission.  Fails while the DMP has the FIFO.
+        bool start(int priority=50);
+
+        void stop(void);
+
+        bool read(MPUIMU::Sample_t & sample);
+
+        uint32_t read(MPUIMU::Sample_t * samples, uint32_t maxSamples);
+
+        uint32_t read(MPUSpan<MPUIMU::Sample_t> samples) { return read(samples.data(), samples.size()); }
+
+        uint32_t available(void) const { return _ring.size(); }
+
+        // Samples lost because the consumer fell RING_SIZE behind
+        uint32_t getDropped(void) const { return _dropped.load(std::memory_order_relaxed); }
+
+        // IMU sample clock against CLOCK_MONOTONIC, in parts per million
+        float getClockDrift(void) const { return _stamper.getDrift(); }
+
+        static uint64_t getTimestamp(void);
+
+    private:
+
+        // Frames per FIFO read; acquire() reads again while a batch comes back full, so that a late
+        // wake catches up however small the frames and large the FIFO
+        static const uint16_t BATCH_SIZE = 96;
+
+        typedef enum {
+
+            WAKE_POLL,
+            WAKE_CHARDEV,
+            WAKE_SYSFS
+
+        } Wake_t;
+
+        MPUIMU & _imu;
+
+        MPURingBuffer<MPUIMU::Sample_t, RING_SIZE> _ring;
+
+        MPUSharedRing _shared;
+        bool          _keepLocal;
+
+        Wake_t   _wake;
+        int      _fd;
+        uint32_t _periodUsec;
+
+        pthread_t _thread;
+        bool      _started;
+
+        std::atomic<bool>     _running;
+        std::atomic<uint32_t> _dropped;
+
+        // Sample timestamps follow the IMU's sample clock rather than the wake-up times
+        MPUTimestamper _stamper;
+
+        MPUIMU::Sample_t _batch[BATCH_SIZE];
+
+        static void * threadFun(void * arg);
+
+        void run(void);
+
+        bool waitForInterrupt(void);
+
+        void acquire(uint64_t now);
+
+        void publish(const MPUIMU::Sample_t & sample);
+
+        void closePin(void);
+
+}; // class MPUAcquisition
+
+#endif // __linux__
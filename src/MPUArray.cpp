@@ -0,0 +1,329 @@
+/*
+   MPUArray.cpp: Parallel acquisition and voting for several IMUs on Linux targets
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+
+#include "MPUArray.h"
+#include "MPUAcquisition.h"
+
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+MPUArray::MPUArray(void)
+{
+    _count = 0;
+    _magMask = 0;
+    _busCount = 0;
+    _periodUsec = 1000;
+    _startTime = 0;
+    _nextTick = 0;
+    _started = false;
+    _running = false;
+    _dropped = 0;
+    _incomplete = 0;
+
+    memset(_slots, 0, sizeof(_slots));
+
+    pthread_mutex_init(&_lock, NULL);
+}
+
+MPUArray::~MPUArray(void)
+{
+    stop();
+    pthread_mutex_destroy(&_lock);
+}
+
+bool MPUArray::add(MPUIMU & imu, uint8_t bus, bool hasMag)
+{
+    if (_started || _count == MAX_DEVICES) {
+        return false;
+    }
+
+    uint8_t k = 0;
+    while (k < _busCount && _buses[k].bus != bus) {
+        ++k;
+    }
+
+    if (k == _busCount) {
+        _buses[k].owner = this;
+        _buses[k].bus = bus;
+        _buses[k].index = k;
+        _buses[k].mask = 0;
+        ++_busCount;
+    }
+
+    _buses[k].mask |= 1 << _count;
+
+    if (hasMag) {
+        _magMask |= 1 << _count;
+    }
+
+    _devices[_count++] = &imu;
+
+    return true;
+}
+
+bool MPUArray::start(uint32_t periodUsec, int priority)
+{
+    if (_started || _count == 0) {
+        return _started;
+    }
+
+    _periodUsec = periodUsec;
+    _startTime = MPUAcquisition::getTimestamp() + periodUsec;
+    _running = true;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    struct sched_param param;
+    param.sched_priority = priority;
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+    for (uint8_t k=0; k<_busCount; ++k) {
+
+        // Real-time scheduling needs CAP_SYS_NICE; run unprivileged otherwise
+        if (pthread_create(&_buses[k].thread, &attr, threadFun, &_buses[k]) != 0 &&
+                pthread_create(&_buses[k].thread, NULL, threadFun, &_buses[k]) != 0) {
+
+            _running = false;
+            for (uint8_t j=0; j<k; ++j) {
+                pthread_join(_buses[j].thread, NULL);
+            }
+            pthread_attr_destroy(&attr);
+            return false;
+        }
+    }
+
+    pthread_attr_destroy(&attr);
+
+    _started = true;
+
+    return true;
+}
+
+void MPUArray::stop(void)
+{
+    if (!_started) {
+        return;
+    }
+
+    _running = false;
+
+    for (uint8_t k=0; k<_busCount; ++k) {
+        pthread_join(_buses[k].thread, NULL);
+    }
+
+    _started = false;
+}
+
+bool MPUArray::read(Frame_t & frame)
+{
+    return _ring.pop(frame);
+}
+
+void * MPUArray::threadFun(void * arg)
+{
+    Bus_t * bus = (Bus_t *)arg;
+    bus->owner->run(*bus);
+    return NULL;
+}
+
+void MPUArray::run(Bus_t & bus)
+{
+    MPUIMU::Sample_t samples[MAX_DEVICES];
+
+    while (_running) {
+
+        // Next tick on the shared schedule; a bus that overran skips the ticks it missed
+        uint64_t now = MPUAcquisition::getTimestamp();
+        uint64_t tick = now < _startTime ? 0 : (now - _startTime) / _periodUsec + 1;
+        uint64_t wake = _startTime + tick * _periodUsec;
+
+        struct timespec ts;
+        ts.tv_sec = wake / 1000000;
+        ts.tv_nsec = (wake % 1000000) * 1000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+        for (uint8_t k=0; k<_count; ++k) {
+
+            if (bus.mask & (1 << k)) {
+                uint64_t before = MPUAcquisition::getTimestamp();
+                _devices[k]->readAll(samples[k]);
+                samples[k].timestamp = (before + MPUAcquisition::getTimestamp()) / 2;
+            }
+        }
+
+        report(bus, tick, samples);
+    }
+}
+
+void MPUArray::report(const Bus_t & bus, uint64_t tick, const MPUIMU::Sample_t * samples)
+{
+    pthread_mutex_lock(&_lock);
+
+    Slot_t & slot = _slots[tick % SLOTS];
+
+    // The slot still holds an older tick that some bus fell too far behind on: give up on it,
+    // and on anything older still, so frames keep coming out in tick order
+    if (slot.active && slot.tick < tick) {
+        Slot_t * old;
+        while ((old = oldest()) != NULL && old->tick <= slot.tick) {
+            publish(*old);
+        }
+    }
+
+    // Too late for a tick that is already gone
+    if (tick < _nextTick || (slot.active && slot.tick > tick)) {
+        pthread_mutex_unlock(&_lock);
+        return;
+    }
+
+    if (!slot.active) {
+        slot.active = true;
+        slot.tick = tick;
+        slot.pending = (1 << _busCount) - 1;
+        slot.frame.timestamp = _startTime + tick * _periodUsec;
+        slot.frame.count = _count;
+        slot.frame.valid = 0;
+    }
+
+    for (uint8_t k=0; k<_count; ++k) {
+        if (bus.mask & (1 << k)) {
+            slot.frame.samples[k] = samples[k];
+        }
+    }
+
+    slot.frame.valid |= bus.mask;
+
+    // This bus has moved on, so it will not report any earlier tick it skipped
+    for (uint8_t k=0; k<SLOTS; ++k) {
+        if (_slots[k].active && _slots[k].tick <= tick) {
+            _slots[k].pending &= ~(1 << bus.index);
+        }
+    }
+
+    Slot_t * done;
+    while ((done = oldest()) != NULL && done->pending == 0) {
+        publish(*done);
+    }
+
+    pthread_mutex_unlock(&_lock);
+}
+
+MPUArray::Slot_t * MPUArray::oldest(void)
+{
+    Slot_t * slot = NULL;
+
+    for (uint8_t k=0; k<SLOTS; ++k) {
+        if (_slots[k].active && (slot == NULL || _slots[k].tick < slot->tick)) {
+            slot = &_slots[k];
+        }
+    }
+
+    return slot;
+}
+
+// Called with _lock held, which also keeps the bus threads from pushing to the ring at once
+void MPUArray::publish(Slot_t & slot)
+{
+    if (slot.frame.valid != (1 << _count) - 1) {
+        _incomplete.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    vote(slot.frame.samples, slot.frame.count, slot.frame.valid, _magMask, slot.frame.voted);
+
+    slot.frame.voted.timestamp = slot.frame.timestamp;
+
+    if (!_ring.push(slot.frame)) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    slot.active = false;
+
+    _nextTick = slot.tick + 1;
+}
+
+static float median(float * values, uint8_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    // Insertion sort; count is at most MAX_DEVICES
+    for (uint8_t j=1; j<count; ++j) {
+        float v = values[j];
+        int8_t i = j - 1;
+        while (i >= 0 && values[i] > v) {
+            values[i+1] = values[i];
+            --i;
+        }
+        values[i+1] = v;
+    }
+
+    return (count & 1) ? values[count/2] : (values[count/2-1] + values[count/2]) / 2;
+}
+
+void MPUArray::vote(const MPUIMU::Sample_t * samples, uint8_t count, uint8_t valid, uint8_t magMask,
+        MPUIMU::Sample_t & voted)
+{
+    float values[MAX_DEVICES];
+    uint8_t n = 0;
+
+    for (uint8_t axis=0; axis<3; ++axis) {
+
+        n = 0;
+        for (uint8_t k=0; k<count; ++k) {
+            if (valid & (1 << k)) values[n++] = samples[k].accel[axis];
+        }
+        voted.accel[axis] = median(values, n);
+
+        n = 0;
+        for (uint8_t k=0; k<count; ++k) {
+            if (valid & (1 << k)) values[n++] = samples[k].gyro[axis];
+        }
+        voted.gyro[axis] = median(values, n);
+
+        n = 0;
+        for (uint8_t k=0; k<count; ++k) {
+            if (valid & magMask & (1 << k)) values[n++] = samples[k].mag[axis];
+        }
+        voted.mag[axis] = median(values, n);
+    }
+
+    n = 0;
+    for (uint8_t k=0; k<count; ++k) {
+        if (valid & (1 << k)) values[n++] = samples[k].temperature;
+    }
+    voted.temperature = median(values, n);
+
+    // The newest of the magnetometer readings voted on
+    voted.magAge = MPUIMU::MAG_AGE_NONE;
+    for (uint8_t k=0; k<count; ++k) {
+        if ((valid & magMask & (1 << k)) && samples[k].magAge < voted.magAge) voted.magAge = samples[k].magAge;
+    }
+
+    voted.timestamp = 0;
+}
+
+#endif // __linux__
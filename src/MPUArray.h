@@ -0,0 +1,137 @@
+/*
+   MPUArray.h: Parallel acquisition and voting for several IMUs on Linux targets
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#if defined(__linux__)
+
+#include "MPU.h"
+#include "MPURingBuffer.h"
+
+#include <pthread.h>
+#include <atomic>
+
+// Reads several begun MPUIMU devices at a common period.  Devices that share a bus are read
+// one after another; each bus gets its own thread, and all threads wake on the same absolute
+// tick, so the latency of one bus does not add to that of another.  The samples of each tick
+// are gathered into one Frame_t, along with their per-axis median for redundancy voting.
+class MPUArray {
+
+    public:
+
+        static const uint8_t  MAX_DEVICES = 8;
+        static const uint32_t RING_SIZE   = 64; // frames
+
+        typedef struct {
+
+            uint64_t         timestamp;             // scheduled tick time, microseconds (CLOCK_MONOTONIC)
+            uint8_t          count;                 // devices in the array
+            uint8_t          valid;                 // bit k set when samples[k] was read for this tick
+            MPUIMU::Sample_t samples[MAX_DEVICES];  // each timestamped at the middle of its own read
+            MPUIMU::Sample_t voted;                 // per-axis median of the valid samples
+
+        } Frame_t;
+
+        MPUArray(void);
+
+        ~MPUArray(void);
+
+        // bus is any number identifying the physical bus: the I^2C bus passed to begin(), or
+        // e.g. 0 for SPI.  Set hasMag for devices that report magnetometer readings, so that
+        // the others do not take part in the magnetometer vote.  Call before start().
+        bool add(MPUIMU & imu, uint8_t bus, bool hasMag=false);
+
+        bool start(uint32_t periodUsec, int priority=50);
+
+        void stop(void);
+
+        bool read(Frame_t & frame);
+
+        uint32_t available(void) const { return _ring.size(); }
+
+        // Frames lost because the consumer fell RING_SIZE behind
+        uint32_t getDropped(void) const { return _dropped.load(std::memory_order_relaxed); }
+
+        // Frames published without every device, because a bus overran the period
+        uint32_t getIncomplete(void) const { return _incomplete.load(std::memory_order_relaxed); }
+
+        // Per-axis median over the samples whose bits are set in valid (average of the middle
+        // two for an even count); magnetometer axes only use samples whose bits are set in magMask
+        static void vote(const MPUIMU::Sample_t * samples, uint8_t count, uint8_t valid, uint8_t magMask,
+                MPUIMU::Sample_t & voted);
+
+    private:
+
+        // Ticks that may be in flight at once when buses run late
+        static const uint8_t SLOTS = 4;
+
+        typedef struct {
+
+            MPUArray * owner;
+            uint8_t    bus;
+            uint8_t    index; // bit in Slot_t::pending
+            uint8_t    mask;  // devices on this bus
+            pthread_t  thread;
+
+        } Bus_t;
+
+        typedef struct {
+
+            uint64_t tick;
+            uint8_t  pending; // bits of the buses yet to report
+            bool     active;
+            Frame_t  frame;
+
+        } Slot_t;
+
+        MPUIMU * _devices[MAX_DEVICES];
+        uint8_t  _count;
+        uint8_t  _magMask;
+
+        Bus_t    _buses[MAX_DEVICES];
+        uint8_t  _busCount;
+
+        uint32_t _periodUsec;
+        uint64_t _startTime;
+        bool     _started;
+
+        Slot_t          _slots[SLOTS];
+        uint64_t        _nextTick;  // ticks before this have been published
+        pthread_mutex_t _lock;
+
+        MPURingBuffer<Frame_t, RING_SIZE> _ring;
+
+        std::atomic<bool>     _running;
+        std::atomic<uint32_t> _dropped;
+        std::atomic<uint32_t> _incomplete;
+
+        static void * threadFun(void * arg);
+
+        void run(Bus_t & bus);
+
+        void report(const Bus_t & bus, uint64_t tick, const MPUIMU::Sample_t * samples);
+
+        Slot_t * oldest(void);
+
+        void publish(Slot_t & slot);
+
+}; // class MPUArray
+
+#endif // __linux__
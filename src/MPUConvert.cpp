@@ -0,0 +1,180 @@
+/* 
+   MPUConvert.cpp: Batch conversion of raw sample frames to structure-of-arrays floats
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPU.h"
+#include "MPU9250.h"
+
+#include <stddef.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MPU_NEON
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define MPU_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MPU_SSE2
+#endif
+
+// Frames are converted this many at a time through scratch buffers on the stack
+static const uint16_t BLOCK = 32;
+
+// Big-endian bytes to native int16
+static void swapBytes(const uint8_t * src, int16_t * dst, uint32_t count)
+{
+    uint32_t k = 0;
+
+#if defined(MPU_NEON)
+    for (; k+8 <= count; k+=8) {
+        uint8x16_t v = vld1q_u8(&src[2*k]);
+        vst1q_s16(&dst[k], vreinterpretq_s16_u8(vrev16q_u8(v)));
+    }
+#elif defined(MPU_AVX2) || defined(MPU_SSE2)
+    for (; k+8 <= count; k+=8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&src[2*k]);
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)&dst[k], v);
+    }
+#endif
+
+    for (; k<count; ++k) {
+        dst[k] = (int16_t)(((uint16_t)src[2*k] << 8) | src[2*k+1]);
+    }
+}
+
+// dst = src * scale - bias
+static void scaleChannel(const int16_t * src, uint32_t count, float scale, float bias, float * dst)
+{
+    uint32_t k = 0;
+
+#if defined(MPU_NEON)
+    float32x4_t s = vdupq_n_f32(scale);
+    float32x4_t b = vdupq_n_f32(bias);
+    for (; k+4 <= count; k+=4) {
+        float32x4_t f = vcvtq_f32_s32(vmovl_s16(vld1_s16(&src[k])));
+        vst1q_f32(&dst[k], vsubq_f32(vmulq_f32(f, s), b));
+    }
+#elif defined(MPU_AVX2)
+    __m256 s = _mm256_set1_ps(scale);
+    __m256 b = _mm256_set1_ps(bias);
+    for (; k+8 <= count; k+=8) {
+        __m256i i = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)&src[k]));
+        _mm256_storeu_ps(&dst[k], _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(i), s), b));
+    }
+#elif defined(MPU_SSE2)
+    __m128 s = _mm_set1_ps(scale);
+    __m128 b = _mm_set1_ps(bias);
+    for (; k+4 <= count; k+=4) {
+        __m128i v = _mm_loadl_epi64((const __m128i *)&src[k]);
+        __m128i i = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); // sign-extend to 32 bits
+        _mm_storeu_ps(&dst[k], _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(i), s), b));
+    }
+#endif
+
+    for (; k<count; ++k) {
+        dst[k] = (float)src[k]*scale - bias;
+    }
+}
+
+void MPUIMU::convertFrames(const uint8_t * frames, uint16_t count, const Scaling_t & scaling, SampleArrays_t & out)
+{
+    // Describe each channel present in the frame: word offset, linear conversion, destination
+    uint8_t channels = 0;
+    uint8_t offset[7];
+    float   scale[7];
+    float   bias[7];
+    float * dest[7];
+
+    uint8_t words = 0;
+
+    if (scaling.sensors & FIFO_ACCEL) {
+        for (uint8_t k=0; k<3; ++k, ++words) {
+            offset[channels] = words;
+            scale[channels] = scaling.aRes;
+            bias[channels] = scaling.accelBias[k];
+            dest[channels++] = out.accel[k];
+        }
+    }
+
+    if (scaling.sensors & FIFO_TEMP) {
+        offset[channels] = words++;
+        scale[channels] = 1.f / scaling.tempSensitivity;
+        bias[channels] = -scaling.tempOffset;
+        dest[channels++] = out.temperature;
+    }
+
+    for (uint8_t k=0; k<3; ++k) {
+        if (scaling.sensors & (0x40 >> k)) {
+            offset[channels] = words++;
+            scale[channels] = scaling.gRes;
+            bias[channels] = scaling.gyroBias[k];
+            dest[channels++] = out.gyro[k];
+        }
+    }
+
+    int16_t swapped[BLOCK*7];
+    int16_t channel[BLOCK];
+
+    for (uint16_t done=0; done<count; done+=BLOCK) {
+
+        uint16_t n = count - done < BLOCK ? count - done : BLOCK;
+
+        swapBytes(&frames[2*done*words], swapped, n*words);
+
+        for (uint8_t c=0; c<channels; ++c) {
+
+            if (dest[c] == NULL) {
+                continue;
+            }
+
+            for (uint16_t k=0; k<n; ++k) {
+                channel[k] = swapped[k*words + offset[c]];
+            }
+
+            scaleChannel(channel, n, scale[c], bias[c], &dest[c][done]);
+        }
+    }
+}
+
+void MPU9250::convertMagFrames(const uint8_t * frames, uint16_t count, uint8_t stride, 
+        const MagScaling_t & scaling, float * mag[3])
+{
+    int16_t channel[3][BLOCK];
+    int16_t last[3] = {0, 0, 0};
+
+    for (uint16_t done=0; done<count; done+=BLOCK) {
+
+        uint16_t n = count - done < BLOCK ? count - done : BLOCK;
+
+        for (uint16_t k=0; k<n; ++k) {
+            parseMagData(&frames[(done+k)*stride], last); // holds the previous value on overflow
+            for (uint8_t j=0; j<3; ++j) {
+                channel[j][k] = last[j];
+            }
+        }
+
+        for (uint8_t j=0; j<3; ++j) {
+            if (mag[j] != NULL) {
+                scaleChannel(channel[j], n, scaling.scale[j], scaling.bias[j], &mag[j][done]);
+            }
+        }
+    }
+}
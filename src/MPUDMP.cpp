@@ -0,0 +1,420 @@
+/*
+   MPUDMP.cpp: Digital Motion Processor firmware loading and FIFO packet decoding
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPU.h"
+
+#include <string.h>
+
+// DMP memory is written and checked this many bytes at a time, within one Wire buffer
+static const uint8_t DMP_CHUNK = 16;
+
+// USER_CTRL and INT_ENABLE bits
+static const uint8_t USER_DMP_EN  = 0x80;
+static const uint8_t USER_FIFO_EN = 0x40;
+static const uint8_t USER_DMP_RST = 0x08;
+static const uint8_t USER_FIFO_RST= 0x04;
+static const uint8_t DMP_INT_EN   = 0x02;
+
+// Where the MotionDriver 6.12 image keeps its settings, under the driver's names
+static const uint16_t D_0_22                 = 22 + 512; // FIFO rate divider
+static const uint16_t D_0_104                = 104;      // gyrometer integration scale
+static const uint16_t D_1_36                 = 256 + 36; // tap thresholds, second stage, X Y Z
+static const uint16_t D_1_40                 = 256 + 40;
+static const uint16_t D_1_44                 = 256 + 44;
+static const uint16_t D_1_72                 = 256 + 72; // tap axes
+static const uint16_t D_1_79                 = 256 + 79; // taps counted
+static const uint16_t D_1_88                 = 256 + 88; // shake rejection timeout
+static const uint16_t D_1_90                 = 256 + 90; // shake rejection time
+static const uint16_t D_1_92                 = 256 + 92; // shake rejection threshold
+static const uint16_t D_1_218                = 256 + 218;// multiple-tap window
+static const uint16_t DMP_TAP_THX            = 468;      // tap thresholds, X Y Z
+static const uint16_t DMP_TAP_THY            = 472;
+static const uint16_t DMP_TAP_THZ            = 476;
+static const uint16_t DMP_TAPW_MIN           = 478;      // tap window
+static const uint16_t CFG_MOTION_BIAS        = 1208;     // gyrometer calibration
+static const uint16_t CFG_ANDROID_ORIENT_INT = 1853;
+static const uint16_t CFG_20                 = 2224;     // tap
+static const uint16_t CFG_LP_QUAT            = 2712;
+static const uint16_t CFG_8                  = 2718;     // 6-axis quaternion
+static const uint16_t CFG_GYRO_RAW_DATA      = 2722;
+static const uint16_t CFG_15                 = 2727;     // sensor data to the FIFO
+static const uint16_t CFG_27                 = 2742;     // gesture data to the FIFO
+static const uint16_t CFG_6                  = 2753;     // FIFO rate
+
+// The driver's gyrometer scale at 200 Hz, and its default tap and shake settings
+static const uint32_t DMP_GYRO_SF         = 46850825;
+static const uint16_t TAP_THRESH          = 250;  // mg/ms
+static const uint16_t TAP_TIME_MS         = 100;
+static const uint16_t TAP_MULTI_TIME_MS   = 500;
+static const uint16_t SHAKE_REJECT_THRESH = 200;  // dps
+static const uint16_t SHAKE_REJECT_TIME   = 40;   // ms
+static const uint16_t SHAKE_REJECT_TO     = 10;   // ms
+
+// Quaternions whose squared norm is further than this from one are taken as a misaligned FIFO
+static const float QUAT_NORM_TOLERANCE = 0.0625f;
+
+static int32_t getInt32(const uint8_t * data)
+{
+    return (int32_t)(((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3]);
+}
+
+static int16_t getInt16(const uint8_t * data)
+{
+    return (int16_t)(((uint16_t)data[0] << 8) | data[1]);
+}
+
+void MPUIMU::writeDMPMemory(uint16_t address, uint16_t count, const uint8_t * data)
+{
+    while (count) {
+
+        uint16_t room = 256 - (address & 0xFF);
+        uint8_t n = count < DMP_CHUNK ? count : DMP_CHUNK;
+        if (n > room) n = room;
+
+        uint8_t pointer[2] = { (uint8_t)(address >> 8), (uint8_t)(address & 0xFF) };
+        writeMPURegisters(DMP_BANK, 2, pointer); // DMP_BANK, DMP_RW_PNT
+        writeMPURegisters(DMP_REG, n, data);
+
+        address += n;
+        data += n;
+        count -= n;
+    }
+}
+
+void MPUIMU::readDMPMemory(uint16_t address, uint16_t count, uint8_t * data)
+{
+    while (count) {
+
+        uint16_t room = 256 - (address & 0xFF);
+        uint8_t n = count < DMP_CHUNK ? count : DMP_CHUNK;
+        if (n > room) n = room;
+
+        uint8_t pointer[2] = { (uint8_t)(address >> 8), (uint8_t)(address & 0xFF) };
+        writeMPURegisters(DMP_BANK, 2, pointer);
+        readMPURegisters(DMP_REG, n, data);
+
+        address += n;
+        data += n;
+        count -= n;
+    }
+}
+
+bool MPUIMU::loadDMPFirmware(const uint8_t * image, uint16_t size, uint16_t startAddress)
+{
+    uint8_t check[DMP_CHUNK];
+
+    for (uint16_t address=0; address<size; address+=DMP_CHUNK) {
+
+        uint16_t n = size - address < DMP_CHUNK ? size - address : DMP_CHUNK;
+
+        writeDMPMemory(address, n, &image[address]);
+        readDMPMemory(address, n, check);
+
+        if (memcmp(check, &image[address], n) != 0) {
+            return false;
+        }
+    }
+
+    uint8_t start[2] = { (uint8_t)(startAddress >> 8), (uint8_t)(startAddress & 0xFF) };
+    writeMPURegisters(DMP_REG_1, 2, start); // DMP_REG_1, DMP_REG_2
+
+    return true;
+}
+
+static void putUint16(uint8_t * data, uint16_t value)
+{
+    data[0] = (uint8_t)(value >> 8);
+    data[1] = (uint8_t)value;
+}
+
+static void putUint32(uint8_t * data, uint32_t value)
+{
+    putUint16(data, (uint16_t)(value >> 16));
+    putUint16(&data[2], (uint16_t)value);
+}
+
+uint8_t MPUIMU::setupDMPFeatures(uint8_t features, uint16_t rate)
+{
+    if (rate == 0 || rate > DMP_SAMPLE_RATE) {
+        return 0;
+    }
+
+    const bool quat6 = (features & DMP_FEATURE_6X_LP_QUAT) != 0;
+    const bool quat3 = !quat6 && (features & DMP_FEATURE_LP_QUAT);
+    const bool accel = (features & DMP_FEATURE_SEND_ACCEL) != 0;
+    const bool gyro  = (features & DMP_FEATURE_SEND_GYRO) != 0;
+    const bool tap   = (features & DMP_FEATURE_TAP) != 0;
+    const bool orient= (features & DMP_FEATURE_ANDROID_ORIENT) != 0;
+
+    uint8_t outputs = (quat3 || quat6 ? DMP_QUAT : 0) | (accel ? DMP_ACCEL : 0) | (gyro ? DMP_GYRO : 0) |
+        (tap || orient ? DMP_GESTURE : 0);
+
+    if (!outputs) {
+        return 0;
+    }
+
+    uint8_t data[12];
+
+    putUint32(data, DMP_GYRO_SF);
+    writeDMPMemory(D_0_104, 4, data);
+
+    // Which sensor data, then whether gestures, go to the FIFO, in the driver's instruction bytes
+    const uint8_t sensors[10] = {
+        0xA3,
+        (uint8_t)(accel ? 0xC0 : 0xA3), (uint8_t)(accel ? 0xC8 : 0xA3), (uint8_t)(accel ? 0xC2 : 0xA3),
+        (uint8_t)(gyro  ? 0xC4 : 0xA3), (uint8_t)(gyro  ? 0xCC : 0xA3), (uint8_t)(gyro  ? 0xC6 : 0xA3),
+        0xA3, 0xA3, 0xA3
+    };
+    writeDMPMemory(CFG_15, 10, sensors);
+
+    data[0] = tap || orient ? 0x20 : 0xD8;
+    writeDMPMemory(CFG_27, 1, data);
+
+    static const uint8_t GYRO_CAL_ON[9]  = { 0xB8, 0xAA, 0xB3, 0x8D, 0xB4, 0x98, 0x0D, 0x35, 0x5D };
+    static const uint8_t GYRO_CAL_OFF[9] = { 0xB8, 0xAA, 0xAA, 0xAA, 0xB0, 0x88, 0xC3, 0xC5, 0xC7 };
+    writeDMPMemory(CFG_MOTION_BIAS, 9, (features & DMP_FEATURE_GYRO_CAL) ? GYRO_CAL_ON : GYRO_CAL_OFF);
+
+    if (gyro) {
+        const uint8_t raw[4] = { 0xB0, 0x80, 0xB4, 0x90 };
+        writeDMPMemory(CFG_GYRO_RAW_DATA, 4, raw);
+    }
+
+    data[0] = tap ? 0xF8 : 0xD8;
+    writeDMPMemory(CFG_20, 1, data);
+
+    if (tap) {
+
+        // Thresholds in counts per sample period, the second stage at three quarters of the first
+        uint16_t counts = (uint16_t)((uint32_t)TAP_THRESH * (16384 >> _aScale) / DMP_SAMPLE_RATE);
+        putUint16(data, counts);
+        putUint16(&data[2], (uint16_t)(counts * 3 / 4));
+        writeDMPMemory(DMP_TAP_THX, 2, data);
+        writeDMPMemory(D_1_36, 2, &data[2]);
+        writeDMPMemory(DMP_TAP_THY, 2, data);
+        writeDMPMemory(D_1_40, 2, &data[2]);
+        writeDMPMemory(DMP_TAP_THZ, 2, data);
+        writeDMPMemory(D_1_44, 2, &data[2]);
+
+        data[0] = 0x3F; // X, Y and Z
+        writeDMPMemory(D_1_72, 1, data);
+
+        data[0] = 0;    // single taps
+        writeDMPMemory(D_1_79, 1, data);
+
+        putUint16(data, TAP_TIME_MS / (1000 / DMP_SAMPLE_RATE));
+        writeDMPMemory(DMP_TAPW_MIN, 2, data);
+
+        putUint16(data, TAP_MULTI_TIME_MS / (1000 / DMP_SAMPLE_RATE));
+        writeDMPMemory(D_1_218, 2, data);
+
+        putUint32(data, DMP_GYRO_SF / 1000 * SHAKE_REJECT_THRESH);
+        writeDMPMemory(D_1_92, 4, data);
+
+        putUint16(data, SHAKE_REJECT_TIME / (1000 / DMP_SAMPLE_RATE));
+        writeDMPMemory(D_1_90, 2, data);
+
+        putUint16(data, SHAKE_REJECT_TO / (1000 / DMP_SAMPLE_RATE));
+        writeDMPMemory(D_1_88, 2, data);
+    }
+
+    data[0] = orient ? 0xD9 : 0xD8;
+    writeDMPMemory(CFG_ANDROID_ORIENT_INT, 1, data);
+
+    const uint8_t lpQuat[4] = {
+        (uint8_t)(quat3 ? 0xC0 : 0x8B), (uint8_t)(quat3 ? 0xC2 : 0x8B),
+        (uint8_t)(quat3 ? 0xC4 : 0x8B), (uint8_t)(quat3 ? 0xC6 : 0x8B)
+    };
+    writeDMPMemory(CFG_LP_QUAT, 4, lpQuat);
+
+    const uint8_t quat6x[4] = {
+        (uint8_t)(quat6 ? 0x20 : 0xA3), (uint8_t)(quat6 ? 0x28 : 0xA3),
+        (uint8_t)(quat6 ? 0x30 : 0xA3), (uint8_t)(quat6 ? 0x38 : 0xA3)
+    };
+    writeDMPMemory(CFG_8, 4, quat6x);
+
+    // The divider, then the code that applies it
+    uint16_t divider = DMP_SAMPLE_RATE / rate - 1;
+    putUint16(data, divider);
+    writeDMPMemory(D_0_22, 2, data);
+
+    const uint8_t rateEnd[12] = { 0xFE, 0xF2, 0xAB, 0xC4, 0xAA, 0xF1, 0xDF, 0xDF, 0xBB, 0xAF, 0xDF, 0xDF };
+    writeDMPMemory(CFG_6, 12, rateEnd);
+
+    _dmpRate = (float)DMP_SAMPLE_RATE / (divider + 1);
+
+    return outputs;
+}
+
+uint8_t MPUIMU::getDMPPacketSize(uint8_t outputs)
+{
+    uint8_t size = 0;
+    if (outputs & DMP_QUAT)    size += 16;
+    if (outputs & DMP_ACCEL)   size += 6;
+    if (outputs & DMP_GYRO)    size += 6;
+    if (outputs & DMP_GESTURE) size += 4;
+    return size;
+}
+
+void MPUIMU::enableDMP(uint8_t outputs)
+{
+    _dmpOutputs = outputs & (DMP_QUAT | DMP_ACCEL | DMP_GYRO | DMP_GESTURE);
+
+    writeConfigRegister(FIFO_EN, 0x00); // the DMP fills the FIFO itself
+
+    // The DMP expects 200 Hz samples: the gyro at 1 kHz (CONFIG's DLPF at about 92 Hz, and
+    // Fchoice_b clear on the MPU9250) divided by five
+    readMPURegisters(SMPLRT_DIV, 3, _dmpSavedConfig); // SMPLRT_DIV, CONFIG, GYRO_CONFIG
+    _dmpSavedRate = _sampleRate;
+
+    uint8_t config[3] = {
+        (uint8_t)(1000 / DMP_SAMPLE_RATE - 1),
+        (uint8_t)((_dmpSavedConfig[1] & ~0x07) | 0x02),
+        (uint8_t)(_dmpSavedConfig[2] & ~0x03)
+    };
+    writeConfigRegisters(SMPLRT_DIV, 3, config);
+    _sampleRate = _dmpRate;
+
+    _fifoSensors = 0;
+    _fifoFrameSize = getDMPPacketSize(_dmpOutputs);
+
+    uint8_t c = readConfigRegister(USER_CTRL) & ~(USER_DMP_EN | USER_FIFO_EN | USER_DMP_RST | USER_FIFO_RST);
+    writeConfigRegister(USER_CTRL, c | USER_DMP_RST | USER_FIFO_RST);
+    writeConfigRegister(USER_CTRL, c | USER_DMP_EN | USER_FIFO_EN);
+
+    writeConfigRegister(INT_ENABLE, readConfigRegister(INT_ENABLE) | DMP_INT_EN);
+}
+
+void MPUIMU::disableDMP(void)
+{
+    if (!_dmpOutputs) {
+        return;
+    }
+
+    writeConfigRegister(INT_ENABLE, readConfigRegister(INT_ENABLE) & ~DMP_INT_EN);
+
+    uint8_t c = readConfigRegister(USER_CTRL);
+    writeConfigRegister(USER_CTRL, c & ~(USER_DMP_EN | USER_FIFO_EN));
+
+    writeConfigRegisters(SMPLRT_DIV, 3, _dmpSavedConfig);
+    _sampleRate = _dmpSavedRate;
+
+    _dmpOutputs = 0;
+    _fifoFrameSize = 0;
+}
+
+bool MPUIMU::parseDMPPacket(const uint8_t * data, uint8_t outputs, DmpPacket_t & packet)
+{
+    memset(&packet, 0, sizeof(packet));
+
+    if (outputs & DMP_QUAT) {
+
+        float norm = 0;
+        for (uint8_t k=0; k<4; ++k) {
+            packet.quat[k] = getInt32(&data[4*k]) / 1073741824.f; // Q30
+            norm += packet.quat[k] * packet.quat[k];
+        }
+
+        if (norm < 1 - QUAT_NORM_TOLERANCE || norm > 1 + QUAT_NORM_TOLERANCE) {
+            return false;
+        }
+
+        data += 16;
+    }
+
+    if (outputs & DMP_ACCEL) {
+        for (uint8_t k=0; k<3; ++k) {
+            packet.accel[k] = getInt16(&data[2*k]);
+        }
+        data += 6;
+    }
+
+    if (outputs & DMP_GYRO) {
+        for (uint8_t k=0; k<3; ++k) {
+            packet.gyro[k] = getInt16(&data[2*k]);
+        }
+        data += 6;
+    }
+
+    // The second byte says which events there are; the fourth holds the orientation in its
+    // top two bits, and the tap as direction * 8 + count - 1 in the others
+    if (outputs & DMP_GESTURE) {
+
+        if (data[1] & 0x01) {
+            packet.events |= DMP_EVENT_TAP;
+            packet.tapDirection = (data[3] & 0x3F) >> 3;
+            packet.tapCount = (data[3] & 0x07) + 1;
+        }
+
+        if (data[1] & 0x08) {
+            packet.events |= DMP_EVENT_ORIENTATION;
+            packet.orientation = data[3] >> 6;
+        }
+    }
+
+    return true;
+}
+
+uint16_t MPUIMU::readDMP(DmpPacket_t * packets, uint16_t maxPackets)
+{
+    if (!_dmpOutputs) {
+        return 0;
+    }
+
+    uint16_t bytes = getFifoCount();
+
+    // Past half full, check for an overflow, after which the packets no longer line up
+    if (bytes >= _fifoSize / 2 && checkFifoOverflow()) {
+        resetFifo();
+        return 0;
+    }
+
+    uint16_t available = bytes / _fifoFrameSize;
+    if (available > maxPackets) {
+        available = maxPackets;
+    }
+
+    countFifo(bytes, available);
+
+    uint8_t data[255];
+    uint8_t packetsPerBurst = _maxBurst / _fifoFrameSize;
+
+    uint16_t done = 0;
+
+    while (done < available) {
+
+        uint16_t n = available - done;
+        if (n > packetsPerBurst) n = packetsPerBurst;
+
+        readMPURegisters(FIFO_R_W, n*_fifoFrameSize, data);
+
+        for (uint16_t k=0; k<n; ++k) {
+            if (!parseDMPPacket(&data[k*_fifoFrameSize], _dmpOutputs, packets[done])) {
+                resetFifo();
+                countSamples(done);
+                return done;
+            }
+            done++;
+        }
+    }
+
+    countSamples(done);
+
+    return done;
+}
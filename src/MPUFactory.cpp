@@ -0,0 +1,315 @@
+/*
+   MPUFactory.cpp: Probes the bus for a supported device and constructs the class that suits it
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPUFactory.h"
+#include "MPUI2C.h"
+#include "MPUSPI.h"
+
+#include <CrossPlatformI2C.h>
+
+#include <new>
+#include <string.h>
+
+// WHO_AM_I values
+static const uint8_t ID_MPU6000_MPU6050 = 0x68;
+static const uint8_t ID_MPU6500         = 0x70;
+static const uint8_t ID_MPU9250         = 0x71;
+
+static const uint8_t MPU_ADDRESS    = 0x68;
+static const uint8_t WHO_AM_I       = 0x75;
+static const uint8_t INT_PIN_CFG    = 0x37;
+static const uint8_t BYPASS_EN      = 0x02;
+
+static const uint8_t AK8963_ADDRESS = 0x0C;
+static const uint8_t AK8963_WIA     = 0x00;
+static const uint8_t AK8963_ID      = 0x48;
+
+MPUFactory::MPUFactory(MPUIMU::Ascale_t ascale, MPUIMU::Gscale_t gscale, MPU9250::Mscale_t mscale, 
+        MPU9250::Mmode_t mmode, uint8_t sampleRateDivisor) 
+{
+    _aScale = ascale;
+    _gScale = gscale;
+    _mScale = mscale;
+    _mMode = mmode;
+    _sampleRateDivisor = sampleRateDivisor;
+
+    memset(&_probe, 0, sizeof(_probe));
+
+    _device = DEVICE_NONE;
+    _bus = BUS_NONE;
+    _deviceI2c = 0;
+    _imu = NULL;
+    _mpu9250 = NULL;
+}
+
+MPUFactory::~MPUFactory(void)
+{
+    destroy();
+
+    if (probeHoldsI2C()) {
+        mpui2c_close(_probe.i2c);
+    }
+}
+
+MPUIMU::Error_t MPUFactory::probe(bool spi, uint8_t i2cBus, uint32_t i2cClock)
+{
+    // A device still running on the last probe's handle keeps it, until destroy()
+    if (probeHoldsI2C() && !sharesI2C()) {
+        mpui2c_close(_probe.i2c);
+    }
+
+    memset(&_probe, 0, sizeof(_probe));
+
+    MPUIMU::Error_t error = MPUIMU::ERROR_CONNECT;
+
+    if (spi) {
+        error = probeSPI();
+    }
+
+    if (error == MPUIMU::ERROR_CONNECT && i2cBus != NO_I2C) {
+        error = probeI2C(i2cBus, i2cClock);
+    }
+
+    if (error != MPUIMU::ERROR_NONE) {
+        _probe.device = DEVICE_NONE;
+    }
+
+    return error;
+}
+
+// Nothing on the bus reads as all zeros or all ones
+static bool answered(uint8_t whoAmI)
+{
+    return whoAmI != 0x00 && whoAmI != 0xFF;
+}
+
+MPUIMU::Error_t MPUFactory::probeSPI(void)
+{
+    uint8_t whoAmI = 0;
+    if (!mpuspi_readRegisters(WHO_AM_I, 1, &whoAmI) || !answered(whoAmI)) {
+        return MPUIMU::ERROR_CONNECT;
+    }
+
+    _probe.bus = BUS_SPI;
+    _probe.whoAmI = whoAmI;
+
+    switch (whoAmI) {
+
+        case ID_MPU6000_MPU6050: // the MPU6050 has no SPI
+            _probe.device = DEVICE_MPU6000;
+            break;
+
+        case ID_MPU6500:
+            _probe.device = DEVICE_MPU6500;
+            break;
+
+        case ID_MPU9250: // the AK8963 is behind the I^2C master, which begin() sets up and checks
+            _probe.device = DEVICE_MPU9250;
+            break;
+
+        default:
+            return MPUIMU::ERROR_IMU_ID;
+    }
+
+    return MPUIMU::ERROR_NONE;
+}
+
+// The AK8963 answers on the main bus while the bypass is on; begin() puts INT_PIN_CFG back anyway
+static uint8_t readAK8963Id(uint8_t handle, uint8_t bus)
+{
+    uint8_t intPinCfg = 0;
+    mpui2c_readRegisters(handle, INT_PIN_CFG, 1, &intPinCfg);
+    cpi2c_writeRegister(handle, INT_PIN_CFG, intPinCfg | BYPASS_EN);
+
+    uint8_t mag = cpi2c_open(AK8963_ADDRESS, bus);
+    uint8_t id = 0;
+    if (!cpi2c_readRegisters(mag, AK8963_WIA, 1, &id)) {
+        id = 0;
+    }
+    mpui2c_close(mag);
+
+    cpi2c_writeRegister(handle, INT_PIN_CFG, intPinCfg);
+
+    return id;
+}
+
+MPUIMU::Error_t MPUFactory::probeI2C(uint8_t bus, uint32_t clock)
+{
+    uint8_t handle = mpui2c_open(MPU_ADDRESS, bus, clock);
+
+    uint8_t whoAmI = 0;
+    if (!mpui2c_readRegisters(handle, WHO_AM_I, 1, &whoAmI) || !answered(whoAmI)) {
+        mpui2c_close(handle);
+        return MPUIMU::ERROR_CONNECT;
+    }
+
+    _probe.bus = BUS_I2C;
+    _probe.whoAmI = whoAmI;
+
+    MPUIMU::Error_t error = MPUIMU::ERROR_NONE;
+
+    switch (whoAmI) {
+
+        case ID_MPU6000_MPU6050: // the MPU6000's I^2C is not supported here
+            _probe.device = DEVICE_MPU6050;
+            break;
+
+        case ID_MPU9250:
+            _probe.magId = readAK8963Id(handle, bus);
+            if (_probe.magId == AK8963_ID) {
+                _probe.device = DEVICE_MPU9250;
+            }
+            else {
+                error = MPUIMU::ERROR_MAG_ID;
+            }
+            break;
+
+        default:
+            error = MPUIMU::ERROR_IMU_ID;
+    }
+
+    // Only a probe that found a device keeps its handle, for begin() to hand over
+    if (error != MPUIMU::ERROR_NONE) {
+        mpui2c_close(handle);
+        return error;
+    }
+
+    _probe.i2c = handle;
+    _probe.i2cClock = clock;
+
+    return MPUIMU::ERROR_NONE;
+}
+
+MPUIMU::Error_t MPUFactory::begin(bool spi, uint8_t i2cBus, uint32_t i2cClock, uint32_t spiClock)
+{
+    if (_probe.device == DEVICE_NONE) {
+        MPUIMU::Error_t error = probe(spi, i2cBus, i2cClock);
+        if (error != MPUIMU::ERROR_NONE) {
+            return error;
+        }
+    }
+
+    destroy();
+
+    switch (_probe.device) {
+
+        case DEVICE_MPU6000: {
+            MPU6000 * imu = new (_storage) MPU6000(_aScale, _gScale, _sampleRateDivisor);
+            adopt(DEVICE_MPU6000, imu);
+            return imu->begin(spiClock);
+        }
+
+        case DEVICE_MPU6050: {
+            MPU6050 * imu = new (_storage) MPU6050(_aScale, _gScale, _sampleRateDivisor);
+            adopt(DEVICE_MPU6050, imu);
+            return imu->begin(i2cBus, i2cClock);
+        }
+
+        case DEVICE_MPU6500: {
+            MPU6500 * imu = new (_storage) MPU6500(_aScale, _gScale, _sampleRateDivisor);
+            adopt(DEVICE_MPU6500, imu);
+            return imu->begin(spiClock);
+        }
+
+        case DEVICE_MPU9250:
+            if (_probe.bus == BUS_SPI) {
+                MPU9250_Master_SPI * imu = new (_storage) MPU9250_Master_SPI(_aScale, _gScale, _mScale, _mMode, _sampleRateDivisor);
+                adopt(DEVICE_MPU9250, imu, imu);
+                return imu->begin(spiClock);
+            }
+            else {
+                MPU9250_Master_I2C * imu = new (_storage) MPU9250_Master_I2C(_aScale, _gScale, _mScale, _mMode, _sampleRateDivisor);
+                adopt(DEVICE_MPU9250, imu, imu);
+                return imu->begin(i2cBus, i2cClock);
+            }
+
+        default:
+            break;
+    }
+
+    return MPUIMU::ERROR_CONNECT;
+}
+
+void MPUFactory::adopt(Device_t device, MPUIMU * imu, MPU9250 * mpu9250)
+{
+    _device = device;
+    _bus = _probe.bus;
+    _deviceI2c = _probe.i2c;
+    _imu = imu;
+    _mpu9250 = mpu9250;
+
+    imu->_probedId = _probe.whoAmI;
+
+    if (_probe.bus == BUS_I2C) {
+        imu->_i2c = _probe.i2c;
+        imu->_i2cClock = _probe.i2cClock;
+    }
+}
+
+// MPUIMU has no virtual destructor, so each class is destroyed as itself
+void MPUFactory::destroy(void)
+{
+    switch (_device) {
+
+        case DEVICE_MPU6000:
+            static_cast<MPU6000 *>(_imu)->~MPU6000();
+            break;
+
+        case DEVICE_MPU6050:
+            static_cast<MPU6050 *>(_imu)->~MPU6050();
+            break;
+
+        case DEVICE_MPU6500:
+            static_cast<MPU6500 *>(_imu)->~MPU6500();
+            break;
+
+        case DEVICE_MPU9250:
+            if (_bus == BUS_SPI) {
+                static_cast<MPU9250_Master_SPI *>(_imu)->~MPU9250_Master_SPI();
+            }
+            else {
+                static_cast<MPU9250_Master_I2C *>(_imu)->~MPU9250_Master_I2C();
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (_bus == BUS_I2C && !sharesI2C()) {
+        mpui2c_close(_deviceI2c);
+    }
+
+    _device = DEVICE_NONE;
+    _bus = BUS_NONE;
+    _imu = NULL;
+    _mpu9250 = NULL;
+}
+
+const char * MPUFactory::getName(void)
+{
+    switch (_probe.device) {
+        case DEVICE_MPU6000: return "MPU6000";
+        case DEVICE_MPU6050: return "MPU6050";
+        case DEVICE_MPU6500: return "MPU6500";
+        case DEVICE_MPU9250: return "MPU9250";
+        default:             return "none";
+    }
+}
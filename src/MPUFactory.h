@@ -0,0 +1,147 @@
+/*
+   MPUFactory.h: Probes the bus for a supported device and constructs the class that suits it
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "MPU6000.h"
+#include "MPU6050.h"
+#include "MPU6500.h"
+#include "MPU9250_Master_I2C.h"
+#include "MPU9250_Master_SPI.h"
+
+static constexpr size_t mpufactory_larger(size_t a, size_t b) { return a > b ? a : b; }
+
+// Finds out which device is fitted, for firmware that has to run on more than one board.  probe()
+// reads WHO_AM_I over SPI and/or I^2C, and for an MPU9250 on I^2C the AK8963's WIA too, at the cost
+// of a few transfers and no delays; begin() then constructs the matching class in storage held by
+// the factory (no heap), with the best transport for it (master mode rather than pass-through for
+// the MPU9250), and runs its begin(), which takes the probe's WHO_AM_I and I^2C handle over
+// instead of repeating them.  A device that would fail with ERROR_IMU_ID or ERROR_MAG_ID is
+// never constructed, so the resets and the self-test are only paid for the right class.
+class MPUFactory {
+
+    public:
+
+        typedef enum {
+
+            DEVICE_NONE,
+            DEVICE_MPU6000,
+            DEVICE_MPU6050,
+            DEVICE_MPU6500,
+            DEVICE_MPU9250
+
+        } Device_t;
+
+        typedef enum {
+
+            BUS_NONE,
+            BUS_SPI,
+            BUS_I2C
+
+        } Bus_t;
+
+        typedef struct {
+
+            Device_t device;
+            Bus_t    bus;
+            uint8_t  whoAmI;    // zero when nothing answered
+            uint8_t  magId;     // AK8963 WIA; zero unless read (I^2C only: over SPI it takes a configured master)
+            uint8_t  i2c;       // handle from mpui2c_open(), held only after a probe that found a device
+            uint32_t i2cClock;  // as mpui2c_open() reported it
+
+        } Probe_t;
+
+        // Scales and rate for whichever device is found; the magnetometer settings apply to an MPU9250
+        MPUFactory(MPUIMU::Ascale_t ascale, MPUIMU::Gscale_t gscale, MPU9250::Mscale_t mscale=MPU9250::MFS_16BITS, 
+                MPU9250::Mmode_t mmode=MPU9250::M_100Hz, uint8_t sampleRateDivisor=0);
+
+        ~MPUFactory(void);
+
+        // Owns the device in its storage
+        MPUFactory(const MPUFactory &) = delete;
+        MPUFactory & operator=(const MPUFactory &) = delete;
+
+        // Tries SPI first when it is wired, then I^2C bus i2cBus unless it is NO_I2C.  Returns ERROR_CONNECT
+        // when nothing answers, ERROR_IMU_ID for an unsupported WHO_AM_I (e.g. an MPU6500 on I^2C, for
+        // which there is no class), and ERROR_MAG_ID for an MPU9250 whose AK8963 does not answer.
+        static const uint8_t NO_I2C = 0xFF;
+
+        MPUIMU::Error_t probe(bool spi, uint8_t i2cBus=1, uint32_t i2cClock=400000);
+
+        const Probe_t & getProbe(void) { return _probe; }
+
+        // Constructs and starts the device that probe() found (running probe(spi, ...) first if it has not
+        // been); an error leaves the object in place, for a retry with getIMU()->begin() if wanted.
+        // spiClock is the sensor-register clock for the SPI devices.
+        MPUIMU::Error_t begin(bool spi, uint8_t i2cBus=1, uint32_t i2cClock=400000, uint32_t spiClock=MPUSPI_SENSOR_CLOCK);
+
+        Device_t getDevice(void) { return _device; }
+
+        const char * getName(void);
+
+        // NULL until begin() has constructed a device; getMPU9250() also when the device is not an MPU9250
+        MPUIMU  * getIMU(void) { return _imu; }
+        MPU9250 * getMPU9250(void) { return _mpu9250; }
+
+    private:
+
+        // Room for any of the classes begin() may construct
+        static const size_t STORAGE_SIZE = 
+            mpufactory_larger(mpufactory_larger(sizeof(MPU6000), sizeof(MPU6050)), 
+                    mpufactory_larger(sizeof(MPU6500), mpufactory_larger(sizeof(MPU9250_Master_I2C), sizeof(MPU9250_Master_SPI))));
+
+        static const size_t STORAGE_ALIGN = 
+            mpufactory_larger(mpufactory_larger(alignof(MPU6000), alignof(MPU6050)), 
+                    mpufactory_larger(alignof(MPU6500), mpufactory_larger(alignof(MPU9250_Master_I2C), alignof(MPU9250_Master_SPI))));
+
+        alignas(STORAGE_ALIGN) uint8_t _storage[STORAGE_SIZE];
+
+        MPUIMU::Ascale_t  _aScale;
+        MPUIMU::Gscale_t  _gScale;
+        MPU9250::Mscale_t _mScale;
+        MPU9250::Mmode_t  _mMode;
+        uint8_t           _sampleRateDivisor;
+
+        Probe_t  _probe;
+
+        // What occupies _storage, on which bus, and the I^2C handle it took from the probe; the factory
+        // closes each handle once neither the probe nor a device holds it
+        Device_t  _device;
+        Bus_t     _bus;
+        uint8_t   _deviceI2c;
+        MPUIMU  * _imu;
+        MPU9250 * _mpu9250;
+
+        MPUIMU::Error_t probeSPI(void);
+        MPUIMU::Error_t probeI2C(uint8_t bus, uint32_t clock);
+
+        // Hands the probe to the device just constructed in _storage
+        void adopt(Device_t device, MPUIMU * imu, MPU9250 * mpu9250=NULL);
+
+        void destroy(void);
+
+        bool probeHoldsI2C(void) { return _probe.bus == BUS_I2C && _probe.device != DEVICE_NONE; }
+
+        bool sharesI2C(void) { return probeHoldsI2C() && _bus == BUS_I2C && _probe.i2c == _deviceI2c; }
+
+}; // class MPUFactory
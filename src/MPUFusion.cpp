@@ -0,0 +1,344 @@
+/*
+   MPUFusion.cpp: Madgwick and Mahony attitude estimation from MPUIMU samples
+
+   Copyright (C) 2018 Simon D. Levy
+
+   Filters after S. O. H. Madgwick, "An efficient orientation filter for inertial and
+   inertial/magnetic sensor arrays" (2010), and R. Mahony et al., "Nonlinear complementary
+   filters on the special orthogonal group" (2008)
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPUFusion.h"
+
+#include <math.h>
+#include <string.h>
+
+static const float DEG2RAD = 3.14159265358979f / 180;
+static const float RAD2DEG = 180 / 3.14159265358979f;
+
+MPUFusion::MPUFusion(Algorithm_t algorithm)
+{
+    _algorithm = algorithm;
+
+    _dt = 0.001f;
+    _beta = 0.1f;
+    _twoKp = 1.0f;
+    _twoKi = 0.0f;
+
+    reset();
+}
+
+void MPUFusion::begin(MPUIMU & imu)
+{
+    setSampleRate(imu.getSampleRate());
+}
+
+void MPUFusion::reset(void)
+{
+    _q0 = 1;
+    _q1 = 0;
+    _q2 = 0;
+    _q3 = 0;
+
+    _integralX = 0;
+    _integralY = 0;
+    _integralZ = 0;
+}
+
+float MPUFusion::invSqrt(float x)
+{
+    // Bit-level initial guess followed by two Newton-Raphson steps; one alone leaves the
+    // quaternion norm short enough to slow the integrated rotation by about 0.2%
+    float half = 0.5f * x;
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86 - (i >> 1);
+    memcpy(&x, &i, sizeof(x));
+    x = x * (1.5f - half * x * x);
+    return x * (1.5f - half * x * x);
+}
+
+void MPUFusion::update(const MPUIMU::Sample_t * samples, uint16_t count)
+{
+    for (uint16_t k=0; k<count; ++k) {
+        update(samples[k]);
+    }
+}
+
+void MPUFusion::update(const MPUIMU::Sample_t & sample)
+{
+    float gx = sample.gyro[0] * DEG2RAD;
+    float gy = sample.gyro[1] * DEG2RAD;
+    float gz = sample.gyro[2] * DEG2RAD;
+
+    // The AK8963 has its X and Y axes swapped and Z reversed relative to the accelerometer
+    float mx =  sample.mag[1];
+    float my =  sample.mag[0];
+    float mz = -sample.mag[2];
+
+    bool useMag = mx != 0 || my != 0 || mz != 0;
+
+    if (_algorithm == MAHONY) {
+        mahony(gx, gy, gz, sample.accel[0], sample.accel[1], sample.accel[2], mx, my, mz, useMag);
+    }
+
+    else if (useMag) {
+        madgwick(gx, gy, gz, sample.accel[0], sample.accel[1], sample.accel[2], mx, my, mz);
+    }
+
+    else {
+        madgwick(gx, gy, gz, sample.accel[0], sample.accel[1], sample.accel[2]);
+    }
+}
+
+void MPUFusion::madgwick(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
+{
+    float q0 = _q0, q1 = _q1, q2 = _q2, q3 = _q3;
+
+    // Rate of change of quaternion from gyroscope
+    float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot1 = 0.5f * ( q0 * gx + q2 * gz - q3 * gy);
+    float qDot2 = 0.5f * ( q0 * gy - q1 * gz + q3 * gx);
+    float qDot3 = 0.5f * ( q0 * gz + q1 * gy - q2 * gx);
+
+    // Feedback only when the accelerometer measurement is valid (avoids NaN in normalization)
+    if (ax != 0 || ay != 0 || az != 0) {
+
+        float recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        recipNorm = invSqrt(mx * mx + my * my + mz * mz);
+        mx *= recipNorm;
+        my *= recipNorm;
+        mz *= recipNorm;
+
+        // Auxiliary variables to avoid repeated arithmetic
+        float _2q0mx = 2 * q0 * mx;
+        float _2q0my = 2 * q0 * my;
+        float _2q0mz = 2 * q0 * mz;
+        float _2q1mx = 2 * q1 * mx;
+        float _2q0 = 2 * q0;
+        float _2q1 = 2 * q1;
+        float _2q2 = 2 * q2;
+        float _2q3 = 2 * q3;
+        float _2q0q2 = 2 * q0 * q2;
+        float _2q2q3 = 2 * q2 * q3;
+        float q0q0 = q0 * q0;
+        float q0q1 = q0 * q1;
+        float q0q2 = q0 * q2;
+        float q0q3 = q0 * q3;
+        float q1q1 = q1 * q1;
+        float q1q2 = q1 * q2;
+        float q1q3 = q1 * q3;
+        float q2q2 = q2 * q2;
+        float q2q3 = q2 * q3;
+        float q3q3 = q3 * q3;
+
+        // Reference direction of Earth's magnetic field
+        float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+        float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+        float _2bx = sqrtf(hx * hx + hy * hy);
+        float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+        float _4bx = 2 * _2bx;
+        float _4bz = 2 * _2bz;
+
+        // Objective function residuals: predicted minus measured gravity and field
+        float fax = 2 * q1q3 - _2q0q2 - ax;
+        float fay = 2 * q0q1 + _2q2q3 - ay;
+        float faz = 1 - 2 * q1q1 - 2 * q2q2 - az;
+        float fmx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+        float fmy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+        float fmz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+        // Gradient decent algorithm corrective step
+        float s0 = -_2q2 * fax + _2q1 * fay - _2bz * q2 * fmx + (-_2bx * q3 + _2bz * q1) * fmy + _2bx * q2 * fmz;
+        float s1 =  _2q3 * fax + _2q0 * fay - 4 * q1 * faz + _2bz * q3 * fmx + (_2bx * q2 + _2bz * q0) * fmy
+            + (_2bx * q3 - _4bz * q1) * fmz;
+        float s2 = -_2q0 * fax + _2q3 * fay - 4 * q2 * faz + (-_4bx * q2 - _2bz * q0) * fmx + (_2bx * q1 + _2bz * q3) * fmy
+            + (_2bx * q0 - _4bz * q2) * fmz;
+        float s3 =  _2q1 * fax + _2q2 * fay + (-_4bx * q3 + _2bz * q1) * fmx + (-_2bx * q0 + _2bz * q2) * fmy + _2bx * q1 * fmz;
+
+        recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+
+        qDot0 -= _beta * s0 * recipNorm;
+        qDot1 -= _beta * s1 * recipNorm;
+        qDot2 -= _beta * s2 * recipNorm;
+        qDot3 -= _beta * s3 * recipNorm;
+    }
+
+    // Integrate rate of change of quaternion
+    _q0 += qDot0 * _dt;
+    _q1 += qDot1 * _dt;
+    _q2 += qDot2 * _dt;
+    _q3 += qDot3 * _dt;
+
+    normalize();
+}
+
+void MPUFusion::madgwick(float gx, float gy, float gz, float ax, float ay, float az)
+{
+    float q0 = _q0, q1 = _q1, q2 = _q2, q3 = _q3;
+
+    float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot1 = 0.5f * ( q0 * gx + q2 * gz - q3 * gy);
+    float qDot2 = 0.5f * ( q0 * gy - q1 * gz + q3 * gx);
+    float qDot3 = 0.5f * ( q0 * gz + q1 * gy - q2 * gx);
+
+    if (ax != 0 || ay != 0 || az != 0) {
+
+        float recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        float fax = 2 * (q1 * q3 - q0 * q2) - ax;
+        float fay = 2 * (q0 * q1 + q2 * q3) - ay;
+        float faz = 1 - 2 * (q1 * q1 + q2 * q2) - az;
+
+        float s0 = -2 * q2 * fax + 2 * q1 * fay;
+        float s1 =  2 * q3 * fax + 2 * q0 * fay - 4 * q1 * faz;
+        float s2 = -2 * q0 * fax + 2 * q3 * fay - 4 * q2 * faz;
+        float s3 =  2 * q1 * fax + 2 * q2 * fay;
+
+        recipNorm = invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+
+        qDot0 -= _beta * s0 * recipNorm;
+        qDot1 -= _beta * s1 * recipNorm;
+        qDot2 -= _beta * s2 * recipNorm;
+        qDot3 -= _beta * s3 * recipNorm;
+    }
+
+    _q0 += qDot0 * _dt;
+    _q1 += qDot1 * _dt;
+    _q2 += qDot2 * _dt;
+    _q3 += qDot3 * _dt;
+
+    normalize();
+}
+
+void MPUFusion::mahony(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, bool useMag)
+{
+    float q0 = _q0, q1 = _q1, q2 = _q2, q3 = _q3;
+
+    if (ax != 0 || ay != 0 || az != 0) {
+
+        float recipNorm = invSqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+
+        float q0q0 = q0 * q0;
+        float q0q1 = q0 * q1;
+        float q0q2 = q0 * q2;
+        float q0q3 = q0 * q3;
+        float q1q1 = q1 * q1;
+        float q1q2 = q1 * q2;
+        float q1q3 = q1 * q3;
+        float q2q2 = q2 * q2;
+        float q2q3 = q2 * q3;
+        float q3q3 = q3 * q3;
+
+        // Estimated direction of gravity
+        float halfvx = q1q3 - q0q2;
+        float halfvy = q0q1 + q2q3;
+        float halfvz = q0q0 - 0.5f + q3q3;
+
+        // Error is the cross product between estimated and measured directions
+        float halfex = ay * halfvz - az * halfvy;
+        float halfey = az * halfvx - ax * halfvz;
+        float halfez = ax * halfvy - ay * halfvx;
+
+        if (useMag) {
+
+            recipNorm = invSqrt(mx * mx + my * my + mz * mz);
+            mx *= recipNorm;
+            my *= recipNorm;
+            mz *= recipNorm;
+
+            // Reference direction of Earth's magnetic field
+            float hx = 2 * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+            float hy = 2 * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+            float bx = sqrtf(hx * hx + hy * hy);
+            float bz = 2 * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+
+            // Estimated direction of magnetic field
+            float halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+            float halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+            float halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+
+            halfex += my * halfwz - mz * halfwy;
+            halfey += mz * halfwx - mx * halfwz;
+            halfez += mx * halfwy - my * halfwx;
+        }
+
+        if (_twoKi > 0) {
+            _integralX += _twoKi * halfex * _dt;
+            _integralY += _twoKi * halfey * _dt;
+            _integralZ += _twoKi * halfez * _dt;
+            gx += _integralX;
+            gy += _integralY;
+            gz += _integralZ;
+        }
+
+        gx += _twoKp * halfex;
+        gy += _twoKp * halfey;
+        gz += _twoKp * halfez;
+    }
+
+    // Integrate rate of change of quaternion
+    gx *= 0.5f * _dt;
+    gy *= 0.5f * _dt;
+    gz *= 0.5f * _dt;
+
+    _q0 += -q1 * gx - q2 * gy - q3 * gz;
+    _q1 +=  q0 * gx + q2 * gz - q3 * gy;
+    _q2 +=  q0 * gy - q1 * gz + q3 * gx;
+    _q3 +=  q0 * gz + q1 * gy - q2 * gx;
+
+    normalize();
+}
+
+void MPUFusion::normalize(void)
+{
+    float recipNorm = invSqrt(_q0 * _q0 + _q1 * _q1 + _q2 * _q2 + _q3 * _q3);
+
+    _q0 *= recipNorm;
+    _q1 *= recipNorm;
+    _q2 *= recipNorm;
+    _q3 *= recipNorm;
+}
+
+void MPUFusion::getQuaternion(Quaternion_t & q)
+{
+    q.w = _q0;
+    q.x = _q1;
+    q.y = _q2;
+    q.z = _q3;
+}
+
+void MPUFusion::getEuler(Euler_t & euler)
+{
+    float sinp = 2 * (_q0 * _q2 - _q3 * _q1);
+    if (sinp > 1) sinp = 1;
+    if (sinp < -1) sinp = -1;
+
+    euler.roll  = atan2f(2 * (_q0 * _q1 + _q2 * _q3), 1 - 2 * (_q1 * _q1 + _q2 * _q2)) * RAD2DEG;
+    euler.pitch = asinf(sinp) * RAD2DEG;
+    euler.yaw   = atan2f(2 * (_q0 * _q3 + _q1 * _q2), 1 - 2 * (_q2 * _q2 + _q3 * _q3)) * RAD2DEG;
+}
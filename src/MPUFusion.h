@@ -0,0 +1,112 @@
+/*
+   MPUFusion.h: Madgwick and Mahony attitude estimation from MPUIMU samples
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MPU.h"
+
+// Updates at the device's own sample rate, one Sample_t at a time or a whole batch from
+// readFifo() or an MPUAcquisition ring.  Samples with a zero magnetometer vector (everything
+// but the MPU9250 in master mode) get the six-axis update.  Magnetometer readings are expected
+// as the MPU9250 reports them, already corrected by calibrateMagnetometer()'s bias and scale.
+class MPUFusion {
+
+    public:
+
+        typedef enum {
+
+            MADGWICK,
+            MAHONY
+
+        } Algorithm_t;
+
+        typedef struct {
+
+            float w;
+            float x;
+            float y;
+            float z;
+
+        } Quaternion_t;
+
+        // Degrees, Z-Y-X (yaw, then pitch, then roll)
+        typedef struct {
+
+            float roll;
+            float pitch;
+            float yaw;
+
+        } Euler_t;
+
+        MPUFusion(Algorithm_t algorithm=MADGWICK);
+
+        // Takes the time step from imu.getSampleRate(); call after begin() and any rate change
+        void begin(MPUIMU & imu);
+
+        void setSampleRate(float hz) { _dt = 1.f / hz; }
+
+        // Madgwick gradient-descent step size
+        void setBeta(float beta) { _beta = beta; }
+
+        // Mahony proportional and integral feedback gains
+        void setGains(float kp, float ki) { _twoKp = 2 * kp; _twoKi = 2 * ki; }
+
+        void reset(void);
+
+        void update(const MPUIMU::Sample_t & sample);
+
+        void update(const MPUIMU::Sample_t * samples, uint16_t count);
+
+        void update(MPUSpan<const MPUIMU::Sample_t> samples)
+        {
+            for (MPUSpan<const MPUIMU::Sample_t> rest = samples; !rest.empty(); rest = rest.from(0xFFFF)) {
+                update(rest.data(), rest.size16());
+            }
+        }
+
+        void getQuaternion(Quaternion_t & q);
+
+        void getEuler(Euler_t & euler);
+
+        // Approximate 1/sqrt(x), good to a few parts per million
+        static float invSqrt(float x);
+
+    private:
+
+        Algorithm_t _algorithm;
+
+        float _dt;
+        float _beta;
+        float _twoKp;
+        float _twoKi;
+
+        float _q0, _q1, _q2, _q3;
+
+        float _integralX, _integralY, _integralZ;
+
+        void madgwick(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
+
+        void madgwick(float gx, float gy, float gz, float ax, float ay, float az);
+
+        void mahony(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, bool useMag);
+
+        void normalize(void);
+
+}; // class MPUFusion
@@ -0,0 +1,205 @@
+/*
+   MPUGyroBiasTracker.cpp: Background gyro bias estimation with temperature compensation
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPUGyroBiasTracker.h"
+
+MPUGyroBiasTracker::MPUGyroBiasTracker(float sampleRate)
+{
+    setSampleRate(sampleRate);
+}
+
+void MPUGyroBiasTracker::begin(MPUIMU & imu)
+{
+    setSampleRate(imu.getSampleRate());
+}
+
+void MPUGyroBiasTracker::setSampleRate(float hz)
+{
+    float window = hz * WINDOW_SECONDS;
+    _window = window < 16 ? 16 : window > 65535 ? 65535 : (uint16_t)window;
+
+    reset();
+}
+
+void MPUGyroBiasTracker::reset(void)
+{
+    _count = 0;
+    _still = false;
+    _stillWindows = 0;
+    _temperature = 0;
+
+    _weight = 0;
+    _tempSum = 0;
+    _tempSquares = 0;
+    for (uint8_t k=0; k<3; ++k) {
+        _biasSum[k] = 0;
+        _biasTempSum[k] = 0;
+    }
+}
+
+void MPUGyroBiasTracker::startWindow(const MPUIMU::Sample_t & sample)
+{
+    for (uint8_t k=0; k<3; ++k) {
+        _gyroRef[k] = sample.gyro[k];
+        _accelRef[k] = sample.accel[k];
+        _gyroSum[k] = 0;
+        _gyroSquares[k] = 0;
+        _accelSum[k] = 0;
+        _accelSquares[k] = 0;
+    }
+    _temperatureSum = 0;
+}
+
+void MPUGyroBiasTracker::update(const MPUIMU::Sample_t & sample)
+{
+    if (_count == 0) {
+        startWindow(sample);
+    }
+
+    for (uint8_t k=0; k<3; ++k) {
+        float g = sample.gyro[k] - _gyroRef[k];
+        float a = sample.accel[k] - _accelRef[k];
+        _gyroSum[k] += g;
+        _gyroSquares[k] += g*g;
+        _accelSum[k] += a;
+        _accelSquares[k] += a*a;
+    }
+    _temperatureSum += sample.temperature;
+
+    _temperature = sample.temperature;
+
+    if (++_count == _window) {
+        finishWindow();
+        _count = 0;
+    }
+}
+
+void MPUGyroBiasTracker::update(const MPUIMU::Sample_t * samples, uint16_t count)
+{
+    for (uint16_t k=0; k<count; ++k) {
+        update(samples[k]);
+    }
+}
+
+void MPUGyroBiasTracker::finishWindow(void)
+{
+    float n = _count;
+    float mean[3];
+
+    _still = true;
+
+    for (uint8_t k=0; k<3; ++k) {
+
+        float g = _gyroSum[k] / n;
+        float a = _accelSum[k] / n;
+
+        if (_gyroSquares[k] / n - g*g > STILL_GYRO*STILL_GYRO ||
+                _accelSquares[k] / n - a*a > STILL_ACCEL*STILL_ACCEL) {
+            _still = false;
+        }
+
+        mean[k] = _gyroRef[k] + g;
+
+        if (mean[k] > MAX_BIAS || mean[k] < -MAX_BIAS) {
+            _still = false;
+        }
+    }
+
+    if (!_still) {
+        return;
+    }
+
+    float t = _temperatureSum / n;
+
+    _weight      = _weight * MEMORY + 1;
+    _tempSum     = _tempSum * MEMORY + t;
+    _tempSquares = _tempSquares * MEMORY + t*t;
+
+    for (uint8_t k=0; k<3; ++k) {
+        _biasSum[k]     = _biasSum[k] * MEMORY + mean[k];
+        _biasTempSum[k] = _biasTempSum[k] * MEMORY + mean[k]*t;
+    }
+
+    _stillWindows++;
+}
+
+void MPUGyroBiasTracker::getBias(float temperature, float bias[3]) const
+{
+    if (_weight == 0) {
+        bias[0] = bias[1] = bias[2] = 0;
+        return;
+    }
+
+    float meanTemp = _tempSum / _weight;
+    float tempVariance = _tempSquares / _weight - meanTemp*meanTemp;
+    bool  fitSlope = tempVariance > MIN_TEMP_SPREAD*MIN_TEMP_SPREAD;
+
+    for (uint8_t k=0; k<3; ++k) {
+
+        float meanBias = _biasSum[k] / _weight;
+        float slope = fitSlope ? (_biasTempSum[k] / _weight - meanBias*meanTemp) / tempVariance : 0;
+
+        bias[k] = meanBias + slope * (temperature - meanTemp);
+    }
+}
+
+void MPUGyroBiasTracker::correct(MPUIMU::Sample_t & sample) const
+{
+    float bias[3];
+    getBias(sample.temperature, bias);
+
+    for (uint8_t k=0; k<3; ++k) {
+        sample.gyro[k] -= bias[k];
+    }
+}
+
+void MPUGyroBiasTracker::correct(MPUIMU::Sample_t * samples, uint16_t count) const
+{
+    for (uint16_t k=0; k<count; ++k) {
+        correct(samples[k]);
+    }
+}
+
+bool MPUGyroBiasTracker::apply(MPUIMU & imu)
+{
+    float bias[3];
+    getBias(_temperature, bias);
+
+    if (bias[0] < MIN_APPLY && bias[0] > -MIN_APPLY &&
+            bias[1] < MIN_APPLY && bias[1] > -MIN_APPLY &&
+            bias[2] < MIN_APPLY && bias[2] > -MIN_APPLY) {
+        return false;
+    }
+
+    float applied[3];
+    imu.adjustGyroBias(bias, applied);
+
+    // The device now removes part of what the fit describes, so the points move by as much;
+    // the temperature dependence stays with the fit
+    for (uint8_t k=0; k<3; ++k) {
+        _biasSum[k]     -= applied[k] * _weight;
+        _biasTempSum[k] -= applied[k] * _tempSum;
+    }
+
+    // The window in progress straddles the change
+    _count = 0;
+
+    return true;
+}
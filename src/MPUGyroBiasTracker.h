@@ -0,0 +1,107 @@
+/*
+   MPUGyroBiasTracker.h: Background gyro bias estimation with temperature compensation
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MPU.h"
+
+// Learns the gyro bias left in the output, as a straight line in die temperature, from the
+// stretches of samples in which the device is still.  Samples are taken in windows of about
+// WINDOW_SECONDS; a window whose gyro and accelerometer readings all stay within STILL_GYRO and
+// STILL_ACCEL (standard deviations) counts as still, and its mean gyro reading and temperature
+// become one point of the fit.  Points fade by MEMORY per window, so the fit follows slow changes,
+// and the slope is only fitted once the points span MIN_TEMP_SPREAD.  Each sample costs a few
+// adds and multiplies; there is no allocation.
+//
+// Feed update() the samples as the device delivers them, then correct() them; or, when there is
+// bus time to spare, apply() moves the current estimate into the device itself, where the scaling
+// (or the hardware offset registers) removes it from every later sample.  Samples need their
+// temperature, so FIFO users should include FIFO_TEMP.
+class MPUGyroBiasTracker {
+
+    public:
+
+        static constexpr float WINDOW_SECONDS  = 0.5f;
+        static constexpr float STILL_GYRO      = 0.25f;  // degrees/second
+        static constexpr float STILL_ACCEL     = 0.015f; // g
+        static constexpr float MAX_BIAS        = 10.f;   // degrees/second; larger means turning
+        static constexpr float MEMORY          = 0.999f;
+        static constexpr float MIN_TEMP_SPREAD = 1.f;    // degrees C, standard deviation
+
+        // Smallest estimate apply() bothers the bus with, degrees/second
+        static constexpr float MIN_APPLY       = 0.02f;
+
+        MPUGyroBiasTracker(float sampleRate=1000);
+
+        // Window length from imu.getSampleRate(); also resets
+        void begin(MPUIMU & imu);
+
+        void setSampleRate(float hz);
+
+        void reset(void);
+
+        void update(const MPUIMU::Sample_t & sample);
+        void update(const MPUIMU::Sample_t * samples, uint16_t count);
+
+        // Residual bias at a temperature, zero until the first still window
+        void getBias(float temperature, float bias[3]) const;
+
+        void correct(MPUIMU::Sample_t & sample) const;
+        void correct(MPUIMU::Sample_t * samples, uint16_t count) const;
+
+        // Hands the residual at the latest temperature to imu.adjustGyroBias(); returns false,
+        // touching nothing, when it is too small to matter
+        bool apply(MPUIMU & imu);
+
+        bool isStill(void) const { return _still; }
+
+        bool hasEstimate(void) const { return _weight > 0; }
+
+        uint32_t getStillWindows(void) const { return _stillWindows; }
+
+    private:
+
+        uint16_t _window;
+
+        // Current window: sums relative to its first sample, to keep the variances accurate
+        uint16_t _count;
+        float    _gyroRef[3];
+        float    _accelRef[3];
+        float    _gyroSum[3];
+        float    _gyroSquares[3];
+        float    _accelSum[3];
+        float    _accelSquares[3];
+        float    _temperatureSum;
+
+        bool     _still;
+        uint32_t _stillWindows;
+        float    _temperature;
+
+        // Weighted least squares of bias against temperature
+        float _weight;
+        float _tempSum;
+        float _tempSquares;
+        float _biasSum[3];
+        float _biasTempSum[3];
+
+        void startWindow(const MPUIMU::Sample_t & sample);
+        void finishWindow(void);
+
+}; // class MPUGyroBiasTracker
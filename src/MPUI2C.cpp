@@ -0,0 +1,210 @@
+/*
+   MPUI2C.cpp: I^2C transfers beyond what the cpi2c_* calls offer
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPUI2C.h"
+
+#include <CrossPlatformI2C.h>
+
+#if !defined(ARDUINO)
+
+// The fallback for burst writes.  As in a burst, DMP memory (MEM_R_W) and the FIFO (FIFO_R_W)
+// take every byte through their one register.
+static bool writeEach(uint8_t handle, uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    bool step = subAddress != 0x6F && subAddress != 0x74;
+
+    bool ok = true;
+    for (uint8_t k=0; k<count; ++k) {
+        ok = cpi2c_writeRegister(handle, step ? subAddress+k : subAddress, data[k]) && ok;
+    }
+    return ok;
+}
+
+#endif
+
+#if defined(ARDUINO)
+
+#include <Wire.h>
+
+uint8_t mpui2c_open(uint8_t address, uint8_t bus, uint32_t & clock)
+{
+    uint8_t handle = cpi2c_open(address, bus);
+
+    if (clock) {
+        Wire.setClock(clock);
+    }
+
+    return handle;
+}
+
+void mpui2c_close(uint8_t)
+{
+}
+
+bool mpui2c_readRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    Wire.beginTransmission(handle);
+    Wire.write(subAddress);
+    if (Wire.endTransmission(false) != 0) { // repeated start
+        return false;
+    }
+
+    if (Wire.requestFrom(handle, count) != count) {
+        return false;
+    }
+
+    for (uint8_t k=0; k<count; ++k) {
+        dest[k] = Wire.read();
+    }
+
+    return true;
+}
+
+bool mpui2c_writeRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    Wire.beginTransmission(handle);
+    Wire.write(subAddress);
+    Wire.write(data, count);
+    return Wire.endTransmission() == 0;
+}
+
+#elif defined(__linux__)
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Per handle (a file descriptor): the device address, and whether the adapter takes I2C_RDWR
+static uint8_t _deviceAddresses[256];
+static uint8_t _combinedTransfers[32];
+
+static bool isCombined(uint8_t handle)
+{
+    return _combinedTransfers[handle>>3] & (1 << (handle & 7));
+}
+
+// The device tree stores clock-frequency as a big-endian 32-bit cell
+static uint32_t readClock(uint8_t bus)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/bus/i2c/devices/i2c-%u/of_node/clock-frequency", bus);
+
+    FILE * fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+
+    uint8_t cell[4];
+    uint32_t clock = fread(cell, 1, 4, fp) == 4 ? 
+        ((uint32_t)cell[0] << 24) | ((uint32_t)cell[1] << 16) | ((uint32_t)cell[2] << 8) | cell[3] : 0;
+
+    fclose(fp);
+
+    return clock;
+}
+
+uint8_t mpui2c_open(uint8_t address, uint8_t bus, uint32_t & clock)
+{
+    uint8_t handle = cpi2c_open(address, bus);
+
+    unsigned long funcs = 0;
+    if (ioctl(handle, I2C_FUNCS, &funcs) == 0 && (funcs & I2C_FUNC_I2C)) {
+        _combinedTransfers[handle>>3] |= 1 << (handle & 7);
+    }
+    else {
+        _combinedTransfers[handle>>3] &= ~(1 << (handle & 7));
+    }
+
+    _deviceAddresses[handle] = address;
+
+    clock = readClock(bus);
+
+    return handle;
+}
+
+void mpui2c_close(uint8_t handle)
+{
+    close(handle);
+}
+
+bool mpui2c_readRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    if (!isCombined(handle)) {
+        return cpi2c_readRegisters(handle, subAddress, count, dest);
+    }
+
+    struct i2c_msg messages[2] = {
+        { _deviceAddresses[handle], 0,        1,     &subAddress },
+        { _deviceAddresses[handle], I2C_M_RD, count, dest }
+    };
+
+    struct i2c_rdwr_ioctl_data transfer = { messages, 2 };
+
+    return ioctl(handle, I2C_RDWR, &transfer) == 2;
+}
+
+bool mpui2c_writeRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    if (!isCombined(handle)) {
+        return writeEach(handle, subAddress, count, data);
+    }
+
+    if (count > MPUI2C_MAX_WRITE) {
+        return false;
+    }
+
+    uint8_t buffer[1 + MPUI2C_MAX_WRITE];
+    buffer[0] = subAddress;
+    for (uint8_t k=0; k<count; ++k) {
+        buffer[1+k] = data[k];
+    }
+
+    struct i2c_msg message = { _deviceAddresses[handle], 0, (uint16_t)(1 + count), buffer };
+
+    struct i2c_rdwr_ioctl_data transfer = { &message, 1 };
+
+    return ioctl(handle, I2C_RDWR, &transfer) == 1;
+}
+
+#else
+
+uint8_t mpui2c_open(uint8_t address, uint8_t bus, uint32_t & clock)
+{
+    clock = 0;
+    return cpi2c_open(address, bus);
+}
+
+void mpui2c_close(uint8_t)
+{
+}
+
+bool mpui2c_readRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    return cpi2c_readRegisters(handle, subAddress, count, dest);
+}
+
+bool mpui2c_writeRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    return writeEach(handle, subAddress, count, data);
+}
+
+#endif
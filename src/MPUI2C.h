@@ -0,0 +1,45 @@
+/*
+   MPUI2C.h: I^2C transfers beyond what the cpi2c_* calls offer
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// The I^2C devices' transport.  Register reads are a single write-then-read transaction joined by
+// a repeated start, and consecutive registers are written in one transaction, on Arduino (Wire)
+// and on Linux (I2C_RDWR on adapters that support plain I^2C); elsewhere, and on Linux adapters
+// that are SMBus-only, these fall back to the cpi2c_* calls one register at a time.
+
+// Opens the device through cpi2c_open().  clock is the bus clock wanted, in Hz, and comes back as
+// the clock in effect as far as it is known, else zero: Arduino sets it, while on Linux it is a
+// property of the adapter (e.g. dtparam=i2c_arm_baudrate=400000 on a Raspberry Pi) that is read
+// from the device tree.
+uint8_t mpui2c_open(uint8_t address, uint8_t bus, uint32_t & clock);
+
+// Releases a handle from mpui2c_open() or cpi2c_open(): on Linux it is a file descriptor; elsewhere
+// it is the device address, and there is nothing to release
+void mpui2c_close(uint8_t handle);
+
+bool mpui2c_readRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, uint8_t * dest);
+
+// At most MPUI2C_MAX_WRITE registers, within the 32-byte Wire buffer
+static const uint8_t MPUI2C_MAX_WRITE = 31;
+
+bool mpui2c_writeRegisters(uint8_t handle, uint8_t subAddress, uint8_t count, const uint8_t * data);
@@ -0,0 +1,455 @@
+/*
+   MPULog.cpp: Chunked binary log of raw FIFO frames, with a buffered writer and a zero-copy reader
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPULog.h"
+
+#include <string.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// The record layouts are the file format, so they must not pick up padding on any target
+static_assert(sizeof(MPULog::Header_t) == 84, "MPULog::Header_t layout");
+static_assert(sizeof(MPULog::ChunkHeader_t) == 16, "MPULog::ChunkHeader_t layout");
+
+void MPULog::describe(MPUIMU & imu, Header_t & header)
+{
+    memset(&header, 0, sizeof(header));
+
+    MPUIMU::Scaling_t scaling;
+    imu.getScaling(scaling);
+
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.headerSize = sizeof(header);
+    header.sensors = scaling.sensors;
+    header.frameSize = MPUIMU::getFrameSize(scaling.sensors);
+    header.sampleRate = imu.getSampleRate();
+    header.aRes = scaling.aRes;
+    header.gRes = scaling.gRes;
+    header.tempSensitivity = scaling.tempSensitivity;
+    header.tempOffset = scaling.tempOffset;
+
+    MPUIMU::Calibration_t calibration;
+    imu.getCalibration(calibration);
+
+    for (uint8_t k=0; k<3; ++k) {
+        header.accelBias[k] = scaling.accelBias[k];
+        header.gyroBias[k] = scaling.gyroBias[k];
+        header.magAdjustment[k] = calibration.magAdjustment[k];
+        header.magScale[k] = 1;
+    }
+}
+
+void MPULog::describe(MPU9250 & imu, Header_t & header)
+{
+    describe((MPUIMU &)imu, header);
+
+    MPU9250::MagScaling_t scaling;
+    imu.getMagScaling(scaling);
+
+    header.hasMag = 1;
+    for (uint8_t k=0; k<3; ++k) {
+        header.magScale[k] = scaling.scale[k];
+        header.magBias[k] = scaling.bias[k];
+    }
+}
+
+void MPULog::getScaling(const Header_t & header, MPUIMU::Scaling_t & scaling)
+{
+    scaling.sensors = header.sensors;
+    scaling.aRes = header.aRes;
+    scaling.gRes = header.gRes;
+    for (uint8_t k=0; k<3; ++k) {
+        scaling.accelBias[k] = header.accelBias[k];
+        scaling.gyroBias[k] = header.gyroBias[k];
+    }
+    scaling.tempSensitivity = header.tempSensitivity;
+    scaling.tempOffset = header.tempOffset;
+}
+
+void MPULog::getMagScaling(const Header_t & header, MPU9250::MagScaling_t & scaling)
+{
+    for (uint8_t k=0; k<3; ++k) {
+        scaling.scale[k] = header.magScale[k];
+        scaling.bias[k] = header.magBias[k];
+    }
+}
+
+MPULogWriter::MPULogWriter(uint8_t * buffer, uint32_t size)
+{
+    _buffer = buffer;
+    _size = size;
+    _used = 0;
+
+    _sink = NULL;
+    _context = NULL;
+
+    _frameSize = 0;
+    _period = 0;
+
+    _inChunk = false;
+    _chunkOffset = 0;
+
+    _framesBuffered = 0;
+    _framesWritten = 0;
+    _bytesWritten = 0;
+    _framesDropped = 0;
+
+#if defined(__linux__)
+    _fd = -1;
+#endif
+}
+
+void MPULogWriter::setSink(Sink_t sink, void * context)
+{
+    _sink = sink;
+    _context = context;
+}
+
+bool MPULogWriter::begin(MPUIMU & imu)
+{
+    MPULog::Header_t header;
+    MPULog::describe(imu, header);
+    return begin(header);
+}
+
+bool MPULogWriter::begin(MPU9250 & imu)
+{
+    MPULog::Header_t header;
+    MPULog::describe(imu, header);
+    return begin(header);
+}
+
+bool MPULogWriter::begin(const MPULog::Header_t & header)
+{
+    if (_sink == NULL || _size < sizeof(header) || header.frameSize == 0) {
+        return false;
+    }
+
+    _frameSize = header.frameSize;
+    _period = header.sampleRate > 0 ? 1e6f / header.sampleRate : 0;
+
+    _used = 0;
+    _inChunk = false;
+    _framesBuffered = 0;
+
+    memcpy(_buffer, &header, sizeof(header));
+    _used = sizeof(header);
+
+    return flush();
+}
+
+bool MPULogWriter::append(const uint8_t * frames, uint16_t count, uint64_t timestamp)
+{
+    if (_frameSize == 0) {
+        return false;
+    }
+
+    bool ok = true;
+
+    for (uint16_t done=0; done<count; ) {
+
+        if (_inChunk && _chunk.frames == MAX_CHUNK_FRAMES) {
+            closeChunk();
+        }
+
+        if (!_inChunk) {
+
+            if (_size - _used < sizeof(_chunk) + _frameSize) {
+                ok = flush() && ok;
+            }
+
+            _chunk.magic = MPULog::CHUNK_MAGIC;
+            _chunk.frames = 0;
+            _chunk.timestamp = timestamp + (uint64_t)(done * _period + 0.5f);
+
+            _chunkOffset = _used;
+            _used += sizeof(_chunk);
+            _inChunk = true;
+        }
+
+        uint32_t room = (_size - _used) / _frameSize;
+        uint32_t n = count - done;
+        if (n > room) {
+            n = room;
+        }
+        if (n > MAX_CHUNK_FRAMES - _chunk.frames) {
+            n = MAX_CHUNK_FRAMES - _chunk.frames;
+        }
+
+        if (n == 0) {
+            ok = flush() && ok;
+            continue;
+        }
+
+        memcpy(&_buffer[_used], &frames[done*_frameSize], n*_frameSize);
+        _used += n*_frameSize;
+        _chunk.frames += n;
+        _framesBuffered += n;
+        done += n;
+    }
+
+    return ok;
+}
+
+void MPULogWriter::closeChunk(void)
+{
+    if (_inChunk) {
+        memcpy(&_buffer[_chunkOffset], &_chunk, sizeof(_chunk));
+        _inChunk = false;
+    }
+}
+
+bool MPULogWriter::flush(void)
+{
+    closeChunk();
+
+    if (_used == 0) {
+        return true;
+    }
+
+    bool ok = _sink != NULL && _sink(_buffer, _used, _context);
+
+    if (ok) {
+        _framesWritten += _framesBuffered;
+        _bytesWritten += _used;
+    }
+    else {
+        _framesDropped += _framesBuffered;
+    }
+
+    _used = 0;
+    _framesBuffered = 0;
+
+    return ok;
+}
+
+#if defined(__linux__)
+
+MPULogWriter::~MPULogWriter(void)
+{
+    close();
+}
+
+bool MPULogWriter::open(const char * path)
+{
+    close();
+
+    _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) {
+        return false;
+    }
+
+    setSink(fileSink, this);
+
+    return true;
+}
+
+void MPULogWriter::close(void)
+{
+    if (_fd >= 0) {
+        flush();
+        ::close(_fd);
+        _fd = -1;
+        setSink(NULL);
+    }
+}
+
+bool MPULogWriter::fileSink(const uint8_t * data, uint32_t size, void * context)
+{
+    int fd = ((MPULogWriter *)context)->_fd;
+
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+#endif // __linux__
+
+MPULogReader::MPULogReader(void)
+{
+    _data = NULL;
+    _size = 0;
+    _pos = 0;
+    _truncated = false;
+
+    memset(&_header, 0, sizeof(_header));
+    memset(&_scaling, 0, sizeof(_scaling));
+
+#if defined(__linux__)
+    _map = NULL;
+    _mapSize = 0;
+#endif
+}
+
+bool MPULogReader::open(const uint8_t * data, size_t size)
+{
+#if defined(__linux__)
+    close();
+#endif
+
+    MPULog::Header_t header;
+
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    // Later versions may only append to the header
+    if (header.magic != MPULog::MAGIC || header.version < MPULog::VERSION ||
+            header.headerSize < sizeof(header) || header.headerSize > size ||
+            header.frameSize != MPUIMU::getFrameSize(header.sensors) || header.frameSize == 0) {
+        return false;
+    }
+
+    _header = header;
+    MPULog::getScaling(_header, _scaling);
+
+    _data = data;
+    _size = size;
+    rewind();
+
+    return true;
+}
+
+void MPULogReader::rewind(void)
+{
+    _pos = _header.headerSize;
+    _truncated = false;
+}
+
+bool MPULogReader::next(Chunk_t & chunk)
+{
+    while (_data != NULL && _pos < _size) {
+
+        MPULog::ChunkHeader_t header;
+
+        if (_size - _pos < sizeof(header)) {
+            _truncated = true;
+            return false;
+        }
+
+        memcpy(&header, &_data[_pos], sizeof(header));
+
+        if (header.magic != MPULog::CHUNK_MAGIC || header.frames > MPULogWriter::MAX_CHUNK_FRAMES ||
+                _size - _pos - sizeof(header) < (size_t)header.frames * _header.frameSize) {
+            _truncated = true;
+            return false;
+        }
+
+        chunk.timestamp = header.timestamp;
+        chunk.count = (uint16_t)header.frames;
+        chunk.frames = &_data[_pos + sizeof(header)];
+
+        _pos += sizeof(header) + (size_t)header.frames * _header.frameSize;
+
+        if (chunk.count > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint16_t MPULogReader::convert(const Chunk_t & chunk, uint16_t first, uint16_t count, MPUIMU::SampleArrays_t & out) const
+{
+    if (first >= chunk.count) {
+        return 0;
+    }
+
+    if (count > chunk.count - first) {
+        count = chunk.count - first;
+    }
+
+    MPUIMU::convertFrames(&chunk.frames[(uint32_t)first * _header.frameSize], count, _scaling, out);
+
+    return count;
+}
+
+#if defined(__linux__)
+
+MPULogReader::~MPULogReader(void)
+{
+    close();
+}
+
+bool MPULogReader::open(const char * path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(MPULog::Header_t)) {
+        ::close(fd);
+        return false;
+    }
+
+    void * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    // The chunks are read front to back
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    if (!open((const uint8_t *)map, st.st_size)) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    _map = map;
+    _mapSize = st.st_size;
+
+    return true;
+}
+
+void MPULogReader::close(void)
+{
+    if (_map != NULL) {
+        munmap(_map, _mapSize);
+        _map = NULL;
+        _mapSize = 0;
+    }
+
+    _data = NULL;
+    _size = 0;
+    _pos = 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,220 @@
+/*
+   MPULog.h: Chunked binary log of raw FIFO frames, with a buffered writer and a zero-copy reader
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MPU.h"
+#include "MPU9250.h"
+
+#include <stddef.h>
+
+// File format, little-endian as on every target the library runs on: one Header_t, then chunks,
+// each a ChunkHeader_t followed by its frames exactly as readFifoRaw() returns them.  A chunk's
+// frames are consecutive samples, the first of them taken at the chunk's timestamp; a gap in the
+// data (an overflow, a FIFO reset) always starts a new chunk.  Raw frames take about a tenth of
+// the space of printed floats, and the header carries everything convertFrames() needs.
+class MPULog {
+
+    public:
+
+        static const uint32_t MAGIC       = 0x4C55504D; // "MPUL"
+        static const uint32_t CHUNK_MAGIC = 0x4B4E4843; // "CHNK"
+        static const uint16_t VERSION     = 1;
+
+        typedef struct {
+
+            uint32_t magic;
+            uint16_t version;
+            uint16_t headerSize;
+            uint8_t  sensors;           // FifoSensor_t mask describing the frame layout
+            uint8_t  frameSize;
+            uint8_t  hasMag;            // nonzero when the mag fields were filled from an MPU9250
+            uint8_t  reserved;
+            uint8_t  magAdjustment[3];  // AK8963 ASAX, ASAY, ASAZ fuse ROM values
+            uint8_t  reserved2;
+            float    sampleRate;        // Hz
+            float    aRes;
+            float    gRes;
+            float    accelBias[3];
+            float    gyroBias[3];
+            float    tempSensitivity;
+            float    tempOffset;
+            float    magScale[3];       // MPU9250::MagScaling_t, ASA and calibration folded in
+            float    magBias[3];
+
+        } Header_t;
+
+        typedef struct {
+
+            uint32_t magic;
+            uint32_t frames;
+            uint64_t timestamp;         // microseconds, on whatever clock the writer was given
+
+        } ChunkHeader_t;
+
+        // Describes the device's current FIFO layout and scaling
+        static void describe(MPUIMU & imu, Header_t & header);
+        static void describe(MPU9250 & imu, Header_t & header);
+
+        static void getScaling(const Header_t & header, MPUIMU::Scaling_t & scaling);
+        static void getMagScaling(const Header_t & header, MPU9250::MagScaling_t & scaling);
+
+}; // class MPULog
+
+// Appends FIFO frames to a log through a caller-supplied buffer, so the sink (a file, an SD card,
+// a socket) sees a few large writes rather than one per read.  No allocation; nothing here blocks
+// except the sink.
+class MPULogWriter {
+
+    public:
+
+        // Returns false when the data could not be written
+        typedef bool (*Sink_t)(const uint8_t * data, uint32_t size, void * context);
+
+        // Chunks are closed at this many frames, to bound the timestamp error of a drifting clock
+        static const uint16_t MAX_CHUNK_FRAMES = 4096;
+
+        // The buffer must hold at least a Header_t; a few kilobytes keeps the sink writes large
+        MPULogWriter(uint8_t * buffer, uint32_t size);
+
+#if defined(__linux__)
+        ~MPULogWriter(void);
+#endif
+
+        void setSink(Sink_t sink, void * context=NULL);
+
+#if defined(__linux__)
+        // Sink to a file, created or truncated; close() flushes
+        bool open(const char * path);
+        void close(void);
+#endif
+
+        // Writes the header; the FIFO must already be enabled with the sensors to be logged
+        bool begin(MPUIMU & imu);
+        bool begin(MPU9250 & imu);
+        bool begin(const MPULog::Header_t & header);
+
+        // Frames as readFifoRaw() returns them; timestamp is that of the first, and is only
+        // recorded when the frames start a chunk
+        bool append(const uint8_t * frames, uint16_t count, uint64_t timestamp);
+
+        // The next frames do not follow on from the last ones
+        void split(void) { closeChunk(); }
+
+        // Hands everything buffered to the sink.  Should the sink fail, the buffered frames are
+        // dropped rather than kept, so that a stalled sink cannot stall the reads.
+        bool flush(void);
+
+        uint64_t getFramesWritten(void) const { return _framesWritten; }
+        uint64_t getBytesWritten(void) const { return _bytesWritten; }
+        uint32_t getFramesDropped(void) const { return _framesDropped; }
+
+    private:
+
+        uint8_t * _buffer;
+        uint32_t  _size;
+        uint32_t  _used;
+
+        Sink_t _sink;
+        void * _context;
+
+        uint8_t _frameSize;
+        float   _period;        // microseconds
+
+        // Open chunk, at _chunkOffset in the buffer
+        bool          _inChunk;
+        uint32_t      _chunkOffset;
+        MPULog::ChunkHeader_t _chunk;
+
+        uint32_t _framesBuffered;
+        uint64_t _framesWritten;
+        uint64_t _bytesWritten;
+        uint32_t _framesDropped;
+
+#if defined(__linux__)
+        int _fd;
+        static bool fileSink(const uint8_t * data, uint32_t size, void * context);
+#endif
+
+        void closeChunk(void);
+
+}; // class MPULogWriter
+
+// Walks the chunks of a log in memory, or (on Linux) of a file mapped into memory, handing out
+// pointers into it rather than copies.  A log cut short by a crash reads up to its last whole chunk.
+class MPULogReader {
+
+    public:
+
+        typedef struct {
+
+            uint64_t        timestamp;
+            uint16_t        count;
+            const uint8_t * frames;
+
+        } Chunk_t;
+
+        MPULogReader(void);
+
+#if defined(__linux__)
+        ~MPULogReader(void);
+
+        bool open(const char * path);
+        void close(void);
+#endif
+
+        // The data stays the caller's; returns false, reading nothing, if the header is not valid
+        bool open(const uint8_t * data, size_t size);
+
+        const MPULog::Header_t & getHeader(void) const { return _header; }
+
+        float getSampleRate(void) const { return _header.sampleRate; }
+
+        void getScaling(MPUIMU::Scaling_t & scaling) const { scaling = _scaling; }
+
+        void getMagScaling(MPU9250::MagScaling_t & scaling) const { MPULog::getMagScaling(_header, scaling); }
+
+        // False at the end of the log
+        bool next(Chunk_t & chunk);
+
+        void rewind(void);
+
+        // Set once next() has met bytes that do not form a whole chunk
+        bool isTruncated(void) const { return _truncated; }
+
+        // Converts count frames of a chunk, starting at frame first; returns how many there were
+        uint16_t convert(const Chunk_t & chunk, uint16_t first, uint16_t count, MPUIMU::SampleArrays_t & out) const;
+
+    private:
+
+        const uint8_t * _data;
+        size_t          _size;
+        size_t          _pos;
+        bool            _truncated;
+
+        MPULog::Header_t  _header;
+        MPUIMU::Scaling_t _scaling;
+
+#if defined(__linux__)
+        void * _map;
+        size_t _mapSize;
+#endif
+
+}; // class MPULogReader
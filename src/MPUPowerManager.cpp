@@ -0,0 +1,127 @@
+/*
+   MPUPowerManager.cpp: Motion-triggered switching between low-power standby and FIFO streaming
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPUPowerManager.h"
+
+MPUPowerManager::MPUPowerManager(MPU9250 & imu, uint8_t fifoSensors) : _imu(imu)
+{
+    _fifoSensors = fifoSensors;
+    _thresholdMg = 100;
+    _rate        = MPU9250::LP_ACCEL_31_25HZ;
+    _quietPeriod = 5000000;
+    _gyroThresholdDps = 10;
+
+    _state      = POWER_STANDBY;
+    _wakeTime   = 0;
+    _lastMotion = 0;
+    _wakeCount  = 0;
+}
+
+void MPUPowerManager::begin(uint64_t hostUsec)
+{
+    _lastMotion = hostUsec;
+
+    standby();
+}
+
+MPUPowerManager::State_t MPUPowerManager::update(uint64_t hostUsec)
+{
+    bool motion = _imu.checkWakeOnMotion();
+
+    if (motion) {
+        _lastMotion = hostUsec;
+    }
+
+    switch (_state) {
+
+        case POWER_STANDBY:
+            if (motion) {
+                wake(hostUsec);
+            }
+            break;
+
+        case POWER_WAKING:
+            if (hostUsec - _wakeTime >= MPU9250::GYRO_STARTUP_USEC) {
+                _state = POWER_STREAMING;
+            }
+            break;
+
+        case POWER_STREAMING:
+            if (hostUsec - _lastMotion >= _quietPeriod) {
+                standby();
+            }
+            break;
+    }
+
+    return _state;
+}
+
+bool MPUPowerManager::checkSamples(const MPUIMU::Sample_t * samples, uint16_t count, uint64_t hostUsec)
+{
+    if (_state == POWER_STANDBY) {
+        return false;
+    }
+
+    // Squared magnitudes against squared bounds, for the sensors that the FIFO carries
+    bool useAccel = (_fifoSensors & MPUIMU::FIFO_ACCEL) != 0;
+    bool useGyro  = (_fifoSensors & MPUIMU::FIFO_GYRO) != 0 && _state == POWER_STREAMING;
+
+    float g = _thresholdMg / 1000.f;
+    float low = g < 1 ? (1 - g) * (1 - g) : 0;
+    float high = (1 + g) * (1 + g);
+    float rotation = _gyroThresholdDps * _gyroThresholdDps;
+
+    for (uint16_t k=0; k<count; ++k) {
+
+        const float * a = samples[k].accel;
+        const float * w = samples[k].gyro;
+
+        float accel = a[0]*a[0] + a[1]*a[1] + a[2]*a[2];
+        float gyro  = w[0]*w[0] + w[1]*w[1] + w[2]*w[2];
+
+        if ((useAccel && (accel < low || accel > high)) || (useGyro && gyro > rotation)) {
+            _lastMotion = hostUsec;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void MPUPowerManager::standby(void)
+{
+    _imu.disableFifo();
+
+    _imu.enterMotionCycle(_thresholdMg, _rate);
+
+    _state = POWER_STANDBY;
+}
+
+void MPUPowerManager::wake(uint64_t hostUsec)
+{
+    _imu.exitMotionCycle();
+
+    _imu.enableFifo(_fifoSensors);
+
+    _wakeTime = hostUsec;
+    _wakeCount++;
+
+    _state = POWER_WAKING;
+}
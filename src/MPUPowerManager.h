@@ -0,0 +1,98 @@
+/*
+   MPUPowerManager.h: Motion-triggered switching between low-power standby and FIFO streaming
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MPU9250.h"
+
+// Keeps an MPU9250 in the low-power accelerometer cycle until wake-on-motion fires, streams through
+// the FIFO at full rate while there is motion, and returns to standby once there has been none for
+// the quiet period.  update() is meant to be polled (or called from the INT pin's handler) with the
+// host time; it reads INT_STATUS once and never waits, so the transitions cost only their register
+// writes.  Because INT_STATUS clears on read, the application should take its data from the FIFO,
+// not from checkNewData().
+//
+// Wake-on-motion stays armed while streaming, but it compares each sample with the one before, so
+// slow sustained motion can pass it by; pass the samples read from the FIFO to checkSamples() to
+// keep the device awake for as long as they move.  The FIFO starts over at each wake, from the
+// first full-rate sample after the one that woke the device; gyro samples in the first
+// GYRO_STARTUP_USEC (state POWER_WAKING) have not settled.
+class MPUPowerManager {
+
+    public:
+
+        typedef enum {
+
+            POWER_STANDBY,
+            POWER_WAKING,
+            POWER_STREAMING
+
+        } State_t;
+
+        MPUPowerManager(MPU9250 & imu, uint8_t fifoSensors=MPUIMU::FIFO_ACCEL|MPUIMU::FIFO_GYRO);
+
+        // Take effect at the next transition to standby
+        void setThreshold(uint16_t mg) { _thresholdMg = mg; }
+        void setLowPowerRate(MPU9250::LowPowerAccelRate_t rate) { _rate = rate; }
+
+        // Microseconds without motion before streaming stops
+        void setQuietPeriod(uint32_t usec) { _quietPeriod = usec; }
+
+        // Rotation above which checkSamples() counts a sample as motion; the acceleration threshold
+        // is the wake-on-motion one, against the magnitude's distance from 1 g
+        void setGyroThreshold(float dps) { _gyroThresholdDps = dps; }
+
+        // Call after the device's begin(); starts in standby
+        void begin(uint64_t hostUsec);
+
+        State_t update(uint64_t hostUsec);
+
+        // Samples the application read while streaming, at the host time of that read; returns
+        // whether any of them moved.  The gyro is not consulted until it has settled.
+        bool checkSamples(const MPUIMU::Sample_t * samples, uint16_t count, uint64_t hostUsec);
+
+        State_t getState(void) { return _state; }
+
+        bool isStreaming(void) { return _state != POWER_STANDBY; }
+
+        // Host time of the update() that saw the latest wake
+        uint64_t getWakeTime(void) { return _wakeTime; }
+
+        uint32_t getWakeCount(void) { return _wakeCount; }
+
+    private:
+
+        MPU9250 & _imu;
+
+        uint8_t                      _fifoSensors;
+        uint16_t                     _thresholdMg;
+        MPU9250::LowPowerAccelRate_t _rate;
+        uint32_t                     _quietPeriod;
+        float                        _gyroThresholdDps;
+
+        State_t  _state;
+        uint64_t _wakeTime;
+        uint64_t _lastMotion;
+        uint32_t _wakeCount;
+
+        void standby(void);
+        void wake(uint64_t hostUsec);
+
+}; // class MPUPowerManager
@@ -0,0 +1,101 @@
+/* 
+   MPURingBuffer.h: Lock-free single-producer/single-consumer ring buffer
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// One thread may push() while another pops; neither ever blocks or takes a lock.
+// SIZE must be a power of two.
+template <typename T, uint32_t SIZE>
+class MPURingBuffer {
+
+    static_assert(SIZE > 0 && (SIZE & (SIZE-1)) == 0, "MPURingBuffer SIZE must be a power of two");
+
+    public:
+
+        MPURingBuffer(void) : _head(0), _tail(0) { }
+
+        // Producer side; returns false (dropping the item) when the ring is full
+        bool push(const T & item)
+        {
+            uint32_t head = _head.load(std::memory_order_relaxed);
+
+            if (head - _tail.load(std::memory_order_acquire) == SIZE) {
+                return false;
+            }
+
+            _items[head & (SIZE-1)] = item;
+            _head.store(head+1, std::memory_order_release);
+
+            return true;
+        }
+
+        // Consumer side; returns false when the ring is empty
+        bool pop(T & item)
+        {
+            uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+            if (_head.load(std::memory_order_acquire) == tail) {
+                return false;
+            }
+
+            item = _items[tail & (SIZE-1)];
+            _tail.store(tail+1, std::memory_order_release);
+
+            return true;
+        }
+
+        // Consumer side; pops up to maxItems in one pass and returns how many it got
+        uint32_t pop(T * items, uint32_t maxItems)
+        {
+            uint32_t tail = _tail.load(std::memory_order_relaxed);
+            uint32_t count = _head.load(std::memory_order_acquire) - tail;
+
+            if (count > maxItems) {
+                count = maxItems;
+            }
+
+            for (uint32_t k=0; k<count; ++k) {
+                items[k] = _items[(tail+k) & (SIZE-1)];
+            }
+
+            _tail.store(tail+count, std::memory_order_release);
+
+            return count;
+        }
+
+        uint32_t size(void) const
+        {
+            return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+        }
+
+        static uint32_t capacity(void) { return SIZE; }
+
+    private:
+
+        T _items[SIZE];
+
+        // Keep the indices on separate cache lines so producer and consumer don't false-share
+        alignas(64) std::atomic<uint32_t> _head;
+        alignas(64) std::atomic<uint32_t> _tail;
+
+}; // class MPURingBuffer
@@ -0,0 +1,143 @@
+/*
+   MPUSPI.cpp: Full-duplex SPI transfers, and clock switching
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPUSPI.h"
+
+#include <CrossPlatformSPI.h>
+
+#include <string.h>
+
+static const uint8_t READ_FLAG        = 0x80;
+static const uint8_t INT_STATUS       = 0x3A;
+static const uint8_t EXT_SENS_DATA_23 = 0x60;
+static const uint8_t MEM_R_W          = 0x6F;
+static const uint8_t FIFO_COUNTH      = 0x72;
+static const uint8_t FIFO_R_W         = 0x74;
+
+static MPUSPIClock_t _setClock;
+static uint32_t      _sensorClock;
+static uint32_t      _clock;
+
+// Transfers up to this many bytes use frames of this size on the stack, and longer ones frames of
+// MPUSPI_MAX_READ, so register reads take little of it whatever a FIFO burst needs
+static const uint8_t SMALL_TRANSFER = 32;
+
+static void useClock(uint32_t hz)
+{
+    if (_setClock && hz != _clock) {
+        _setClock(hz);
+        _clock = hz;
+    }
+}
+
+static bool isSensorRegister(uint8_t subAddress)
+{
+    return (subAddress >= INT_STATUS && subAddress <= EXT_SENS_DATA_23) || 
+        (subAddress >= FIFO_COUNTH && subAddress <= FIFO_R_W);
+}
+
+// The frame sent is the register, with the read flag, then dummy bytes; the data follow the byte
+// clocked in behind the register
+template <uint8_t SIZE>
+static bool transferRead(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    uint8_t frame[1+SIZE];
+    uint8_t response[1+SIZE];
+
+    frame[0] = subAddress | READ_FLAG;
+    memset(&frame[1], 0xFF, count);
+
+    if (!cpspi_transfer(frame, response, 1+count)) {
+        return false;
+    }
+
+    memcpy(dest, &response[1], count);
+
+    return true;
+}
+
+template <uint8_t SIZE>
+static bool transferWrite(uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    uint8_t frame[1+SIZE];
+    uint8_t response[1+SIZE];
+
+    frame[0] = subAddress & ~READ_FLAG;
+    memcpy(&frame[1], data, count);
+
+    return cpspi_transfer(frame, response, 1+count);
+}
+
+void mpuspi_setClockControl(MPUSPIClock_t setClock)
+{
+    _setClock = setClock;
+    _clock = 0; // unknown until the first transfer sets it
+}
+
+void mpuspi_setSensorClock(uint32_t hz)
+{
+    _sensorClock = hz;
+}
+
+bool mpuspi_readRegisters(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    useClock(_sensorClock && isSensorRegister(subAddress) ? _sensorClock : MPUSPI_REGISTER_CLOCK);
+
+    while (count) {
+
+        uint8_t n = count > MPUSPI_MAX_READ ? MPUSPI_MAX_READ : count;
+
+        bool ok = n <= SMALL_TRANSFER ? 
+            transferRead<SMALL_TRANSFER>(subAddress, n, dest) : transferRead<MPUSPI_MAX_READ>(subAddress, n, dest);
+
+        if (!ok) {
+            return false;
+        }
+
+        // DMP memory and the FIFO are read through a single register
+        if (subAddress != FIFO_R_W && subAddress != MEM_R_W) {
+            subAddress += n;
+        }
+
+        dest += n;
+        count -= n;
+    }
+
+    return true;
+}
+
+void mpuspi_writeRegister(uint8_t subAddress, uint8_t data)
+{
+    useClock(MPUSPI_REGISTER_CLOCK);
+
+    cpspi_writeRegister(subAddress, data);
+}
+
+bool mpuspi_writeRegisters(uint8_t subAddress, uint8_t count, const uint8_t * data)
+{
+    if (count > MPUSPI_MAX_READ) {
+        return false;
+    }
+
+    useClock(MPUSPI_REGISTER_CLOCK);
+
+    return count <= SMALL_TRANSFER ? 
+        transferWrite<SMALL_TRANSFER>(subAddress, count, data) : transferWrite<MPUSPI_MAX_READ>(subAddress, count, data);
+}
@@ -0,0 +1,53 @@
+/*
+   MPUSPI.h: Full-duplex SPI transfers with cached command frames, and clock switching
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// The SPI devices' transport.  Every read is one full-duplex cpspi_transfer(): a command frame of
+// the register with the read flag followed by dummy bytes, so the platform neither formats the
+// frame nor sets the read flag.  Consecutive registers are written the same way, in one transfer.
+// Frames are built on the caller's stack, so nothing is shared between calls (e.g. from an ISR).  CrossPlatformSPI owns the chip select, so there is one device.
+
+// The MPU6000, MPU6500, and MPU9250 take every register at up to 1 MHz, but the sensor and
+// interrupt registers (INT_STATUS through EXT_SENS_DATA_23, and the FIFO) can be read at up to
+// 20 MHz.  CrossPlatformSPI has no call to change the clock, so the platform passes one in;
+// without it, everything runs at whatever clock the platform set up.
+static const uint32_t MPUSPI_REGISTER_CLOCK = 1000000;
+static const uint32_t MPUSPI_SENSOR_CLOCK   = 20000000;
+
+typedef void (*MPUSPIClock_t)(uint32_t hz);
+
+void mpuspi_setClockControl(MPUSPIClock_t setClock);
+
+// Clock for the sensor registers, which the devices set once begin() has configured them;
+// zero keeps every transfer at MPUSPI_REGISTER_CLOCK.  Only changes of clock are passed on.
+void mpuspi_setSensorClock(uint32_t hz);
+
+// Longer reads are split into transfers of MPUSPI_MAX_READ bytes
+static const uint8_t MPUSPI_MAX_READ = 254;
+
+bool mpuspi_readRegisters(uint8_t subAddress, uint8_t count, uint8_t * dest);
+
+void mpuspi_writeRegister(uint8_t subAddress, uint8_t data);
+
+// At most MPUSPI_MAX_READ registers
+bool mpuspi_writeRegisters(uint8_t subAddress, uint8_t count, const uint8_t * data);
@@ -0,0 +1,176 @@
+/* 
+   MPUSampleBlock.h: Move-only blocks of samples from a fixed pool
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MPU.h"
+
+#include <atomic>
+
+// An owned run of samples for passing a batch down a processing pipeline by moving it rather than
+// copying it.  Blocks come from an MPUSamplePool, which must outlive them, and go back to it when
+// destroyed or released.  Any thread may acquire or release; each block belongs to one at a time.
+class MPUSampleBlock {
+
+    template <uint16_t BLOCK_SIZE, uint8_t BLOCKS> friend class MPUSamplePool;
+
+    public:
+
+        // Empty, owning nothing
+        MPUSampleBlock(void) : _data(NULL), _capacity(0), _size(0), _free(NULL), _bit(0) { }
+
+        MPUSampleBlock(MPUSampleBlock && other) : MPUSampleBlock()
+        {
+            swap(other);
+        }
+
+        MPUSampleBlock & operator=(MPUSampleBlock && other)
+        {
+            if (this != &other) {
+                release();
+                swap(other);
+            }
+            return *this;
+        }
+
+        MPUSampleBlock(const MPUSampleBlock &) = delete;
+        MPUSampleBlock & operator=(const MPUSampleBlock &) = delete;
+
+        ~MPUSampleBlock(void)
+        {
+            release();
+        }
+
+        // False when the pool was exhausted, or the block has been moved from
+        explicit operator bool(void) const { return _data != NULL; }
+
+        // The samples written so far, and the whole block for filling
+        MPUSpan<MPUIMU::Sample_t> samples(void) const { return MPUSpan<MPUIMU::Sample_t>(_data, _size); }
+        MPUSpan<MPUIMU::Sample_t> space(void) const { return MPUSpan<MPUIMU::Sample_t>(_data, _capacity); }
+
+        MPUIMU::Sample_t * data(void) const { return _data; }
+        uint16_t size(void) const { return _size; }
+        uint16_t capacity(void) const { return _capacity; }
+
+        MPUIMU::Sample_t * begin(void) const { return _data; }
+        MPUIMU::Sample_t * end(void) const { return _data + _size; }
+
+        // After filling space() by some other means; clamps to the capacity
+        void resize(uint32_t size) { _size = size < _capacity ? size : _capacity; }
+
+        // Replaces the contents with what the FIFO holds, up to the capacity
+        uint16_t fill(MPUIMU & imu)
+        {
+            _size = imu.readFifo(space());
+            return _size;
+        }
+
+        // Back to the pool; the block is empty afterward
+        void release(void)
+        {
+            if (_free != NULL) {
+                _free->fetch_or(_bit, std::memory_order_release);
+            }
+
+            _data = NULL;
+            _capacity = 0;
+            _size = 0;
+            _free = NULL;
+            _bit = 0;
+        }
+
+    private:
+
+        MPUSampleBlock(MPUIMU::Sample_t * data, uint16_t capacity, std::atomic<uint32_t> * free, uint32_t bit) :
+            _data(data), _capacity(capacity), _size(0), _free(free), _bit(bit) { }
+
+        void swap(MPUSampleBlock & other)
+        {
+            MPUIMU::Sample_t * data = _data; _data = other._data; other._data = data;
+            uint16_t capacity = _capacity; _capacity = other._capacity; other._capacity = capacity;
+            uint16_t size = _size; _size = other._size; other._size = size;
+            std::atomic<uint32_t> * free = _free; _free = other._free; other._free = free;
+            uint32_t bit = _bit; _bit = other._bit; other._bit = bit;
+        }
+
+        MPUIMU::Sample_t      * _data;
+        uint16_t                _capacity;
+        uint16_t                _size;
+        std::atomic<uint32_t> * _free;  // the pool's mask of free blocks
+        uint32_t                _bit;   // this block's bit in it
+
+}; // class MPUSampleBlock
+
+// Storage for BLOCKS blocks of BLOCK_SIZE samples, with a lock-free mask of the free ones; typically
+// a static, so that nothing is allocated at run time
+template <uint16_t BLOCK_SIZE, uint8_t BLOCKS>
+class MPUSamplePool {
+
+    static_assert(BLOCK_SIZE > 0, "MPUSamplePool BLOCK_SIZE must be positive");
+    static_assert(BLOCKS > 0 && BLOCKS <= 32, "MPUSamplePool holds from one to 32 blocks");
+
+    public:
+
+        MPUSamplePool(void) : _free(BLOCKS == 32 ? 0xFFFFFFFF : (1UL << BLOCKS) - 1) { }
+
+        MPUSamplePool(const MPUSamplePool &) = delete;
+        MPUSamplePool & operator=(const MPUSamplePool &) = delete;
+
+        // An empty block when every one is in use
+        MPUSampleBlock acquire(void)
+        {
+            uint32_t free = _free.load(std::memory_order_relaxed);
+
+            while (free) {
+
+                uint32_t bit = free & (~free + 1); // lowest free block
+
+                if (_free.compare_exchange_weak(free, free & ~bit, std::memory_order_acquire, std::memory_order_relaxed)) {
+
+                    uint8_t index = 0;
+                    while (!(bit & (1UL << index))) {
+                        index++;
+                    }
+
+                    return MPUSampleBlock(_samples[index], BLOCK_SIZE, &_free, bit);
+                }
+            }
+
+            return MPUSampleBlock();
+        }
+
+        uint8_t available(void) const
+        {
+            uint32_t free = _free.load(std::memory_order_relaxed);
+
+            uint8_t count = 0;
+            for (; free; free &= free - 1) {
+                count++;
+            }
+
+            return count;
+        }
+
+    private:
+
+        MPUIMU::Sample_t      _samples[BLOCKS][BLOCK_SIZE];
+        std::atomic<uint32_t> _free;
+
+}; // class MPUSamplePool
@@ -0,0 +1,309 @@
+/*
+   MPUSharedRing.cpp: Shared-memory sample ring for publishing to other processes on Linux
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+
+#include "MPUSharedRing.h"
+
+#include <fcntl.h>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(MPUSharedRing::Frame_t) == 56, "Frame_t layout changed");
+static_assert(sizeof(MPUSharedRing::Slot_t) == 64, "Slot_t should fill one cache line");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared counters must be lock-free to work across processes");
+
+MPUSharedRing::MPUSharedRing(void)
+{
+    _header = NULL;
+    _slots = NULL;
+    _size = 0;
+    _name[0] = 0;
+    _head = 0;
+}
+
+MPUSharedRing::~MPUSharedRing(void)
+{
+    close();
+}
+
+bool MPUSharedRing::create(const char * name, float sampleRate, uint32_t capacity)
+{
+    close();
+
+    uint32_t slots = 1;
+    while (slots < capacity) {
+        slots <<= 1;
+    }
+
+    size_t size = sizeof(Header_t) + (size_t)slots * sizeof(Slot_t);
+
+    // Readers of an earlier ring of this name keep their own mapping of it
+    shm_unlink(name);
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    void * memory = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (memory == MAP_FAILED) {
+        shm_unlink(name);
+        return false;
+    }
+
+    _header = (Header_t *)memory;
+    _slots = (Slot_t *)((uint8_t *)memory + sizeof(Header_t));
+    _size = size;
+    _head = 0;
+    snprintf(_name, sizeof(_name), "%s", name);
+
+    _header->version = VERSION;
+    _header->frameSize = sizeof(Frame_t);
+    _header->capacity = slots;
+    _header->sampleRate = sampleRate;
+    new (&_header->head) std::atomic<uint32_t>(0);
+
+    for (uint32_t k=0; k<slots; ++k) {
+        new (&_slots[k].sequence) std::atomic<uint32_t>(0);
+    }
+
+    // Readers check the magic number last
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = MAGIC;
+
+    return true;
+}
+
+void MPUSharedRing::close(void)
+{
+    if (_header == NULL) {
+        return;
+    }
+
+    munmap(_header, _size);
+    shm_unlink(_name);
+
+    _header = NULL;
+    _slots = NULL;
+}
+
+void MPUSharedRing::publish(const MPUIMU::Sample_t & sample, uint32_t calibration)
+{
+    if (_header == NULL) {
+        return;
+    }
+
+    uint32_t n = _head;
+    Slot_t & slot = _slots[n & (_header->capacity - 1)];
+
+    slot.sequence.store(2*n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Frame_t & frame = slot.frame;
+    frame.timestamp = sample.timestamp;
+    for (uint8_t k=0; k<3; ++k) {
+        frame.accel[k] = sample.accel[k];
+        frame.gyro[k] = sample.gyro[k];
+        frame.mag[k] = sample.mag[k];
+    }
+    frame.temperature = sample.temperature;
+    frame.calibration = calibration;
+    frame.magAge = sample.magAge;
+    frame.reserved = 0;
+
+    slot.sequence.store(2*n + 2, std::memory_order_release);
+
+    _head = n + 1;
+    _header->head.store(_head, std::memory_order_release);
+}
+
+MPUSharedRingReader::MPUSharedRingReader(void)
+{
+    _header = NULL;
+    _slots = NULL;
+    _size = 0;
+    _capacity = 0;
+    _next = 0;
+    _missed = 0;
+}
+
+MPUSharedRingReader::~MPUSharedRingReader(void)
+{
+    close();
+}
+
+bool MPUSharedRingReader::open(const char * name)
+{
+    close();
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    void * memory = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(MPUSharedRing::Header_t)) {
+        memory = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    const MPUSharedRing::Header_t * header = (const MPUSharedRing::Header_t *)memory;
+
+    bool ok = header->magic == MPUSharedRing::MAGIC;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    uint32_t capacity = header->capacity;
+
+    ok = ok && header->version == MPUSharedRing::VERSION && header->frameSize == sizeof(MPUSharedRing::Frame_t) &&
+        capacity && (capacity & (capacity-1)) == 0 &&
+        (size_t)st.st_size >= sizeof(MPUSharedRing::Header_t) + (size_t)capacity * sizeof(MPUSharedRing::Slot_t);
+
+    if (!ok) {
+        munmap(memory, st.st_size);
+        return false;
+    }
+
+    _header = header;
+    _slots = (const MPUSharedRing::Slot_t *)((const uint8_t *)memory + sizeof(MPUSharedRing::Header_t));
+    _size = st.st_size;
+    _capacity = capacity;
+    _next = header->head.load(std::memory_order_acquire);
+    _missed = 0;
+
+    return true;
+}
+
+void MPUSharedRingReader::close(void)
+{
+    if (_header == NULL) {
+        return;
+    }
+
+    munmap((void *)_header, _size);
+
+    _header = NULL;
+    _slots = NULL;
+}
+
+// A copy is good if the slot held frame n, finished, both before and after it was taken
+bool MPUSharedRingReader::copy(uint32_t n, MPUSharedRing::Frame_t & frame)
+{
+    const MPUSharedRing::Slot_t & slot = _slots[n & (_capacity - 1)];
+
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != 2*n + 2) {
+        return false;
+    }
+
+    memcpy(&frame, &slot.frame, sizeof(frame));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+bool MPUSharedRingReader::read(MPUSharedRing::Frame_t & frame)
+{
+    if (_header == NULL) {
+        return false;
+    }
+
+    while (true) {
+
+        uint32_t head = _header->head.load(std::memory_order_acquire);
+
+        if (head == _next) {
+            return false;
+        }
+
+        // The slot of frame head - capacity is the next to be overwritten
+        if (head - _next >= _capacity) {
+            uint32_t oldest = head - _capacity + 1;
+            _missed += oldest - _next;
+            _next = oldest;
+        }
+
+        if (copy(_next, frame)) {
+            _next++;
+            return true;
+        }
+
+        // Lapped while copying; the head has moved on, so go round again
+    }
+}
+
+uint32_t MPUSharedRingReader::read(MPUSharedRing::Frame_t * frames, uint32_t maxFrames)
+{
+    uint32_t count = 0;
+
+    while (count < maxFrames && read(frames[count])) {
+        count++;
+    }
+
+    return count;
+}
+
+bool MPUSharedRingReader::latest(MPUSharedRing::Frame_t & frame)
+{
+    if (_header == NULL) {
+        return false;
+    }
+
+    while (true) {
+
+        uint32_t head = _header->head.load(std::memory_order_acquire);
+
+        if (head == 0 && _slots[0].sequence.load(std::memory_order_acquire) == 0) {
+            return false; // nothing published yet
+        }
+
+        if (copy(head - 1, frame)) {
+            return true;
+        }
+    }
+}
+
+uint32_t MPUSharedRingReader::available(void)
+{
+    if (_header == NULL) {
+        return 0;
+    }
+
+    uint32_t count = _header->head.load(std::memory_order_acquire) - _next;
+
+    return count < _capacity ? count : _capacity - 1;
+}
+
+#endif // __linux__
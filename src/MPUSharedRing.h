@@ -0,0 +1,157 @@
+/*
+   MPUSharedRing.h: Shared-memory sample ring for publishing to other processes on Linux
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#if defined(__linux__)
+
+#include "MPU.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// One process owns the bus and publishes every sample into a POSIX shared-memory object; any number
+// of others map it read-only and follow it, with no system calls, no bus transfers, and nothing the
+// publisher waits for.  The object is a Header_t and then capacity slots, each a sequence and a
+// Frame_t on one cache line.  The writer makes a slot's sequence odd while it fills the frame and
+// then 2 * (frame number + 1), so a reader knows from the sequence both whether its copy is whole and
+// whether the publisher has lapped it.  Readers never write, so a reader that stops costs nothing.
+// Counters are 32 bits, whose atomic loads are plain loads on every target (64-bit ones are not on
+// 32-bit ARM, and would fault on the read-only mapping); they wrap, which the arithmetic allows for.
+class MPUSharedRing {
+
+    public:
+
+        // The layout other programs build against: host byte order, no padding
+        typedef struct {
+
+            uint64_t timestamp;     // microseconds, CLOCK_MONOTONIC
+            float    accel[3];      // g
+            float    gyro[3];       // degrees per second
+            float    temperature;   // degrees Centigrade
+            float    mag[3];        // milliGauss; zero on devices without a magnetometer
+            uint32_t calibration;   // MPUIMU::getCalibrationEpoch() when the sample was read
+            uint16_t magAge;        // as in MPUIMU::Sample_t
+            uint16_t reserved;
+
+        } Frame_t;
+
+        static const uint32_t MAGIC   = 0x52555050; // "PPUR"
+        static const uint16_t VERSION = 2;
+
+        static const uint32_t DEFAULT_CAPACITY = 1024;
+
+        typedef struct {
+
+            uint32_t magic;
+            uint16_t version;
+            uint16_t frameSize;     // sizeof(Frame_t)
+            uint32_t capacity;      // slots, a power of two
+            float    sampleRate;    // Hz, as the publisher's device was configured
+
+            // Frames published so far, modulo 2^32; frame n is in slot n % capacity
+            alignas(64) std::atomic<uint32_t> head;
+
+        } Header_t;
+
+        typedef struct {
+
+            std::atomic<uint32_t> sequence;
+            uint32_t              reserved;
+            Frame_t               frame;
+
+        } Slot_t;
+
+        // Publisher.  name is a shared-memory name such as "/mpu", which appears as /dev/shm/mpu and
+        // is removed again by close(); capacity is rounded up to a power of two.
+        MPUSharedRing(void);
+
+        ~MPUSharedRing(void);
+
+        bool create(const char * name, float sampleRate, uint32_t capacity=DEFAULT_CAPACITY);
+
+        void close(void);
+
+        bool isOpen(void) { return _header != NULL; }
+
+        void publish(const MPUIMU::Sample_t & sample, uint32_t calibration);
+
+    private:
+
+        Header_t * _header;
+        Slot_t   * _slots;
+        size_t     _size;
+        char       _name[64];
+
+        uint32_t   _head;
+
+}; // class MPUSharedRing
+
+class MPUSharedRingReader {
+
+    public:
+
+        MPUSharedRingReader(void);
+
+        ~MPUSharedRingReader(void);
+
+        // read() then returns the frames published from now on.  False if there is no ring of that
+        // name, or it has another layout.
+        bool open(const char * name);
+
+        void close(void);
+
+        bool isOpen(void) { return _header != NULL; }
+
+        // The frame after the one last read, false once caught up.  A reader that falls a whole ring
+        // behind skips to the oldest frame still there and counts what it missed.
+        bool read(MPUSharedRing::Frame_t & frame);
+
+        uint32_t read(MPUSharedRing::Frame_t * frames, uint32_t maxFrames);
+
+        uint32_t read(MPUSpan<MPUSharedRing::Frame_t> frames) { return read(frames.data(), frames.size()); }
+
+        // Most recent frame, for readers that only want the current state
+        bool latest(MPUSharedRing::Frame_t & frame);
+
+        uint32_t available(void);
+
+        uint64_t getMissed(void) { return _missed; }
+
+        float    getSampleRate(void) { return _header ? _header->sampleRate : 0; }
+
+        uint32_t getCapacity(void) { return _capacity; }
+
+    private:
+
+        const MPUSharedRing::Header_t * _header;
+        const MPUSharedRing::Slot_t   * _slots;
+        size_t                          _size;
+        uint32_t                        _capacity;
+
+        uint32_t _next;
+        uint64_t _missed;
+
+        bool copy(uint32_t n, MPUSharedRing::Frame_t & frame);
+
+}; // class MPUSharedRingReader
+
+#endif // __linux__
@@ -0,0 +1,564 @@
+/*
+   MPUSimulator.cpp: Register-level model of the MPU6500/MPU9250 and its AK8963, for testing without hardware
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPUSimulator.h"
+
+#include <string.h>
+
+MPUSimulator::MPUSimulator(uint8_t whoAmI)
+{
+    _whoAmI = whoAmI;
+
+    _time = 0;
+    _transferTime = 0;
+    _sampleCount = 0;
+    _fifoOverflows = 0;
+
+    _dmpPacketSize = 0;
+
+    _trace = NULL;
+    _traceSize = 0;
+    _tracePos = 0;
+    _replayMisses = 0;
+
+    // At rest and level, in a typical field
+    setAccel(0, 0, 1);
+    setGyro(0, 0, 0);
+    setTemperature(25);
+    setMag(200, 50, -400);
+
+    reset();
+
+    memset(_ak, 0, sizeof(_ak));
+    _ak[0x00] = 0x48; // WIA
+    _ak[AK8963_ASAX]   = 0x80; // unity sensitivity adjustment
+    _ak[AK8963_ASAX+1] = 0x80;
+    _ak[AK8963_ASAX+2] = 0x80;
+    _nextMagSample = 0;
+}
+
+void MPUSimulator::reset(void)
+{
+    memset(_regs, 0, sizeof(_regs));
+
+    _regs[WHO_AM_I]   = _whoAmI;
+    _regs[PWR_MGMT_1] = 0x01;
+
+    for (uint8_t k=0; k<3; ++k) {
+        _regs[SELF_TEST_X_GYRO+k]  = 1;
+        _regs[SELF_TEST_X_ACCEL+k] = 1;
+    }
+
+    _fifoHead = 0;
+    _fifoCount = 0;
+
+    memset(_dmp, 0, sizeof(_dmp));
+
+    for (uint8_t k=0; k<3; ++k) {
+        _womAccel[k] = 0;
+    }
+
+    _nextSample = _time + samplePeriod();
+}
+
+void MPUSimulator::setAccel(float x, float y, float z)
+{
+    _accel[0] = x;
+    _accel[1] = y;
+    _accel[2] = z;
+}
+
+void MPUSimulator::setGyro(float x, float y, float z)
+{
+    _gyro[0] = x;
+    _gyro[1] = y;
+    _gyro[2] = z;
+}
+
+void MPUSimulator::setTemperature(float degrees)
+{
+    _temperature = degrees;
+}
+
+void MPUSimulator::setMag(float x, float y, float z)
+{
+    _mag[0] = x;
+    _mag[1] = y;
+    _mag[2] = z;
+}
+
+void MPUSimulator::advance(uint32_t usec)
+{
+    _time += (uint64_t)usec * 1000;
+}
+
+void MPUSimulator::setTime(uint64_t usec)
+{
+    if (usec * 1000 > _time) {
+        _time = usec * 1000;
+    }
+}
+
+uint64_t MPUSimulator::samplePeriod(void)
+{
+    uint8_t dlpf = _regs[CONFIG] & 0x07;
+
+    // The low-power accelerometer cycle runs at 500 Hz / 2^(11 - LP_ACCEL_ODR)
+    if (_regs[PWR_MGMT_1] & 0x20) {
+        uint8_t odr = _regs[LP_ACCEL_ODR] & 0x0F;
+        return 2000000ull << (11 - (odr > 11 ? 11 : odr));
+    }
+
+    // Fchoice_b set bypasses the DLPF at 32 kHz; DLPF settings 0 and 7 run at 8 kHz; neither divides
+    if (_regs[GYRO_CONFIG] & 0x03) {
+        return 31250;
+    }
+    if (dlpf == 0 || dlpf == 7) {
+        return 125000;
+    }
+
+    return 1000000ull * (1 + _regs[SMPLRT_DIV]);
+}
+
+float MPUSimulator::getSampleRate(void)
+{
+    return 1e9f / samplePeriod();
+}
+
+uint64_t MPUSimulator::magPeriod(void)
+{
+    switch (_ak[AK8963_CNTL] & 0x0F) {
+        case 0x01:
+            return 8000000;   // single measurement
+        case 0x02:
+            return 125000000; // 8 Hz
+        case 0x06:
+            return 10000000;  // 100 Hz
+    }
+
+    return 0;
+}
+
+void MPUSimulator::update(void)
+{
+    uint64_t period = samplePeriod();
+
+    if (_time >= _nextSample) {
+
+        uint64_t n = (_time - _nextSample) / period + 1;
+
+        // Only the last FIFO_SIZE frames could still be observed
+        uint64_t skip = n > FIFO_SIZE ? n - FIFO_SIZE : 0;
+        if (skip && (_regs[USER_CTRL] & 0x40) && _regs[FIFO_EN]) {
+            _fifoOverflows += (uint32_t)skip;
+        }
+
+        for (uint64_t k=skip; k<n; ++k) {
+            produceSample();
+        }
+
+        _sampleCount += n;
+        _nextSample += n * period;
+    }
+
+    uint64_t magPer = magPeriod();
+
+    if (magPer && _time >= _nextMagSample) {
+
+        produceMagSample();
+
+        // Single-measurement mode powers down afterward
+        if ((_ak[AK8963_CNTL] & 0x0F) == 0x01) {
+            _ak[AK8963_CNTL] &= 0xF0;
+        }
+        else {
+            _nextMagSample += ((_time - _nextMagSample) / magPer + 1) * magPer;
+        }
+    }
+}
+
+void MPUSimulator::putRaw(uint8_t * dest, float value)
+{
+    int32_t raw = (int32_t)(value < 0 ? value - 0.5f : value + 0.5f);
+
+    if (raw > 32767) raw = 32767;
+    if (raw < -32768) raw = -32768;
+
+    dest[0] = (uint8_t)((raw >> 8) & 0xFF);
+    dest[1] = (uint8_t)(raw & 0xFF);
+}
+
+void MPUSimulator::produceSample(void)
+{
+    uint8_t afs = (_regs[ACCEL_CONFIG] >> 3) & 0x03;
+    uint8_t gfs = (_regs[GYRO_CONFIG] >> 3) & 0x03;
+
+    // Wake-on-motion compares each sample with the previous one, at 4 mg per WOM_THR count
+    bool wom = (_regs[MOT_DETECT_CTRL] & 0x80) && (_regs[INT_ENABLE] & 0x40);
+
+    for (uint8_t k=0; k<3; ++k) {
+
+        float a = _accel[k] * (16384 >> afs);
+        if (_regs[ACCEL_CONFIG] & (0x80 >> k)) {
+            a += SELF_TEST_RESPONSE;
+        }
+
+        float change = (a - _womAccel[k]) * (1000.f / (16384 >> afs));
+        if (wom && (change > _regs[WOM_THR] * 4.f || change < -_regs[WOM_THR] * 4.f)) {
+            _regs[INT_STATUS] |= 0x40; // WOM_INT
+        }
+        _womAccel[k] = a;
+
+        // Offsets are in 1000 dps units (four counts at 250 dps)
+        int16_t offset = (int16_t)(((uint16_t)_regs[XG_OFFSET_H+2*k] << 8) | _regs[XG_OFFSET_H+2*k+1]);
+        float g = _gyro[k] * 32768.f / (250 << gfs) + offset * 4.f / (1 << gfs);
+        if (_regs[GYRO_CONFIG] & (0x80 >> k)) {
+            g += SELF_TEST_RESPONSE;
+        }
+
+        putRaw(&_regs[ACCEL_XOUT_H+2*k], a);
+        putRaw(&_regs[GYRO_XOUT_H+2*k], g);
+    }
+
+    putRaw(&_regs[TEMP_OUT_H], (_temperature - 21) * 333.87f);
+
+    _regs[INT_STATUS] |= 0x01; // RAW_DATA_RDY_INT
+
+    // The DMP's packets take the place of the frames
+    if ((_regs[USER_CTRL] & 0xC0) == 0xC0) {
+        if (_dmpPacketSize && pushFifo(_dmpPacket, _dmpPacketSize)) {
+            _fifoOverflows++;
+            _regs[INT_STATUS] |= 0x10; // FIFO_OVERFLOW_INT
+        }
+    }
+
+    // Frames go in register order
+    else if ((_regs[USER_CTRL] & 0x40) && _regs[FIFO_EN]) {
+
+        uint8_t fifoEn = _regs[FIFO_EN];
+        bool dropped = false;
+
+        if (fifoEn & 0x08) {
+            dropped |= pushFifo(&_regs[ACCEL_XOUT_H], 6);
+        }
+        if (fifoEn & 0x80) {
+            dropped |= pushFifo(&_regs[TEMP_OUT_H], 2);
+        }
+        for (uint8_t k=0; k<3; ++k) {
+            if (fifoEn & (0x40 >> k)) {
+                dropped |= pushFifo(&_regs[GYRO_XOUT_H+2*k], 2);
+            }
+        }
+
+        if (dropped) {
+            _fifoOverflows++;
+            _regs[INT_STATUS] |= 0x10; // FIFO_OVERFLOW_INT
+        }
+    }
+
+    // Slave 0 reads repeat at every sample
+    if ((_regs[I2C_SLV0_CTRL] & 0x80) && (_regs[I2C_SLV0_ADDR] & 0x80)) {
+        runSlave0();
+    }
+}
+
+void MPUSimulator::produceMagSample(void)
+{
+    bool sixteen = _ak[AK8963_CNTL] & 0x10;
+    float countsPerMilliGauss = (sixteen ? 32760.f : 8190.f) / 49120.f;
+
+    for (uint8_t k=0; k<3; ++k) {
+        uint8_t be[2];
+        putRaw(be, _mag[k] * countsPerMilliGauss);
+        _ak[AK8963_XOUT_L+2*k]   = be[1]; // little-endian
+        _ak[AK8963_XOUT_L+2*k+1] = be[0];
+    }
+
+    // Unread data is overrun
+    if (_ak[AK8963_ST1] & 0x01) {
+        _ak[AK8963_ST1] |= 0x02;
+    }
+    _ak[AK8963_ST1] |= 0x01;
+
+    _ak[AK8963_ST2] = sixteen ? 0x10 : 0x00;
+}
+
+// Overflow drops the oldest bytes, as the device does when FIFO_MODE is clear
+bool MPUSimulator::pushFifo(const uint8_t * data, uint8_t count)
+{
+    bool dropped = false;
+
+    for (uint8_t k=0; k<count; ++k) {
+
+        if (_fifoCount == FIFO_SIZE) {
+            _fifoHead = (_fifoHead + 1) % FIFO_SIZE;
+            _fifoCount--;
+            dropped = true;
+        }
+
+        _fifo[(_fifoHead + _fifoCount) % FIFO_SIZE] = data[k];
+        _fifoCount++;
+    }
+
+    return dropped;
+}
+
+void MPUSimulator::runSlave0(void)
+{
+    uint8_t addr = _regs[I2C_SLV0_ADDR];
+    uint8_t reg  = _regs[I2C_SLV0_REG];
+
+    if ((addr & 0x7F) != AK8963_ADDRESS) {
+        return;
+    }
+
+    if (addr & 0x80) {
+        readAK8963(reg, _regs[I2C_SLV0_CTRL] & 0x0F, &_regs[EXT_SENS_DATA_00]);
+    }
+    else {
+        writeAK8963(reg, _regs[I2C_SLV0_DO]);
+    }
+}
+
+void MPUSimulator::setDMPPacket(const uint8_t * packet, uint8_t size)
+{
+    _dmpPacketSize = size < DMP_PACKET_MAX ? size : DMP_PACKET_MAX;
+    memcpy(_dmpPacket, packet, _dmpPacketSize);
+}
+
+// The byte at BANK_SEL:MEM_START_ADDR, after which the address moves on within the bank
+uint8_t * MPUSimulator::dmpPointer(void)
+{
+    uint8_t * p = &_dmp[(((uint16_t)_regs[BANK_SEL] << 8) | _regs[MEM_START_ADDR]) % DMP_MEMORY_SIZE];
+    _regs[MEM_START_ADDR]++;
+    return p;
+}
+
+void MPUSimulator::writeMPU(uint8_t subAddress, uint8_t data)
+{
+    subAddress &= 0x7F;
+
+    if (subAddress == MEM_R_W) {
+        *dmpPointer() = data;
+        return;
+    }
+
+    if ((subAddress >= INT_STATUS && subAddress <= EXT_SENS_DATA_23) ||
+            subAddress == FIFO_COUNTH || subAddress == FIFO_COUNTL || subAddress == FIFO_R_W ||
+            subAddress == WHO_AM_I || subAddress == SIGNAL_PATH_RESET) {
+        return;
+    }
+
+    if (subAddress == PWR_MGMT_1 && (data & 0x80)) {
+        reset();
+        return;
+    }
+
+    if (subAddress == USER_CTRL) {
+        if (data & 0x04) {
+            _fifoHead = 0;
+            _fifoCount = 0;
+        }
+        data &= 0xF0; // reset bits clear themselves
+    }
+
+    _regs[subAddress] = data;
+
+    // A faster rate (e.g. leaving the low-power cycle) takes effect within one of its periods
+    uint64_t period = samplePeriod();
+    if (_nextSample > _time + period) {
+        _nextSample = _time + period;
+    }
+
+    if (subAddress == I2C_SLV0_CTRL && (data & 0x80)) {
+        runSlave0();
+    }
+}
+
+void MPUSimulator::readMPU(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    subAddress &= 0x7F;
+
+    if (subAddress == MEM_R_W) {
+        for (uint8_t k=0; k<count; ++k) {
+            dest[k] = *dmpPointer();
+        }
+        return;
+    }
+
+    // Bursts from FIFO_R_W keep reading the FIFO
+    if (subAddress == FIFO_R_W) {
+        for (uint8_t k=0; k<count; ++k) {
+            if (_fifoCount) {
+                dest[k] = _fifo[_fifoHead];
+                _fifoHead = (_fifoHead + 1) % FIFO_SIZE;
+                _fifoCount--;
+            }
+            else {
+                dest[k] = 0xFF;
+            }
+        }
+        return;
+    }
+
+    bool clearStatus = false;
+
+    for (uint8_t k=0; k<count; ++k) {
+
+        uint8_t r = (subAddress + k) & 0x7F;
+
+        switch (r) {
+            case FIFO_COUNTH:
+                dest[k] = (_fifoCount >> 8) & 0x1F;
+                break;
+            case FIFO_COUNTL:
+                dest[k] = _fifoCount & 0xFF;
+                break;
+            case INT_STATUS:
+                clearStatus = true;
+                // fall through
+            default:
+                dest[k] = _regs[r];
+        }
+    }
+
+    if (clearStatus) {
+        _regs[INT_STATUS] = 0;
+    }
+}
+
+void MPUSimulator::writeAK8963(uint8_t subAddress, uint8_t data)
+{
+    switch (subAddress) {
+
+        case AK8963_CNTL:
+            _ak[AK8963_CNTL] = data;
+            _nextMagSample = _time + magPeriod();
+            break;
+
+        case AK8963_CNTL2:
+            if (data & 0x01) {
+                memset(&_ak[AK8963_ST1], 0, AK8963_ASAX - AK8963_ST1);
+            }
+            break;
+
+        case 0x0C: // ASTC
+            _ak[subAddress] = data;
+            break;
+    }
+}
+
+void MPUSimulator::readAK8963(uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    for (uint8_t k=0; k<count; ++k) {
+
+        uint8_t r = subAddress + k;
+
+        dest[k] = r < AK8963_SIZE ? _ak[r] : 0;
+
+        // Reading ST2 ends the data read
+        if (r == AK8963_ST2) {
+            _ak[AK8963_ST1] &= ~0x03;
+        }
+    }
+}
+
+void MPUSimulator::replay(const uint8_t * trace, uint32_t size)
+{
+    _trace = trace;
+    _traceSize = size;
+    _tracePos = 0;
+    _replayMisses = 0;
+}
+
+void MPUSimulator::stopReplay(void)
+{
+    _trace = NULL;
+}
+
+// Answers from the next matching read record, skipping anything in between and wrapping around once
+bool MPUSimulator::replayRead(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    subAddress &= 0x7F;
+
+    uint32_t pos = _tracePos;
+
+    for (uint32_t scanned=0; scanned<_traceSize; ) {
+
+        if (pos + 3 > _traceSize) {
+            scanned += _traceSize - pos;
+            pos = 0;
+            continue;
+        }
+
+        uint8_t  op  = _trace[pos];
+        uint8_t  reg = _trace[pos+1] & 0x7F;
+        uint8_t  n   = _trace[pos+2];
+        uint32_t len = 3 + n;
+
+        if (pos + len > _traceSize) {
+            scanned += _traceSize - pos;
+            pos = 0;
+            continue;
+        }
+
+        if (op == address && reg == subAddress && n == count) {
+            memcpy(dest, &_trace[pos+3], count);
+            _tracePos = (pos + len) % _traceSize;
+            return true;
+        }
+
+        pos += len;
+        scanned += len;
+    }
+
+    _replayMisses++;
+    return false;
+}
+
+void MPUSimulator::writeRegister(uint8_t address, uint8_t subAddress, uint8_t data)
+{
+    _time += _transferTime;
+    update();
+
+    if (address == AK8963_ADDRESS) {
+        writeAK8963(subAddress, data);
+    }
+    else {
+        writeMPU(subAddress, data);
+    }
+}
+
+void MPUSimulator::readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest)
+{
+    _time += _transferTime;
+    update();
+
+    if (_trace && replayRead(address, subAddress, count, dest)) {
+        return;
+    }
+
+    if (address == AK8963_ADDRESS) {
+        readAK8963(subAddress, count, dest);
+    }
+    else {
+        readMPU(subAddress, count, dest);
+    }
+}
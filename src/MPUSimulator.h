@@ -0,0 +1,203 @@
+/*
+   MPUSimulator.h: Register-level model of the MPU6500/MPU9250 and its AK8963, for testing without hardware
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Stands behind the transport of MPU9250_Mock and MPU6500_Mock.  Samples are produced on a simulated
+// clock at the rate that SMPLRT_DIV, CONFIG, and GYRO_CONFIG select, from sensor values set by the
+// caller: the data registers and INT_STATUS follow them, the FIFO fills with the frames FIFO_EN
+// selects (and overflows), self-test and gyro offset registers act on the output, the low-power
+// accelerometer cycle and wake-on-motion work, DMP memory can be loaded and read back, and slave 0
+// reaches an AK8963 that produces data at its own rate.  The clock only moves when told, so a
+// test can run many times faster (or slower) than real time.
+//
+// Alternatively, reads are answered from a recorded trace, in order, at full speed.  A trace is a
+// sequence of records, one per transfer:
+//
+//   [address, | TRACE_WRITE for a write] [register] [count] [count bytes of data]
+//
+// with the register's SPI read flag cleared.  Writes are still applied to the model, so that its
+// configuration keeps up with the trace; reads that the trace cannot match are answered by the model.
+class MPUSimulator {
+
+    public:
+
+        static const uint8_t MPU_ADDRESS    = 0x68;
+        static const uint8_t AK8963_ADDRESS = 0x0C;
+
+        static const uint8_t TRACE_WRITE    = 0x80;
+
+        static const uint16_t FIFO_SIZE     = 512;
+
+        // Transfer time the mock devices use during begin(), in microseconds
+        static const uint32_t STARTUP_TRANSFER_TIME = 5000;
+
+        MPUSimulator(uint8_t whoAmI=0x71);
+
+        // Power-on register state; the clock and sensor values are kept
+        void reset(void);
+
+        // Sensor values in the units of MPUIMU::Sample_t
+        void setAccel(float x, float y, float z);
+        void setGyro(float x, float y, float z);
+        void setTemperature(float degrees);
+        void setMag(float x, float y, float z);
+
+        // Simulated time, in microseconds
+        void     advance(uint32_t usec);
+        void     setTime(uint64_t usec);
+        uint64_t getTime(void) { return _time / 1000; }
+
+        // Time each transfer adds to the clock, e.g. to model the bus, or the delays of a startup sequence
+        void setTransferTime(uint32_t usec) { _transferTime = (uint64_t)usec * 1000; }
+        uint32_t getTransferTime(void) { return (uint32_t)(_transferTime / 1000); }
+
+        // Rate at which the current configuration produces samples, in Hz
+        float getSampleRate(void);
+
+        // Samples produced since construction, and samples that overflowed the FIFO
+        uint64_t getSampleCount(void) { return _sampleCount; }
+        uint32_t getFifoOverflows(void) { return _fifoOverflows; }
+
+        // The trace stays the caller's; replay starts over when it reaches the end
+        void replay(const uint8_t * trace, uint32_t size);
+        void stopReplay(void);
+        uint32_t getReplayMisses(void) { return _replayMisses; }
+
+        // The DMP does not run, but while it is enabled (DMP_EN and FIFO_EN in USER_CTRL) each sample
+        // puts this packet in the FIFO instead of the frames FIFO_EN selects
+        static const uint16_t DMP_MEMORY_SIZE = 4096;
+        static const uint8_t  DMP_PACKET_MAX  = 32;
+
+        void setDMPPacket(const uint8_t * packet, uint8_t size);
+
+        const uint8_t * getDMPMemory(void) { return _dmp; }
+        uint16_t getDMPStartAddress(void) { return ((uint16_t)_regs[PRGM_START_H] << 8) | _regs[PRGM_START_H+1]; }
+
+        // Transport: address is MPU_ADDRESS or AK8963_ADDRESS
+        void writeRegister(uint8_t address, uint8_t subAddress, uint8_t data);
+        void readRegisters(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest);
+
+    private:
+
+        // Registers with behavior
+        static const uint8_t SELF_TEST_X_GYRO = 0x00;
+        static const uint8_t SELF_TEST_X_ACCEL= 0x0D;
+        static const uint8_t XG_OFFSET_H      = 0x13;
+        static const uint8_t SMPLRT_DIV       = 0x19;
+        static const uint8_t CONFIG           = 0x1A;
+        static const uint8_t GYRO_CONFIG      = 0x1B;
+        static const uint8_t ACCEL_CONFIG     = 0x1C;
+        static const uint8_t LP_ACCEL_ODR     = 0x1E;
+        static const uint8_t WOM_THR          = 0x1F;
+        static const uint8_t FIFO_EN          = 0x23;
+        static const uint8_t I2C_SLV0_ADDR    = 0x25;
+        static const uint8_t I2C_SLV0_REG     = 0x26;
+        static const uint8_t I2C_SLV0_CTRL    = 0x27;
+        static const uint8_t INT_ENABLE       = 0x38;
+        static const uint8_t INT_STATUS       = 0x3A;
+        static const uint8_t ACCEL_XOUT_H     = 0x3B;
+        static const uint8_t TEMP_OUT_H       = 0x41;
+        static const uint8_t GYRO_XOUT_H      = 0x43;
+        static const uint8_t EXT_SENS_DATA_00 = 0x49;
+        static const uint8_t EXT_SENS_DATA_23 = 0x60;
+        static const uint8_t I2C_SLV0_DO      = 0x63;
+        static const uint8_t SIGNAL_PATH_RESET= 0x68;
+        static const uint8_t MOT_DETECT_CTRL  = 0x69;
+        static const uint8_t USER_CTRL        = 0x6A;
+        static const uint8_t PWR_MGMT_1       = 0x6B;
+        static const uint8_t BANK_SEL         = 0x6D;
+        static const uint8_t MEM_START_ADDR   = 0x6E;
+        static const uint8_t MEM_R_W          = 0x6F;
+        static const uint8_t PRGM_START_H     = 0x70;
+        static const uint8_t FIFO_COUNTH      = 0x72;
+        static const uint8_t FIFO_COUNTL      = 0x73;
+        static const uint8_t FIFO_R_W         = 0x74;
+        static const uint8_t WHO_AM_I         = 0x75;
+
+        static const uint8_t AK8963_ST1       = 0x02;
+        static const uint8_t AK8963_XOUT_L    = 0x03;
+        static const uint8_t AK8963_ST2       = 0x09;
+        static const uint8_t AK8963_CNTL      = 0x0A;
+        static const uint8_t AK8963_CNTL2     = 0x0B;
+        static const uint8_t AK8963_ASAX      = 0x10;
+        static const uint8_t AK8963_SIZE      = 0x13;
+
+        // Self-test response for a SELF_TEST register code of 1 (the factory trim 2620 * 1.01^0)
+        static const int16_t SELF_TEST_RESPONSE = 2620;
+
+        uint8_t _whoAmI;
+
+        uint8_t _regs[128];
+        uint8_t _ak[AK8963_SIZE];
+
+        uint8_t  _fifo[FIFO_SIZE];
+        uint16_t _fifoHead;  // oldest byte
+        uint16_t _fifoCount;
+        uint32_t _fifoOverflows;
+
+        uint8_t _dmp[DMP_MEMORY_SIZE];
+        uint8_t _dmpPacket[DMP_PACKET_MAX];
+        uint8_t _dmpPacketSize;
+
+        float _accel[3];
+        float _gyro[3];
+        float _temperature;
+        float _mag[3];
+
+        // Acceleration at the previous sample, in counts, for wake-on-motion
+        float _womAccel[3];
+
+        // Nanoseconds
+        uint64_t _time;
+        uint64_t _transferTime;
+        uint64_t _nextSample;
+        uint64_t _nextMagSample;
+
+        uint64_t _sampleCount;
+
+        const uint8_t * _trace;
+        uint32_t        _traceSize;
+        uint32_t        _tracePos;
+        uint32_t        _replayMisses;
+
+        void update(void);
+        void produceSample(void);
+        void produceMagSample(void);
+        bool pushFifo(const uint8_t * data, uint8_t count);
+        void runSlave0(void);
+
+        uint64_t samplePeriod(void);
+        uint64_t magPeriod(void);
+
+        uint8_t * dmpPointer(void);
+
+        void writeMPU(uint8_t subAddress, uint8_t data);
+        void readMPU(uint8_t subAddress, uint8_t count, uint8_t * dest);
+        void writeAK8963(uint8_t subAddress, uint8_t data);
+        void readAK8963(uint8_t subAddress, uint8_t count, uint8_t * dest);
+
+        bool replayRead(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t * dest);
+
+        static void putRaw(uint8_t * dest, float value);
+
+}; // class MPUSimulator
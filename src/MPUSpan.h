@@ -0,0 +1,69 @@
+/* 
+   MPUSpan.h: Non-owning view of a contiguous run of items
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A pointer and a count, for handing a caller's buffer to the batch reads (and their results on to
+// the batch consumers) without copying or allocating.  Converts from a built-in array and from a
+// span of non-const items.
+template <typename T>
+class MPUSpan {
+
+    public:
+
+        MPUSpan(void) : _data(NULL), _size(0) { }
+
+        MPUSpan(T * data, uint32_t size) : _data(data), _size(size) { }
+
+        template <uint32_t N>
+        MPUSpan(T (&array)[N]) : _data(array), _size(N) { }
+
+        template <typename U>
+        MPUSpan(const MPUSpan<U> & other) : _data(other.data()), _size(other.size()) { }
+
+        T *      data(void) const { return _data; }
+        uint32_t size(void) const { return _size; }
+        bool     empty(void) const { return _size == 0; }
+
+        T & operator[](uint32_t index) const { return _data[index]; }
+
+        T * begin(void) const { return _data; }
+        T * end(void) const { return _data + _size; }
+
+        // The first count items, or the items from offset on; both clamp to what there is
+        MPUSpan first(uint32_t count) const { return MPUSpan(_data, count < _size ? count : _size); }
+
+        MPUSpan from(uint32_t offset) const
+        {
+            return offset < _size ? MPUSpan(_data + offset, _size - offset) : MPUSpan(_data + _size, 0);
+        }
+
+        // For the batch reads, which count in uint16_t
+        uint16_t size16(void) const { return _size > 0xFFFF ? 0xFFFF : (uint16_t)_size; }
+
+    private:
+
+        T *      _data;
+        uint32_t _size;
+
+}; // class MPUSpan
@@ -0,0 +1,159 @@
+/*
+   MPUTimestamper.cpp: Sample timestamps from the IMU's own sample clock
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MPUTimestamper.h"
+
+MPUTimestamper::MPUTimestamper(float sampleRate)
+{
+    _lastTimestamp = 0;
+
+    setSampleRate(sampleRate);
+}
+
+void MPUTimestamper::begin(MPUIMU & imu)
+{
+    setSampleRate(imu.getSampleRate());
+}
+
+void MPUTimestamper::setSampleRate(float hz)
+{
+    _nominalPeriod = 1e6f / hz;
+    _period = _nominalPeriod;
+
+    reset();
+}
+
+void MPUTimestamper::reset(void)
+{
+    _refIndex = 0;
+    _refTime = 0;
+    _started = false;
+    _locked = false;
+    _next = 0;
+    _havePrev = false;
+}
+
+uint32_t MPUTimestamper::getMissed(uint64_t hostUsec) const
+{
+    if (!_started) {
+        return 0;
+    }
+
+    int64_t late = (int64_t)(hostUsec - getTimestamp(_next));
+
+    return late < _period ? 0 : (uint32_t)(late / _period);
+}
+
+uint64_t MPUTimestamper::getTimestamp(uint64_t index) const
+{
+    int64_t samples = (int64_t)(index - _refIndex);
+
+    return _refTime + (int64_t)(samples * (double)_period);
+}
+
+void MPUTimestamper::observe(uint64_t index, uint64_t hostUsec)
+{
+    if (!_started) {
+        _refIndex = index;
+        _refTime = hostUsec;
+        _started = true;
+        _windowStart = index;
+        _minIndex = index;
+        _minTime = hostUsec;
+        _minResidual = 0;
+        return;
+    }
+
+    // Host time observed past the line; latency only ever adds to this
+    int64_t residual = (int64_t)(hostUsec - getTimestamp(index));
+
+    if (residual < _minResidual) {
+        _minResidual = residual;
+        _minIndex = index;
+        _minTime = hostUsec;
+    }
+
+    // No sample can be seen before it exists, so the line must be late: move it down at once
+    if (residual < 0) {
+        _refIndex = index;
+        _refTime = hostUsec;
+        _minResidual = 0;
+    }
+
+    if (index - _windowStart < WINDOW) {
+        return;
+    }
+
+    if (_havePrev && _minIndex > _prevIndex) {
+
+        float measured = (float)(_minTime - _prevTime) / (float)(_minIndex - _prevIndex);
+
+        if (measured > _nominalPeriod * (1 - MAX_DRIFT) && measured < _nominalPeriod * (1 + MAX_DRIFT)) {
+            _period += (measured - _period) * (_locked ? PERIOD_GAIN : 1);
+            _locked = true;
+        }
+    }
+
+    _prevIndex = _minIndex;
+    _prevTime = _minTime;
+    _havePrev = true;
+
+    // Re-anchor the line on the least-delayed observation of the window
+    _refIndex = _minIndex;
+    _refTime = _minTime;
+
+    _windowStart = index;
+    _minIndex = index;
+    _minTime = hostUsec;
+    _minResidual = (int64_t)(hostUsec - getTimestamp(index));
+}
+
+void MPUTimestamper::stamp(MPUIMU::Sample_t & sample, uint64_t hostUsec)
+{
+    observe(_next, hostUsec);
+
+    sample.timestamp = nextTimestamp();
+}
+
+void MPUTimestamper::stampBatch(MPUIMU::Sample_t * samples, uint16_t count, uint64_t hostUsec)
+{
+    if (count == 0) {
+        return;
+    }
+
+    observe(_next + count - 1, hostUsec);
+
+    for (uint16_t k=0; k<count; ++k) {
+        samples[k].timestamp = nextTimestamp();
+    }
+}
+
+uint64_t MPUTimestamper::nextTimestamp(void)
+{
+    uint64_t timestamp = getTimestamp(_next++);
+
+    if (timestamp < _lastTimestamp) {
+        timestamp = _lastTimestamp;
+    }
+
+    _lastTimestamp = timestamp;
+
+    return timestamp;
+}
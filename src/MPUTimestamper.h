@@ -0,0 +1,105 @@
+/*
+   MPUTimestamper.h: Sample timestamps from the IMU's own sample clock
+
+   Copyright (C) 2018 Simon D. Levy
+
+   This file is part of MPU.
+
+   MPU is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   MPU is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   You should have received a copy of the GNU General Public License
+   along with MPU.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "MPU.h"
+
+// Numbers samples as the device produces them and maps each index onto the host clock as
+// a straight line, so timestamps are evenly spaced at the IMU's true sample period rather
+// than carrying the host's read latency.  Each observation pairs a sample index with a host
+// time no earlier than the sample's production (a data-ready edge, or a FIFO read); the
+// earliest observation in every window marks the line, and the slope between windows gives
+// the period and so the drift of the IMU oscillator from the host clock.
+class MPUTimestamper {
+
+    public:
+
+        // Samples per line update, and the weight a new period measurement gets
+        static const uint16_t WINDOW = 1024;
+        static constexpr float PERIOD_GAIN = 0.125f;
+
+        // Measurements further than this from the nominal period are discarded
+        static constexpr float MAX_DRIFT = 0.05f;
+
+        MPUTimestamper(float sampleRate=1000);
+
+        // Nominal period from imu.getSampleRate(); also resets
+        void begin(MPUIMU & imu);
+
+        void setSampleRate(float hz);
+
+        // Call after anything that loses samples, e.g. a FIFO overflow or reset
+        void reset(void);
+
+        // Samples after the next one to be stamped that the line says were produced by hostUsec; for a
+        // device read from its data registers, which hold only the newest, these were lost
+        uint32_t getMissed(uint64_t hostUsec) const;
+
+        // Sample index was produced no later than hostUsec
+        void observe(uint64_t index, uint64_t hostUsec);
+
+        uint64_t getTimestamp(uint64_t index) const;
+
+        // Stamps a sample whose data-ready edge (or read) happened at hostUsec.  Timestamps never go
+        // backwards, even across reset(): when the line moves down, the next ones wait for it.
+        void stamp(MPUIMU::Sample_t & sample, uint64_t hostUsec);
+
+        // Stamps a FIFO batch read at hostUsec: the frames are the next count samples, the last
+        // of which had been produced by then
+        void stampBatch(MPUIMU::Sample_t * samples, uint16_t count, uint64_t hostUsec);
+
+        // Estimated sample period in microseconds of host time
+        float getPeriod(void) const { return _period; }
+
+        // IMU sample clock relative to the host clock, in parts per million (positive is slow)
+        float getDrift(void) const { return (_period / _nominalPeriod - 1) * 1e6f; }
+
+        bool isLocked(void) const { return _locked; }
+
+    private:
+
+        float _nominalPeriod;
+        float _period;
+
+        // Line through (_refIndex, _refTime) with slope _period
+        uint64_t _refIndex;
+        uint64_t _refTime;
+        bool     _started;
+        bool     _locked;
+
+        // Next sample index to hand out, and the last timestamp
+        uint64_t _next;
+        uint64_t _lastTimestamp;
+
+        // Earliest observation, relative to the line, since the window began
+        uint64_t _windowStart;
+        uint64_t _minIndex;
+        uint64_t _minTime;
+        int64_t  _minResidual;
+
+        // Previous window's earliest observation
+        uint64_t _prevIndex;
+        uint64_t _prevTime;
+        bool     _havePrev;
+
+        uint64_t nextTimestamp(void);
+
+}; // class MPUTimestamper